@@ -51,11 +51,20 @@
 #ifndef APPGLOBAL_H
 #define APPGLOBAL_H
 
+#include <QtGlobal>
+#include <QString>
+
 //#define USE_SIMULATOR
 
 #if defined(Q_OS_WIN32) || defined(Q_OS_LINUX) || defined(USE_SIMULATOR)
 #define SIMULATOR
 #endif
 
+static const QLatin1String BT_SERVER_UUID("3bb45162-cecf-4bcb-be9f-026ec7ab38be");
+
+// Default endpoints for the non-Bluetooth player transports
+static const quint16 PLAYER_TCP_PORT = 7300;
+static const QLatin1String PLAYER_LOCAL_NAME("btnoise-player");
+
 
 #endif // APPGLOBAL_H
@@ -0,0 +1,237 @@
+#include "appconfig.h"
+#include "trace.h"
+
+#include <QSettings>
+#include <QtConcurrent/QtConcurrentRun>
+
+AppConfig::AppConfig(QObject *parent) :
+    QObject(parent)
+{
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(SaveDelay);
+    connect(&m_saveTimer, &QTimer::timeout, this, &AppConfig::save);
+
+    // Changes made while a write was running go out in the next one
+    connect(&m_writer, &QFutureWatcher<void>::finished, this, [this]() {
+        if (m_dirty && !m_saveTimer.isActive())
+            save();
+    });
+}
+
+AppConfig::~AppConfig()
+{
+    flush();
+}
+
+void AppConfig::load()
+{
+    const QSettings settings;
+
+    m_transportKind = PlayerTransport::kindFromString(settings.value("player.transport").toString());
+    m_player.set(settings.value("player.address").toString(), settings.value("player.name").toString());
+    m_speaker.set(settings.value("speaker.address").toString(), settings.value("speaker.name").toString());
+    m_group = settings.value("player.group").toStringList();
+
+    emit transportKindChanged();
+    emit playerChanged();
+    emit speakerChanged();
+    emit groupChanged();
+}
+
+void AppConfig::flush()
+{
+    m_saveTimer.stop();
+    m_writer.waitForFinished();
+
+    if (m_dirty) {
+        m_dirty = false;
+        write(values());
+    }
+}
+
+PlayerTransport::Kind AppConfig::transportKind() const
+{
+    return m_transportKind;
+}
+
+void AppConfig::setTransportKind(PlayerTransport::Kind kind)
+{
+    const bool wasOverridden = m_transportOverridden;
+    m_transportOverridden = false;
+    if (m_transportKind == kind) {
+        // Now the saved value too
+        if (wasOverridden)
+            scheduleSave();
+        return;
+    }
+
+    m_transportKind = kind;
+    scheduleSave();
+    emit transportKindChanged();
+}
+
+void AppConfig::overrideTransportKind(PlayerTransport::Kind kind)
+{
+    if (!m_transportOverridden) {
+        m_savedTransportKind = m_transportKind;
+        m_transportOverridden = true;
+    }
+
+    if (m_transportKind == kind)
+        return;
+
+    m_transportKind = kind;
+    emit transportKindChanged();
+}
+
+bool AppConfig::playerConfigured() const
+{
+    return !m_player.address.isEmpty();
+}
+
+QString AppConfig::playerAddress() const
+{
+    return m_player.address;
+}
+
+QString AppConfig::playerName() const
+{
+    return m_player.name;
+}
+
+QBluetoothAddress AppConfig::playerBluetoothAddress() const
+{
+    return m_player.bluetoothAddress;
+}
+
+void AppConfig::setPlayer(const QString &address, const QString &name)
+{
+    const bool wasOverridden = m_playerOverridden;
+    m_playerOverridden = false;
+    if (!m_player.set(address, name)) {
+        if (wasOverridden)
+            scheduleSave();
+        return;
+    }
+
+    scheduleSave();
+    emit playerChanged();
+}
+
+void AppConfig::overridePlayer(const QString &address, const QString &name)
+{
+    if (!m_playerOverridden) {
+        m_savedPlayer = m_player;
+        m_playerOverridden = true;
+    }
+
+    if (m_player.set(address, name))
+        emit playerChanged();
+}
+
+bool AppConfig::speakerConfigured() const
+{
+    return !m_speaker.address.isEmpty();
+}
+
+QString AppConfig::speakerAddress() const
+{
+    return m_speaker.address;
+}
+
+QString AppConfig::speakerName() const
+{
+    return m_speaker.name;
+}
+
+QBluetoothAddress AppConfig::speakerBluetoothAddress() const
+{
+    return m_speaker.bluetoothAddress;
+}
+
+void AppConfig::setSpeaker(const QString &address, const QString &name)
+{
+    if (!m_speaker.set(address, name))
+        return;
+
+    scheduleSave();
+    emit speakerChanged();
+}
+
+QStringList AppConfig::group() const
+{
+    return m_group;
+}
+
+void AppConfig::setGroup(const QStringList &group)
+{
+    if (m_group == group)
+        return;
+
+    m_group = group;
+    scheduleSave();
+    emit groupChanged();
+}
+
+bool AppConfig::Device::set(const QString &newAddress, const QString &newName)
+{
+    if (address == newAddress && name == newName)
+        return false;
+
+    if (address != newAddress)
+        bluetoothAddress = QBluetoothAddress(newAddress);
+    address = newAddress;
+    name = newName;
+    return true;
+}
+
+void AppConfig::scheduleSave()
+{
+    m_dirty = true;
+    m_saveTimer.start();
+}
+
+void AppConfig::save()
+{
+    // One write at a time, so an older snapshot can't land last
+    if (m_writer.isRunning())
+        return;
+
+    m_dirty = false;
+    m_writer.setFuture(QtConcurrent::run(&AppConfig::write, values()));
+}
+
+QVariantHash AppConfig::values() const
+{
+    auto orNull = [](const QString &value) {
+        return value.isEmpty() ? QVariant() : QVariant(value);
+    };
+
+    const PlayerTransport::Kind transportKind = m_transportOverridden ? m_savedTransportKind : m_transportKind;
+    const Device &player = m_playerOverridden ? m_savedPlayer : m_player;
+
+    QVariantHash result;
+    result.insert(QStringLiteral("player.transport"), PlayerTransport::kindToString(transportKind));
+    result.insert(QStringLiteral("player.address"), orNull(player.address));
+    result.insert(QStringLiteral("player.name"), orNull(player.name));
+    result.insert(QStringLiteral("player.group"), m_group.isEmpty() ? QVariant() : QVariant(m_group));
+    result.insert(QStringLiteral("speaker.address"), orNull(m_speaker.address));
+    result.insert(QStringLiteral("speaker.name"), orNull(m_speaker.name));
+    return result;
+}
+
+void AppConfig::write(const QVariantHash &values)
+{
+    QSettings settings;
+
+    for (auto it = values.cbegin(); it != values.cend(); ++it) {
+        if (it.value().isNull())
+            settings.remove(it.key());
+        else
+            settings.setValue(it.key(), it.value());
+    }
+
+    settings.sync();
+    if (settings.status() != QSettings::NoError)
+        qCWarning(lcUi) << "writing settings failed" << settings.status();
+}
@@ -0,0 +1,100 @@
+#ifndef APPCONFIG_H
+#define APPCONFIG_H
+
+#include "playertransport.h"
+
+#include <QObject>
+#include <QBluetoothAddress>
+#include <QFutureWatcher>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantHash>
+
+// The app's settings, read from QSettings once at startup and served from
+// memory afterwards. Changes notify at once; they are written back on a
+// worker thread a moment after the last one, so neither QML bindings nor
+// the GUI thread wait on the settings file.
+class AppConfig : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool playerConfigured READ playerConfigured NOTIFY playerChanged)
+    Q_PROPERTY(bool speakerConfigured READ speakerConfigured NOTIFY speakerChanged)
+
+public:
+    // Quiet time before changes are written, in ms
+    static const int SaveDelay = 1000;
+
+    explicit AppConfig(QObject *parent = nullptr);
+    // Writes anything still pending
+    ~AppConfig();
+
+    void load();
+    // Writes pending changes now, on the calling thread
+    void flush();
+
+    PlayerTransport::Kind transportKind() const;
+    void setTransportKind(PlayerTransport::Kind kind);
+    // For this run only, e.g. from the command line: the saved value stays
+    // as it was. A later setTransportKind() is saved as usual and ends the
+    // override.
+    void overrideTransportKind(PlayerTransport::Kind kind);
+
+    bool playerConfigured() const;
+    QString playerAddress() const;
+    QString playerName() const;
+    // Parsed once; null for players reached over TCP or a local socket
+    QBluetoothAddress playerBluetoothAddress() const;
+    void setPlayer(const QString &address, const QString &name);
+    // Same as overrideTransportKind()
+    void overridePlayer(const QString &address, const QString &name);
+
+    bool speakerConfigured() const;
+    QString speakerAddress() const;
+    QString speakerName() const;
+    QBluetoothAddress speakerBluetoothAddress() const;
+    void setSpeaker(const QString &address, const QString &name);
+
+    // Players controlled along with the configured one
+    QStringList group() const;
+    void setGroup(const QStringList &group);
+
+signals:
+    void transportKindChanged();
+    void playerChanged();
+    void speakerChanged();
+    void groupChanged();
+
+private:
+    struct Device {
+        QString address;
+        QString name;
+        QBluetoothAddress bluetoothAddress;
+
+        bool set(const QString &newAddress, const QString &newName);
+    };
+
+    void scheduleSave();
+    void save();
+    // Null values are removed from the settings
+    QVariantHash values() const;
+    static void write(const QVariantHash &values);
+
+    PlayerTransport::Kind m_transportKind = PlayerTransport::Rfcomm;
+    Device m_player;
+    Device m_speaker;
+    QStringList m_group;
+
+    // What is written while an override is in effect
+    bool m_transportOverridden = false;
+    PlayerTransport::Kind m_savedTransportKind = PlayerTransport::Rfcomm;
+    bool m_playerOverridden = false;
+    Device m_savedPlayer;
+
+    // Changed since the last write was started
+    bool m_dirty = false;
+    QTimer m_saveTimer;
+    QFutureWatcher<void> m_writer;
+};
+
+#endif // APPCONFIG_H
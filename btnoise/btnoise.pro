@@ -1,7 +1,7 @@
 TEMPLATE = app
 
-QT += qml quick bluetooth
-CONFIG += c++14
+QT += qml quick bluetooth network concurrent
+CONFIG += c++17
 
 # The following define makes your compiler emit warnings if you use
 # any feature of Qt which as been marked deprecated (the exact warnings
@@ -14,17 +14,68 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# qmake CONFIG+=notrace compiles the binary trace points out
+notrace: DEFINES += NO_TRACE
+
 HEADERS += \
         deviceinfo.h \
         devicefinder.h \
+        appconfig.h \
         bluetoothbaseclass.h \
+        playertransport.h \
+        rfcommtransport.h \
+        tcptransport.h \
+        localtransport.h \
+        protocol.h \
+        clockestimator.h \
+        outboundbuffer.h \
+        commandtracker.h \
+        offlinequeue.h \
+        bulkupload.h \
+        connectionstatemachine.h \
+        playersession.h \
+        playersessionmanager.h \
+        discoverycache.h \
+        discoverypipeline.h \
+        deviceregistry.h \
+        devicelistmodel.h \
+        trace.h \
+        metrics.h \
+        startuptimeline.h \
         app-global.h
 
 SOURCES += \
         main.cpp \
         deviceinfo.cpp \
         devicefinder.cpp \
-        bluetoothbaseclass.cpp
+        appconfig.cpp \
+        bluetoothbaseclass.cpp \
+        playertransport.cpp \
+        rfcommtransport.cpp \
+        tcptransport.cpp \
+        localtransport.cpp \
+        protocol.cpp \
+        clockestimator.cpp \
+        outboundbuffer.cpp \
+        commandtracker.cpp \
+        offlinequeue.cpp \
+        bulkupload.cpp \
+        connectionstatemachine.cpp \
+        playersession.cpp \
+        playersessionmanager.cpp \
+        discoverycache.cpp \
+        discoverypipeline.cpp \
+        deviceregistry.cpp \
+        devicelistmodel.cpp \
+        trace.cpp \
+        metrics.cpp \
+        startuptimeline.cpp
+
+# Stand-in player for running the desktop (SIMULATOR) build without a radio
+win32|linux:!android {
+    HEADERS += simulatedplayer.h
+    SOURCES += simulatedplayer.cpp
+}
 
 RESOURCES += qml.qrc
 
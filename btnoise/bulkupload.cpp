@@ -0,0 +1,300 @@
+#include "bulkupload.h"
+#include "trace.h"
+
+#include <QFileInfo>
+
+BulkUpload::BulkUpload(const QString &fileName, OutboundBuffer *outbound, QObject *parent) :
+    QObject(parent),
+    m_fileName(fileName),
+    m_name(QFileInfo(fileName).fileName()),
+    m_outbound(outbound)
+{
+    m_ackTimer.setSingleShot(true);
+    m_ackTimer.setInterval(AckTimeout);
+    connect(&m_ackTimer, &QTimer::timeout, this, &BulkUpload::ackTimedOut);
+
+    // Room on the link means room for the next chunks
+    connect(m_outbound, &OutboundBuffer::bytesWritten, this, &BulkUpload::pump);
+}
+
+bool BulkUpload::open()
+{
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        fail(m_file.errorString());
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_checksum = 0;
+    while (!m_file.atEnd()) {
+        const QByteArray piece = m_file.read(64 * 1024);
+        if (piece.isEmpty()) {
+            fail(m_file.errorString());
+            return false;
+        }
+        m_checksum = protocolChecksum(piece.constData(), std::size_t(piece.size()), m_checksum);
+    }
+
+    qCInfo(lcProtocol) << "upload of" << m_name << m_size << "bytes, crc" << QString::number(m_checksum, 16);
+    return true;
+}
+
+QString BulkUpload::fileName() const
+{
+    return m_fileName;
+}
+
+QString BulkUpload::name() const
+{
+    return m_name;
+}
+
+qint64 BulkUpload::size() const
+{
+    return m_size;
+}
+
+qint64 BulkUpload::acknowledged() const
+{
+    return m_acked;
+}
+
+qreal BulkUpload::progress() const
+{
+    return m_size ? qreal(m_acked) / m_size : (m_state == Done ? 1 : 0);
+}
+
+qreal BulkUpload::throughput() const
+{
+    if ((m_state != Sending && m_state != Done) || !m_rateClock.isValid())
+        return 0;
+
+    const qint64 elapsed = m_state == Done ? m_rateElapsed : m_rateClock.elapsed();
+    return elapsed > 0 ? qreal(m_acked - m_rateStart) * 1000 / elapsed : 0;
+}
+
+BulkUpload::State BulkUpload::state() const
+{
+    return m_state;
+}
+
+QString BulkUpload::stateName(State state)
+{
+    switch (state) {
+    case Negotiating:
+        return QStringLiteral("negotiating");
+    case Sending:
+        return QStringLiteral("sending");
+    case Done:
+        return QStringLiteral("done");
+    case Failed:
+        return QStringLiteral("failed");
+    case Canceled:
+        return QStringLiteral("canceled");
+    case Waiting:
+    default:
+        return QStringLiteral("waiting");
+    }
+}
+
+QString BulkUpload::errorString() const
+{
+    return m_error;
+}
+
+bool BulkUpload::isFinished() const
+{
+    return m_state == Done || m_state == Failed || m_state == Canceled;
+}
+
+QVariantMap BulkUpload::toVariantMap() const
+{
+    QVariantMap result;
+    result.insert(QStringLiteral("name"), m_name);
+    result.insert(QStringLiteral("state"), stateName(m_state));
+    result.insert(QStringLiteral("size"), m_size);
+    result.insert(QStringLiteral("acknowledged"), m_acked);
+    result.insert(QStringLiteral("progress"), progress());
+    result.insert(QStringLiteral("throughput"), throughput());
+    if (m_state == Failed)
+        result.insert(QStringLiteral("error"), m_error);
+    return result;
+}
+
+void BulkUpload::begin()
+{
+    if (isFinished() || !m_file.isOpen())
+        return;
+
+    // The player decides where to go on from
+    m_retries = 0;
+    setState(Negotiating);
+    sendUpload();
+}
+
+void BulkUpload::suspend()
+{
+    if (isFinished())
+        return;
+
+    m_ackTimer.stop();
+    m_next = m_acked;
+    setState(Waiting);
+}
+
+void BulkUpload::cancel()
+{
+    if (isFinished())
+        return;
+
+    // The player keeps what it got, a later upload of the same file resumes
+    // from there
+    qCInfo(lcProtocol) << "upload of" << m_name << "canceled at" << m_acked;
+    m_ackTimer.stop();
+    m_file.close();
+    setState(Canceled);
+}
+
+void BulkUpload::pump()
+{
+    if (m_state != Sending)
+        return;
+
+    while (m_next < m_size && m_next - m_acked < WindowSize
+           && m_outbound->queuedBytes() < MaxQueuedBytes) {
+        const qint64 length = qMin<qint64>(ChunkSize, m_size - m_next);
+
+        if (m_file.pos() != m_next && !m_file.seek(m_next)) {
+            fail(m_file.errorString());
+            return;
+        }
+        m_chunk.resize(std::size_t(length));
+        if (m_file.read(&m_chunk[0], length) != length) {
+            fail(tr("%1 changed during the upload").arg(m_name));
+            return;
+        }
+
+        m_outbound->bulkCommand(ProtocolOpcode::Chunk)
+            .addUInt(std::uint64_t(m_next))
+            .addUInt(protocolChecksum(m_chunk.data(), m_chunk.size()))
+            .addString(m_chunk)
+            .end();
+        m_next += length;
+    }
+
+    if (m_next > m_acked && !m_ackTimer.isActive())
+        m_ackTimer.start();
+}
+
+void BulkUpload::acknowledge(std::uint64_t offset, std::uint32_t status)
+{
+    if (m_state != Negotiating && m_state != Sending)
+        return;
+
+    if (status == StatusRejected) {
+        fail(tr("The player refused %1").arg(m_name));
+        return;
+    }
+
+    const qint64 at = qint64(qMin<std::uint64_t>(offset, std::uint64_t(m_size) + 1));
+    if (at > m_size) {
+        fail(tr("The player acknowledged more than was sent"));
+        return;
+    }
+
+    m_ackTimer.stop();
+
+    if (m_state == Negotiating) {
+        // Whatever the player holds of an earlier attempt
+        if (at)
+            qCInfo(lcProtocol) << "resuming upload of" << m_name << "at" << at;
+        m_acked = m_next = at;
+        m_rateStart = at;
+        m_rateClock.start();
+        setState(Sending);
+    } else if (status == StatusCorrupt) {
+        if (at < m_acked) {
+            // The assembled file failed its checksum and was thrown away
+            if (++m_restarts > MaxRestarts) {
+                fail(tr("%1 keeps arriving corrupted").arg(m_name));
+                return;
+            }
+            qCInfo(lcProtocol) << "player discarded" << m_name << ", restarting at" << at;
+            m_rateStart = at;
+            m_rateClock.start();
+        } else if (++m_retries > MaxRetries) {
+            fail(tr("%1 keeps arriving corrupted").arg(m_name));
+            return;
+        }
+
+        // Go back: everything sent after the bad chunk is ignored by the
+        // player
+        TRACE(Protocol, UploadRewound, at, m_next);
+        qCDebug(lcProtocol) << "upload of" << m_name << "rewinds from" << m_next << "to" << at;
+        m_acked = m_next = at;
+    } else if (at > m_acked) {
+        m_acked = at;
+        m_retries = 0;
+    }
+
+    emit progressChanged();
+
+    if (m_acked == m_size) {
+        m_rateElapsed = m_rateClock.elapsed();
+        qCInfo(lcProtocol) << "upload of" << m_name << "done," << qRound(throughput()) << "bytes/s";
+        m_file.close();
+        setState(Done);
+        return;
+    }
+
+    pump();
+}
+
+void BulkUpload::setState(State state)
+{
+    if (m_state == state)
+        return;
+
+    m_state = state;
+    emit stateChanged();
+}
+
+void BulkUpload::fail(const QString &error)
+{
+    qCInfo(lcProtocol) << "upload of" << m_name << "failed:" << error;
+    m_ackTimer.stop();
+    m_file.close();
+    m_error = error;
+    setState(Failed);
+}
+
+void BulkUpload::sendUpload()
+{
+    const QByteArray name = m_name.toUtf8();
+    m_outbound->bulkCommand(ProtocolOpcode::Upload)
+        .addUInt(std::uint64_t(m_size))
+        .addUInt(m_checksum)
+        .addString(std::string_view(name.constData(), std::size_t(name.size())))
+        .end();
+    m_ackTimer.start();
+}
+
+void BulkUpload::ackTimedOut()
+{
+    if (++m_retries > MaxRetries) {
+        fail(tr("The player stopped answering"));
+        return;
+    }
+
+    if (m_state == Negotiating) {
+        sendUpload();
+        return;
+    }
+
+    // Whatever is still in flight is sent again; chunks the player already
+    // has are acknowledged and otherwise ignored
+    qCInfo(lcProtocol) << "upload of" << m_name << "stalled, resending from" << m_acked;
+    m_next = m_acked;
+    pump();
+}
@@ -0,0 +1,120 @@
+#ifndef BULKUPLOAD_H
+#define BULKUPLOAD_H
+
+#include "outboundbuffer.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <string>
+
+// One file on its way to the player over the bulk lane of the link (see
+// CapBulkTransfer in protocol.h).
+//
+// Chunks go out in a sliding window: up to WindowSize bytes may be sent
+// ahead of the player's last acknowledgement, enough to cover the round trip
+// of an RFCOMM link at full rate. The window also bounds how long a command
+// can wait behind bulk data, and no more chunks are queued while the link
+// still holds MaxQueuedBytes, so a STOP or SET_VOL only ever waits for a
+// chunk or two.
+//
+// After a disconnect the upload waits, then resumes with a new UPLOAD from
+// wherever the player says it got to.
+class BulkUpload : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Waiting,
+        Negotiating,
+        Sending,
+        Done,
+        Failed,
+        Canceled
+    };
+    Q_ENUM(State)
+
+    static const int ChunkSize = 2048;
+    static const int WindowSize = 8 * ChunkSize;
+    static const int MaxQueuedBytes = 2 * ChunkSize;
+    // Without any acknowledgement for this long the unacknowledged part is
+    // sent again
+    static const int AckTimeout = 5000;
+    static const int MaxRetries = 3;
+    // Full restarts after the player found the assembled file corrupt
+    static const int MaxRestarts = 2;
+
+    BulkUpload(const QString &fileName, OutboundBuffer *outbound, QObject *parent = nullptr);
+
+    // Opens the file and checksums it; false sets Failed
+    bool open();
+
+    QString fileName() const;
+    QString name() const;
+    qint64 size() const;
+    qint64 acknowledged() const;
+    qreal progress() const;
+    // Bytes per second acknowledged since the current connection started
+    // sending, or over the last connection once done
+    qreal throughput() const;
+    State state() const;
+    static QString stateName(State state);
+    QString errorString() const;
+    bool isFinished() const;
+
+    // For QML
+    QVariantMap toVariantMap() const;
+
+public slots:
+    // Announces the upload on a freshly connected link
+    void begin();
+    // The link is gone, wait for the next begin()
+    void suspend();
+    void cancel();
+    // Queues chunks while the window and the link have room
+    void pump();
+
+    void acknowledge(std::uint64_t offset, std::uint32_t status);
+    // Gives up for good
+    void fail(const QString &error);
+
+signals:
+    void stateChanged();
+    void progressChanged();
+
+private:
+    void setState(State state);
+    void sendUpload();
+    void ackTimedOut();
+
+    QString m_fileName;
+    QString m_name;
+    OutboundBuffer *m_outbound;
+    QFile m_file;
+    // Reused for every chunk
+    std::string m_chunk;
+    qint64 m_size = 0;
+    std::uint32_t m_checksum = 0;
+
+    State m_state = Waiting;
+    QString m_error;
+    // Everything before m_acked is with the player, chunks up to m_next are
+    // on their way
+    qint64 m_acked = 0;
+    qint64 m_next = 0;
+    int m_retries = 0;
+    int m_restarts = 0;
+    QTimer m_ackTimer;
+
+    QElapsedTimer m_rateClock;
+    qint64 m_rateStart = 0;
+    // How long the last connection took to finish, in ms
+    qint64 m_rateElapsed = 0;
+};
+
+#endif // BULKUPLOAD_H
@@ -0,0 +1,149 @@
+#include "clockestimator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+// Round trips within this much of the best one still count as good, so a
+// link with steady sub-millisecond jitter keeps more than a single sample
+const std::int64_t MIN_DELAY_SPREAD = 500;
+// Crystal oscillators are within a few tens of ppm; a fit beyond this is
+// noise, not drift
+const double MAX_DRIFT_PPM = 500;
+
+}
+
+std::int64_t ClockEstimator::now()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool ClockEstimator::addSample(std::int64_t t1, std::int64_t t2, std::int64_t t3, std::int64_t t4)
+{
+    const std::int64_t roundTrip = t4 - t1;
+    const std::int64_t playerTime = t3 - t2;
+    if (roundTrip < 0 || playerTime < 0 || playerTime > roundTrip)
+        return false;
+
+    Sample &sample = m_samples[m_next];
+    sample.localTime = t4;
+    sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+    sample.delay = roundTrip - playerTime;
+
+    m_next = (m_next + 1) % WindowSize;
+    if (m_count < WindowSize)
+        m_count++;
+
+    update();
+    return true;
+}
+
+void ClockEstimator::reset()
+{
+    m_count = 0;
+    m_next = 0;
+    m_reference = 0;
+    m_offset = 0;
+    m_drift = 0;
+    m_delay = -1;
+}
+
+bool ClockEstimator::isSynchronized() const
+{
+    return m_count >= MinSamples;
+}
+
+std::size_t ClockEstimator::sampleCount() const
+{
+    return m_count;
+}
+
+std::int64_t ClockEstimator::offsetAt(std::int64_t localTime) const
+{
+    return m_offset + std::llround(m_drift * 1e-6 * double(localTime - m_reference));
+}
+
+std::int64_t ClockEstimator::offset() const
+{
+    return m_offset;
+}
+
+double ClockEstimator::drift() const
+{
+    return m_drift;
+}
+
+std::int64_t ClockEstimator::delay() const
+{
+    return m_delay;
+}
+
+std::int64_t ClockEstimator::toRemote(std::int64_t localTime) const
+{
+    return localTime + offsetAt(localTime);
+}
+
+void ClockEstimator::update()
+{
+    m_delay = m_samples[0].delay;
+    for (std::size_t i = 1; i < m_count; i++)
+        m_delay = std::min(m_delay, m_samples[i].delay);
+
+    const std::int64_t limit = m_delay + std::max(m_delay / 2, MIN_DELAY_SPREAD);
+
+    std::array<Sample, WindowSize> trusted;
+    std::size_t count = 0;
+    std::int64_t first = 0;
+    std::int64_t last = 0;
+    for (std::size_t i = 0; i < m_count; i++) {
+        if (m_samples[i].delay > limit)
+            continue;
+        if (!count || m_samples[i].localTime < first)
+            first = m_samples[i].localTime;
+        if (!count || m_samples[i].localTime > last)
+            last = m_samples[i].localTime;
+        trusted[count++] = m_samples[i];
+    }
+
+    std::array<std::int64_t, WindowSize> offsets;
+    for (std::size_t i = 0; i < count; i++)
+        offsets[i] = trusted[i].offset;
+    std::nth_element(offsets.begin(), offsets.begin() + count / 2, offsets.begin() + count);
+    const std::int64_t median = offsets[count / 2];
+
+    m_reference = last;
+    m_offset = median;
+    m_drift = 0;
+
+    if (count < MinSamples || last - first < MinDriftSpan)
+        return;
+
+    // Least squares around the newest sample and the median, so the sums
+    // stay small enough for doubles to be exact
+    double meanX = 0;
+    double meanY = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        meanX += double(trusted[i].localTime - last);
+        meanY += double(trusted[i].offset - median);
+    }
+    meanX /= double(count);
+    meanY /= double(count);
+
+    double sxx = 0;
+    double sxy = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        const double dx = double(trusted[i].localTime - last) - meanX;
+        sxx += dx * dx;
+        sxy += dx * (double(trusted[i].offset - median) - meanY);
+    }
+
+    const double slope = sxy / sxx;
+    if (std::abs(slope * 1e6) > MAX_DRIFT_PPM)
+        return;
+
+    m_drift = slope * 1e6;
+    m_offset = median + std::llround(meanY - slope * meanX);
+}
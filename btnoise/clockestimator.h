@@ -0,0 +1,67 @@
+#ifndef CLOCKESTIMATOR_H
+#define CLOCKESTIMATOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Estimates a player's clock from TIME / TIME_REPLY exchanges, NTP style.
+// Kept free of Qt like the protocol, so it can be fed recorded samples.
+//
+// Each exchange gives an offset, ((t2 - t1) + (t3 - t4)) / 2, which is off by
+// at most half the round trip. Only the samples whose round trip is close to
+// the smallest one in the window are trusted; a retransmission or a busy
+// radio shows up as a long round trip and is ignored. Once the trusted
+// samples span long enough, a straight line through them also gives the
+// drift between the two clocks.
+class ClockEstimator
+{
+public:
+    static const std::size_t WindowSize = 32;
+    // Samples needed before the estimate is used
+    static const std::size_t MinSamples = 4;
+    // Drift is only fitted over at least this many microseconds
+    static const std::int64_t MinDriftSpan = 10000000;
+
+    // Microseconds on the local monotonic clock
+    static std::int64_t now();
+
+    // t1, t4: request sent, reply received, local clock
+    // t2, t3: request received, reply sent, player clock
+    // Returns false if the sample is inconsistent and was dropped.
+    bool addSample(std::int64_t t1, std::int64_t t2, std::int64_t t3, std::int64_t t4);
+    void reset();
+
+    bool isSynchronized() const;
+    std::size_t sampleCount() const;
+
+    // Player clock minus local clock at localTime, in usec
+    std::int64_t offsetAt(std::int64_t localTime) const;
+    std::int64_t offset() const;
+    // How much faster the player clock runs, in parts per million
+    double drift() const;
+    // Smallest round trip in the window, in usec; negative when empty
+    std::int64_t delay() const;
+
+    std::int64_t toRemote(std::int64_t localTime) const;
+
+private:
+    struct Sample {
+        std::int64_t localTime;
+        std::int64_t offset;
+        std::int64_t delay;
+    };
+
+    void update();
+
+    std::array<Sample, WindowSize> m_samples;
+    std::size_t m_count = 0;
+    std::size_t m_next = 0;
+
+    std::int64_t m_reference = 0;
+    std::int64_t m_offset = 0;
+    double m_drift = 0;
+    std::int64_t m_delay = -1;
+};
+
+#endif // CLOCKESTIMATOR_H
@@ -0,0 +1,250 @@
+#include "commandtracker.h"
+#include "outboundbuffer.h"
+#include "trace.h"
+
+#include <QDebug>
+
+namespace {
+
+// Weight of a new sample in the smoothed round trip time, as TCP's SRTT
+const qreal SMOOTHING = 0.125;
+
+qreal smooth(qreal current, qreal sample)
+{
+    return current < 0 ? sample : current + SMOOTHING * (sample - current);
+}
+
+QString commandName(ProtocolOpcode opcode)
+{
+    const std::string_view name = ProtocolParser::opcodeName(opcode);
+    return QString::fromLatin1(name.data(), static_cast<int>(name.size()));
+}
+
+}
+
+CommandTracker::CommandTracker(OutboundBuffer *outbound, QObject *parent) :
+    QObject(parent),
+    m_outbound(outbound)
+{
+    m_clock.start();
+
+    m_timeoutTimer.setInterval(100);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &CommandTracker::checkTimeouts);
+}
+
+void CommandTracker::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled)
+        return;
+
+    // Disable first, rollbacks run by reset() may already send again
+    m_enabled = enabled;
+
+    if (!enabled)
+        reset();
+}
+
+bool CommandTracker::isEnabled() const
+{
+    return m_enabled;
+}
+
+void CommandTracker::setWindowSize(int size)
+{
+    m_windowSize = qMax(1, size);
+    fillWindow();
+}
+
+int CommandTracker::windowSize() const
+{
+    return m_windowSize;
+}
+
+int CommandTracker::timeoutFor(ProtocolOpcode opcode)
+{
+    switch (opcode) {
+    case ProtocolOpcode::ConnectSpeaker:
+        // Pairing with a speaker easily takes several seconds
+        return 15000;
+    case ProtocolOpcode::Scan:
+    case ProtocolOpcode::UnpairSpeaker:
+        return 5000;
+    case ProtocolOpcode::SetVolume:
+        return 2000;
+    default:
+        return 3000;
+    }
+}
+
+void CommandTracker::send(const ProtocolMessage &message, Rollback rollback)
+{
+    emit commandSent(message.opcode);
+
+    if (!m_enabled) {
+        m_outbound->send(message);
+        return;
+    }
+
+    Command command;
+    command.message = message;
+    command.message.sequence = m_nextSequence++;
+    command.rollback = std::move(rollback);
+
+    if (m_inFlight.size() >= m_windowSize) {
+        m_waiting.enqueue(std::move(command));
+        return;
+    }
+
+    transmit(std::move(command));
+}
+
+void CommandTracker::transmit(Command command)
+{
+    command.sentAt = m_clock.nsecsElapsed();
+    command.deadline = command.sentAt + qint64(timeoutFor(command.message.opcode)) * 1000000;
+
+    TRACE(Protocol, CommandSent, command.message.opcode, command.message.sequence);
+    m_outbound->send(command.message);
+    m_inFlight.insert(command.message.sequence, std::move(command));
+
+    if (!m_timeoutTimer.isActive())
+        m_timeoutTimer.start();
+}
+
+void CommandTracker::fillWindow()
+{
+    while (!m_waiting.isEmpty() && m_inFlight.size() < m_windowSize)
+        transmit(m_waiting.dequeue());
+}
+
+void CommandTracker::acknowledge(std::uint64_t sequence, std::uint32_t status)
+{
+    auto it = m_inFlight.find(sequence);
+    if (it == m_inFlight.end()) {
+        qCInfo(lcProtocol) << "ack for unknown or expired command" << sequence;
+        return;
+    }
+
+    Command command = std::move(it.value());
+    m_inFlight.erase(it);
+
+    if (status != StatusOk) {
+        qCInfo(lcProtocol) << "player rejected command" << sequence << "status" << status;
+        fail(command, false);
+    } else {
+        const qint64 roundTrip = (m_clock.nsecsElapsed() - command.sentAt) / 1000;
+        const qreal ms = roundTrip / 1000.0;
+
+        Stats &stats = m_stats[int(command.message.opcode)];
+        stats.count++;
+        stats.last = ms;
+        stats.smoothed = smooth(stats.smoothed, ms);
+
+        m_roundTripTime = smooth(m_roundTripTime, ms);
+
+        TRACE(Protocol, CommandAcknowledged, command.message.opcode, roundTrip);
+        emit commandAcknowledged(command.message.opcode, roundTrip);
+        emit roundTripTimeChanged();
+        emit latencyStatsChanged();
+    }
+
+    if (m_inFlight.isEmpty())
+        m_timeoutTimer.stop();
+
+    fillWindow();
+}
+
+void CommandTracker::fail(Command &command, bool timedOut)
+{
+    m_stats[int(command.message.opcode)].failed++;
+    TRACE(Protocol, CommandFailed, command.message.opcode, timedOut);
+
+    emit commandFailed(command.message.opcode, timedOut);
+    emit latencyStatsChanged();
+
+    if (command.rollback)
+        command.rollback();
+}
+
+void CommandTracker::checkTimeouts()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+
+    // Collect first, rollbacks may issue new commands
+    QList<Command> expired;
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end(); ) {
+        if (it.value().deadline <= now) {
+            expired.append(std::move(it.value()));
+            it = m_inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (Command &command : expired) {
+        qCInfo(lcProtocol) << "command timed out"
+                           << commandName(command.message.opcode)
+                           << command.message.sequence;
+        fail(command, true);
+    }
+
+    if (m_inFlight.isEmpty())
+        m_timeoutTimer.stop();
+
+    fillWindow();
+}
+
+void CommandTracker::reset()
+{
+    m_timeoutTimer.stop();
+
+    QList<Command> lost = m_inFlight.values();
+    m_inFlight.clear();
+    while (!m_waiting.isEmpty())
+        lost.append(m_waiting.dequeue());
+
+    // Newest first, so each rollback restores what the one before it saw
+    for (int i = lost.size() - 1; i >= 0; i--)
+        fail(lost[i], false);
+}
+
+void CommandTracker::handOver(const Requeue &requeue)
+{
+    m_timeoutTimer.stop();
+
+    QList<Command> lost = m_inFlight.values();
+    m_inFlight.clear();
+    while (!m_waiting.isEmpty())
+        lost.append(m_waiting.dequeue());
+
+    for (Command &command : lost) {
+        command.message.sequence = 0;
+        requeue(command.message, std::move(command.rollback));
+    }
+}
+
+int CommandTracker::inFlight() const
+{
+    return m_inFlight.size();
+}
+
+qreal CommandTracker::roundTripTime() const
+{
+    return m_roundTripTime;
+}
+
+QVariantMap CommandTracker::latencyStats() const
+{
+    QVariantMap result;
+
+    for (auto it = m_stats.constBegin(); it != m_stats.constEnd(); ++it) {
+        QVariantMap stats;
+        stats.insert("count", it.value().count);
+        stats.insert("failed", it.value().failed);
+        stats.insert("last", it.value().last);
+        stats.insert("smoothed", it.value().smoothed);
+        result.insert(commandName(static_cast<ProtocolOpcode>(it.key())), stats);
+    }
+
+    return result;
+}
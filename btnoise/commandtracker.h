@@ -0,0 +1,104 @@
+#ifndef COMMANDTRACKER_H
+#define COMMANDTRACKER_H
+
+#include "protocol.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QQueue>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <functional>
+
+class OutboundBuffer;
+
+// Numbers outgoing commands, keeps at most windowSize() of them in flight and
+// matches the player's ACKs against them. A command that isn't acknowledged
+// in time, is rejected or is lost with the link fails and runs its rollback,
+// so optimistic UI state can be undone. Round trip times are tracked overall
+// and per command type.
+//
+// Until the player has offered CapAcknowledge the tracker is disabled and
+// commands go out unnumbered, fire-and-forget as before.
+class CommandTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Rollback = std::function<void()>;
+
+    explicit CommandTracker(OutboundBuffer *outbound, QObject *parent = nullptr);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    void setWindowSize(int size);
+    int windowSize() const;
+
+    // message must not reference a text argument, it may be held back until
+    // the window opens.
+    void send(const ProtocolMessage &message, Rollback rollback = Rollback());
+    void acknowledge(std::uint64_t sequence, std::uint32_t status);
+    // The link went away: everything in flight or waiting fails.
+    void reset();
+    // The link went away but the commands should outlive it: everything in
+    // flight or waiting goes to requeue instead, oldest first and unnumbered.
+    // Nothing fails, so no rollback runs.
+    using Requeue = std::function<void(const ProtocolMessage &message, Rollback rollback)>;
+    void handOver(const Requeue &requeue);
+
+    int inFlight() const;
+    // Smoothed over all command types, in ms; negative until measured.
+    qreal roundTripTime() const;
+    // Command name -> { count, failed, last, smoothed }, times in ms
+    QVariantMap latencyStats() const;
+
+    static int timeoutFor(ProtocolOpcode opcode);
+
+signals:
+    void roundTripTimeChanged();
+    void latencyStatsChanged();
+    void commandSent(ProtocolOpcode opcode);
+    void commandAcknowledged(ProtocolOpcode opcode, qint64 roundTripUsec);
+    void commandFailed(ProtocolOpcode opcode, bool timedOut);
+
+private:
+    struct Command {
+        ProtocolMessage message;
+        Rollback rollback;
+        qint64 sentAt = 0;
+        qint64 deadline = 0;
+    };
+
+    struct Stats {
+        int count = 0;
+        int failed = 0;
+        qreal last = 0;
+        qreal smoothed = -1;
+    };
+
+    OutboundBuffer *m_outbound;
+    bool m_enabled = false;
+    int m_windowSize = 8;
+    std::uint64_t m_nextSequence = 1;
+
+    // Ordered by sequence, so the first entry is the oldest
+    QMap<std::uint64_t, Command> m_inFlight;
+    QQueue<Command> m_waiting;
+
+    QElapsedTimer m_clock;
+    QTimer m_timeoutTimer;
+
+    QHash<int, Stats> m_stats;
+    qreal m_roundTripTime = -1;
+
+    void transmit(Command command);
+    void fail(Command &command, bool timedOut);
+    void checkTimeouts();
+    void fillWindow();
+};
+
+#endif // COMMANDTRACKER_H
@@ -0,0 +1,241 @@
+#include "connectionstatemachine.h"
+#include "trace.h"
+
+#include <QDebug>
+#include <QRandomGenerator>
+
+ConnectionStateMachine::ConnectionStateMachine(QObject *parent) :
+    QObject(parent)
+{
+    m_connectTimer.setSingleShot(true);
+    connect(&m_connectTimer, &QTimer::timeout, this, [this]() {
+        qCInfo(lcTransport) << "connect attempt timed out";
+        handleFailure();
+    });
+
+    m_backoffTimer.setSingleShot(true);
+    connect(&m_backoffTimer, &QTimer::timeout, this, &ConnectionStateMachine::attempt);
+}
+
+void ConnectionStateMachine::setTransport(PlayerTransport *transport)
+{
+    if (m_transport)
+        m_transport->disconnect(this);
+
+    m_transport = transport;
+    m_connectTimer.stop();
+    m_backoffTimer.stop();
+
+    if (!m_transport) {
+        setState(Idle);
+        return;
+    }
+
+    connect(m_transport, &PlayerTransport::connected, this, &ConnectionStateMachine::handleConnected);
+    connect(m_transport, &PlayerTransport::disconnected, this, &ConnectionStateMachine::handleDisconnected);
+    connect(m_transport, &PlayerTransport::errorOccurred, this, [this]() {
+        // Failed connects don't always end in disconnected()
+        if (m_state == Connecting)
+            handleFailure();
+    });
+
+    m_failedAttempts = 0;
+    setState(Idle);
+    if (m_started)
+        attempt();
+}
+
+void ConnectionStateMachine::setAddress(const QString &address)
+{
+    if (address == m_address)
+        return;
+
+    m_address = address;
+    m_failedAttempts = 0;
+    m_connectTimer.stop();
+    m_backoffTimer.stop();
+
+    if (m_transport && m_transport->state() != PlayerTransport::UnconnectedState) {
+        // Swallow the disconnect of the old link, we reconnect right away
+        m_transport->blockSignals(true);
+        m_transport->close();
+        m_transport->blockSignals(false);
+
+        if (m_state == Connected)
+            emit disconnected();
+    }
+
+    setState(Idle);
+    if (m_started)
+        attempt();
+}
+
+QString ConnectionStateMachine::address() const
+{
+    return m_address;
+}
+
+ConnectionStateMachine::State ConnectionStateMachine::state() const
+{
+    return m_state;
+}
+
+QString ConnectionStateMachine::stateName(State state)
+{
+    switch (state) {
+    case Connecting:
+        return QStringLiteral("connecting");
+    case Connected:
+        return QStringLiteral("connected");
+    case BackingOff:
+        return QStringLiteral("backingOff");
+    case Idle:
+    default:
+        return QStringLiteral("idle");
+    }
+}
+
+int ConnectionStateMachine::retryDelay() const
+{
+    return m_backoffTimer.isActive() ? m_backoffTimer.remainingTime() : 0;
+}
+
+int ConnectionStateMachine::failedAttempts() const
+{
+    return m_failedAttempts;
+}
+
+void ConnectionStateMachine::setConnectTimeout(int ms)
+{
+    m_connectTimeout = ms;
+}
+
+void ConnectionStateMachine::setBackoff(int minimumMs, int maximumMs)
+{
+    m_minimumBackoff = qMax(1, minimumMs);
+    m_maximumBackoff = qMax(m_minimumBackoff, maximumMs);
+}
+
+void ConnectionStateMachine::start()
+{
+    m_started = true;
+
+    if (m_state == Idle)
+        attempt();
+}
+
+void ConnectionStateMachine::stop()
+{
+    m_started = false;
+    m_connectTimer.stop();
+    m_backoffTimer.stop();
+
+    if (m_transport && m_transport->state() != PlayerTransport::UnconnectedState)
+        m_transport->close();
+
+    setState(Idle);
+}
+
+void ConnectionStateMachine::connectNow()
+{
+    m_started = true;
+
+    if (m_state == Idle || m_state == BackingOff) {
+        m_backoffTimer.stop();
+        attempt();
+    }
+}
+
+void ConnectionStateMachine::setState(State state)
+{
+    if (state == m_state)
+        return;
+
+    const State previous = m_state;
+    m_state = state;
+
+    TRACE(Transport, ConnectionState, state, previous);
+    qCInfo(lcTransport) << "player connection" << stateName(previous) << "->" << stateName(state);
+    emit stateChanged(state, previous);
+}
+
+void ConnectionStateMachine::attempt()
+{
+    if (!m_transport || m_address.isEmpty()) {
+        setState(Idle);
+        return;
+    }
+
+    if (m_transport->state() == PlayerTransport::ConnectedState) {
+        handleConnected();
+        return;
+    }
+
+    if (m_transport->state() != PlayerTransport::UnconnectedState) {
+        m_transport->blockSignals(true);
+        m_transport->close();
+        m_transport->blockSignals(false);
+    }
+
+    setState(Connecting);
+    m_connectTimer.start(m_connectTimeout);
+    m_transport->connectToPlayer(m_address);
+}
+
+void ConnectionStateMachine::handleConnected()
+{
+    m_connectTimer.stop();
+    m_backoffTimer.stop();
+    m_failedAttempts = 0;
+
+    const bool wasConnected = m_state == Connected;
+    setState(Connected);
+    if (!wasConnected)
+        emit connected();
+}
+
+void ConnectionStateMachine::handleDisconnected()
+{
+    if (m_state == Connected) {
+        emit disconnected();
+
+        // The link just worked, chances are it comes straight back
+        setState(Idle);
+        if (m_started)
+            attempt();
+        return;
+    }
+
+    if (m_state == Connecting)
+        handleFailure();
+}
+
+void ConnectionStateMachine::handleFailure()
+{
+    m_connectTimer.stop();
+
+    if (m_transport && m_transport->state() != PlayerTransport::UnconnectedState) {
+        m_transport->blockSignals(true);
+        m_transport->close();
+        m_transport->blockSignals(false);
+    }
+
+    if (!m_started) {
+        setState(Idle);
+        return;
+    }
+
+    // min * 2^n capped at max, spread over [0.5, 1.5) so several
+    // controllers don't retry in lockstep
+    const int exponent = qMin(m_failedAttempts, 16);
+    const qint64 base = qMin<qint64>(qint64(m_minimumBackoff) << exponent, m_maximumBackoff);
+    const double jitter = 0.5 + QRandomGenerator::global()->generateDouble();
+    const int delay = static_cast<int>(qMin<qint64>(static_cast<qint64>(base * jitter), m_maximumBackoff));
+
+    m_failedAttempts++;
+
+    qCInfo(lcTransport) << "connect attempt" << m_failedAttempts << "failed, retrying in" << delay << "ms";
+
+    setState(BackingOff);
+    m_backoffTimer.start(delay);
+}
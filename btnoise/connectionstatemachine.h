@@ -0,0 +1,83 @@
+#ifndef CONNECTIONSTATEMACHINE_H
+#define CONNECTIONSTATEMACHINE_H
+
+#include "playertransport.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+
+// Keeps a transport connected to one player address.
+//
+//   Idle ──start()──> Connecting ──connected──> Connected
+//                       │   ^                      │
+//      failed / timeout │   │ backoff expired      │ link lost: retry at once
+//                       v   │                      v
+//                     BackingOff <─────────── Connecting
+//
+// Failed attempts back off exponentially with jitter.
+class ConnectionStateMachine : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Idle,
+        Connecting,
+        Connected,
+        BackingOff
+    };
+    Q_ENUM(State)
+
+    explicit ConnectionStateMachine(QObject *parent = nullptr);
+
+    void setTransport(PlayerTransport *transport);
+    // Changing the address drops the current link and reconnects at once
+    void setAddress(const QString &address);
+    QString address() const;
+
+    State state() const;
+    static QString stateName(State state);
+
+    // Delay before the next attempt while backing off, in ms
+    int retryDelay() const;
+    int failedAttempts() const;
+
+    void setConnectTimeout(int ms);
+    void setBackoff(int minimumMs, int maximumMs);
+
+public slots:
+    void start();
+    void stop();
+    // Skips a pending backoff, e.g. when the user is looking at the player
+    void connectNow();
+
+signals:
+    void stateChanged(ConnectionStateMachine::State state, ConnectionStateMachine::State previous);
+    void connected();
+    void disconnected();
+
+private:
+    QPointer<PlayerTransport> m_transport;
+    QString m_address;
+
+    State m_state = Idle;
+    bool m_started = false;
+    int m_failedAttempts = 0;
+
+    int m_connectTimeout = 10000;
+    int m_minimumBackoff = 500;
+    int m_maximumBackoff = 30000;
+
+    QTimer m_connectTimer;
+    QTimer m_backoffTimer;
+
+    void setState(State state);
+    void attempt();
+    void handleConnected();
+    void handleDisconnected();
+    void handleFailure();
+};
+
+#endif // CONNECTIONSTATEMACHINE_H
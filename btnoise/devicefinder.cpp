@@ -48,101 +48,189 @@
 **
 ****************************************************************************/
 
-#include <sstream>
-
 #include "devicefinder.h"
 #include "deviceinfo.h"
+#include "startuptimeline.h"
+#include "trace.h"
 
-static const QLatin1String BT_SERVER_UUID("3bb45162-cecf-4bcb-be9f-026ec7ab38be");
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
 
-DeviceFinder::DeviceFinder(QSettings *settings, QObject *parent):
+DeviceFinder::DeviceFinder(AppConfig *config, QObject *parent):
     BluetoothBaseClass(parent),
-    m_settings(settings),
+    m_config(config),
     m_localDevice(parent),
-    socket(QBluetoothServiceInfo::RfcommProtocol),
-    m_deviceDiscoveryAgent(this),
-  m_serviceDiscoveryAgent(this)
+    m_discovery(QBluetoothUuid(BT_SERVER_UUID)),
+    m_devices(&m_registry, DiscoveryCache::Player),
+    m_speakerDevices(&m_registry, DiscoveryCache::Speaker),
+    m_sessions(&m_metrics)
 {
-    connect(&m_deviceDiscoveryAgent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered, this, &DeviceFinder::addDevice);
-    connect(&m_deviceDiscoveryAgent, static_cast<void (QBluetoothDeviceDiscoveryAgent::*)(QBluetoothDeviceDiscoveryAgent::Error)>(&QBluetoothDeviceDiscoveryAgent::error),
-            this, &DeviceFinder::scanError);
+    connect(&m_discovery, &DiscoveryPipeline::serviceDiscovered, this, &DeviceFinder::serviceDiscovered);
+    connect(&m_discovery, &DiscoveryPipeline::inquiryError, this, &DeviceFinder::scanError);
+    connect(&m_discovery, &DiscoveryPipeline::finished, this, &DeviceFinder::scanFinished);
 
-    connect(&m_deviceDiscoveryAgent, &QBluetoothDeviceDiscoveryAgent::finished, this, &DeviceFinder::scanFinished);
-    connect(&m_deviceDiscoveryAgent, &QBluetoothDeviceDiscoveryAgent::canceled, this, &DeviceFinder::scanFinished);
+    setTransportKind(m_config->transportKind());
 
-    connect(&m_serviceDiscoveryAgent, &QBluetoothServiceDiscoveryAgent::finished, this, &DeviceFinder::scanFinished);
-    connect(&m_serviceDiscoveryAgent, &QBluetoothServiceDiscoveryAgent::canceled, this, &DeviceFinder::scanFinished);
+    connect(m_config, &AppConfig::playerChanged, this, &DeviceFinder::playerConfiguredChanged);
+    connect(m_config, &AppConfig::speakerChanged, this, &DeviceFinder::speakerConfiguredChanged);
 
-    connect(&m_serviceDiscoveryAgent, &QBluetoothServiceDiscoveryAgent::serviceDiscovered, this, &DeviceFinder::serviceDiscovered);
+    // Group state is what the Noise page shows and controls
+    connect(&m_sessions, &PlayerSessionManager::changed, this, &DeviceFinder::volumeChanged);
+    connect(&m_sessions, &PlayerSessionManager::changed, this, &DeviceFinder::playingChanged);
+    connect(&m_sessions, &PlayerSessionManager::changed, this, &DeviceFinder::rampingChanged);
 
-    connect(&socket, &QBluetoothSocket::readyRead, this, &DeviceFinder::readServer);
-    connect(&socket, &QBluetoothSocket::connected, this, &DeviceFinder::handlePlayerConnection);
-    connect(&socket, &QBluetoothSocket::disconnected, [this]() {
-        qInfo() << "disconnected from service";
-        m_playerConnected = false;
-        emit playerConnectedChanged();
-    });
+    setPlayer(m_config->playerAddress(), m_config->playerName());
 
-    connect(&m_volControlTimer, &QTimer::timeout, this, &DeviceFinder::sendVolCmd);
-    connect(&m_connWatchdogTimer, &QTimer::timeout, this, &DeviceFinder::ensureConnected);
+    // The other group members stay connected from the start
+    for (const QString &address : m_config->group())
+        m_sessions.addSession(address, address)->open();
 
-    m_connWatchdogTimer.setInterval(5000);
-    m_connWatchdogTimer.start();
+    m_cache.load();
+    populateFromCache(DiscoveryCache::Player);
+    populateFromCache(DiscoveryCache::Speaker);
 }
 
 DeviceFinder::~DeviceFinder()
 {
-    qDeleteAll(m_devices);
-    m_devices.clear();
-
-    qDeleteAll(m_speakerDevices);
-    m_speakerDevices.clear();
 }
 
-void DeviceFinder::startSearch()
+PlayerTransport::Kind DeviceFinder::transportKind() const
 {
-    clearMessages();
-    qDeleteAll(m_devices);
-    m_devices.clear();
-
-    if (m_settings->contains("player.address")) {
-        qInfo() << "adding saved player to list"
-                << m_settings->value("player.address").toString()
-                << m_settings->value("player.name").toString();
-        m_devices.append(new DeviceInfo(m_settings->value("player.address").toString(), m_settings->value("player.name").toString()));
-    }
+    return m_sessions.transportKind();
+}
 
-    emit devicesChanged();
+void DeviceFinder::setTransportKind(PlayerTransport::Kind kind)
+{
+    m_sessions.setTransportKind(kind);
+}
 
-    qInfo() << "starting service scan";
-    m_serviceDiscoveryAgent.setUuidFilter(QBluetoothUuid(BT_SERVER_UUID));
-    m_serviceDiscoveryAgent.start(QBluetoothServiceDiscoveryAgent::FullDiscovery);
+void DeviceFinder::connectSavedPlayer()
+{
+    if (!m_player)
+        return;
 
-    emit scanningChanged();
+    StartupTimeline::instance().mark(StartupTimeline::ConnectStarted);
+    m_player->open();
 }
 
-void DeviceFinder::addDevice(const QBluetoothDeviceInfo &device)
+void DeviceFinder::setPlayer(const QString &address, const QString &name)
 {
-    qInfo() << "found device" << device.address().toString();
-    m_devices.append(new DeviceInfo(device));
-//    setInfo(tr("Device found. Scanning more..."));
-    emit devicesChanged();
+    if (m_player && m_player->address() == address)
+        return;
+
+    if (m_player) {
+        m_player->disconnect(this);
+        // A group member keeps its session when it stops being the main player
+        if (!m_config->group().contains(m_player->address()))
+            m_sessions.removeSession(m_player->address());
+    }
+
+    m_player = address.isEmpty() ? nullptr : m_sessions.addSession(address, name);
+
+    if (m_player) {
+        connect(m_player, &PlayerSession::connectedChanged, this, &DeviceFinder::playerConnectedChanged);
+        connect(m_player, &PlayerSession::connectionStateChanged, this, &DeviceFinder::connectionStateChanged);
+        connect(m_player, &PlayerSession::speakerConnectedChanged, this, &DeviceFinder::speakerConnectedChanged);
+        connect(m_player, &PlayerSession::roundTripTimeChanged, this, &DeviceFinder::roundTripTimeChanged);
+        connect(m_player, &PlayerSession::latencyStatsChanged, this, &DeviceFinder::commandLatenciesChanged);
+        connect(m_player, &PlayerSession::speakerDiscovered, this, &DeviceFinder::speakerDiscovered);
+        connect(m_player, &PlayerSession::uploadChanged, this, &DeviceFinder::uploadChanged);
+
+        // Startup milestones are about the configured player, not the group
+        connect(m_player, &PlayerSession::connectedChanged, this, [this]() {
+            if (m_player->isConnected())
+                StartupTimeline::instance().mark(StartupTimeline::PlayerConnected);
+        });
+        connect(m_player, &PlayerSession::stateReceived, this, []() {
+            StartupTimeline::instance().mark(StartupTimeline::FirstState);
+        });
+    }
+
+    emit playerConnectedChanged();
+    emit connectionStateChanged();
+    emit speakerConnectedChanged();
+    emit roundTripTimeChanged();
+    emit commandLatenciesChanged();
+    emit uploadChanged();
 }
 
-void DeviceFinder::serviceDiscovered(const QBluetoothServiceInfo &service)
+void DeviceFinder::populateFromCache(DiscoveryCache::Kind kind)
 {
-    qInfo() << "service discovered"
-            << service.device().name()
-            << service.device().address().toString();
+    const bool player = kind == DiscoveryCache::Player;
+
+    m_registry.clear(kind);
+
+    for (const auto &entry : m_cache.entries(kind)) {
+        DeviceInfo device(entry.address, entry.name);
+        device.setRfcommChannel(entry.rfcommChannel);
+        m_registry.insert(kind, device);
+    }
 
-    for (const auto &device : m_devices) {
-        if (QString::compare(static_cast<DeviceInfo *>(device)->getAddress(), service.device().address().toString()) == 0) {
-            return;
-        }
+    // The saved device is listed even if the cache doesn't know it yet. A
+    // player reached over TCP or a local socket has no Bluetooth address
+    // and isn't picked from the list anyway.
+    const QBluetoothAddress saved = player ? m_config->playerBluetoothAddress() : m_config->speakerBluetoothAddress();
+    const QString savedName = player ? m_config->playerName() : m_config->speakerName();
+    if (!saved.isNull() && !m_registry.contains(kind, saved.toUInt64())) {
+        qCInfo(lcDiscovery) << "adding saved" << (player ? "player" : "speaker") << "to list"
+                << saved.toString()
+                << savedName;
+        m_registry.insert(kind, DeviceInfo(saved.toUInt64(), savedName));
     }
+}
+
+void DeviceFinder::startSearch()
+{
+    if (m_discovery.isActive())
+        return;
+
+    clearMessages();
+    m_metrics.recordDiscoveryStarted();
+    populateFromCache(DiscoveryCache::Player);
+
+    // Known players are asked directly while the inquiry looks for new ones
+    QList<QBluetoothAddress> known;
+    for (const auto &entry : m_cache.entries(DiscoveryCache::Player))
+        known.append(QBluetoothAddress(entry.address));
 
-    m_devices.append(new DeviceInfo(service));
-    emit devicesChanged();
+    // Searching while the saved player is away is about getting it back, so
+    // the search ends once it turns up. With it connected the user is
+    // looking for other players and the search runs to the end.
+    const QBluetoothAddress saved = m_config->playerBluetoothAddress();
+    const bool findSaved = m_sessions.transportKind() == PlayerTransport::Rfcomm
+            && !saved.isNull() && m_player && !m_player->isConnected();
+    m_discovery.setStopAddress(findSaved ? saved : QBluetoothAddress());
+
+    TRACE(Discovery, ScanStarted, false, findSaved ? saved.toUInt64() : 0);
+    m_discovery.start(known);
+
+    emit scanningChanged();
+}
+
+void DeviceFinder::serviceDiscovered(const QBluetoothServiceInfo &service)
+{
+    TRACE(Discovery, PlayerFound, 0, service.device().address().toUInt64());
+    qCInfo(lcDiscovery) << "service discovered"
+                        << service.device().name()
+                        << service.device().address().toString();
+
+    DiscoveryCache::Entry entry;
+    entry.address = service.device().address().toUInt64();
+    entry.name = service.device().name();
+    entry.kind = DiscoveryCache::Player;
+    entry.rfcommChannel = static_cast<quint16>(qMax(0, service.protocolServiceMultiplexer()));
+    entry.serviceName = service.serviceName();
+    entry.serviceUuid = service.serviceUuid().toString();
+    m_cache.update(entry);
+
+    // Updates a cached row in place with the name and RFCOMM channel
+    m_registry.insert(DiscoveryCache::Player, DeviceInfo(service));
+
+    // The connect attempt doesn't wait for the rest of the search
+    if (m_player && !m_player->isConnected()
+            && m_config->playerBluetoothAddress() == service.device().address())
+        m_player->connectNow();
 }
 
 void DeviceFinder::scanError(QBluetoothDeviceDiscoveryAgent::Error error)
@@ -164,285 +252,305 @@ void DeviceFinder::scanFinished()
 //        setInfo(tr("Scanning done."));
 //    }
 
+    TRACE(Discovery, ScanFinished, 0, 0);
+    m_metrics.recordDiscoveryFinished();
+
     emit scanningChanged();
-    emit devicesChanged();
 }
 
-std::vector<std::string> DeviceFinder::parseCmd(const std::string &cmd)
+void DeviceFinder::speakerDiscovered(quint64 address, const QString &speakerName)
 {
-  std::string delim = ",";
-  std::vector<std::string> cmdv;
-
-  unsigned long start = 0U;
-  unsigned long end = cmd.find(delim);
-
-  while (end != std::string::npos) {
-    cmdv.emplace_back(cmd.substr(start, end - start));
-    start = end + delim.length();
-    end = cmd.find(delim, start);
-  }
+    const QString speakerAddress = QBluetoothAddress(address).toString();
+
+    // Refresh the cache even for listed speakers so lastSeen stays current
+    DiscoveryCache::Entry entry;
+    entry.address = address;
+    entry.name = speakerName;
+    entry.kind = DiscoveryCache::Speaker;
+    m_cache.update(entry);
+
+    if (m_registry.contains(DiscoveryCache::Speaker, address)) {
+        qCDebug(lcDiscovery) << "speaker device already known"
+                             << speakerAddress;
+        // A renamed speaker updates its row in place
+        m_registry.insert(DiscoveryCache::Speaker, DeviceInfo(address, speakerName));
+        return;
+    }
 
-  cmdv.emplace_back(cmd.substr(start, end));
+    TRACE(Discovery, SpeakerFound, 0, address);
+    qCInfo(lcDiscovery) << "discovered speaker"
+                        << speakerAddress
+                        << speakerName;
 
-  return cmdv;
+    m_registry.insert(DiscoveryCache::Speaker, DeviceInfo(address, speakerName));
 }
 
-void DeviceFinder::sendCmd(const std::vector<std::string> &cmdv)
+void DeviceFinder::connectToService(const QString &address)
 {
-    std::stringstream cmd_ss("");
-
-    for (unsigned int i = 0; i < cmdv.size(); i++) {
-        socket.write(cmdv[i].c_str());
-
-        if (i < cmdv.size() - 1) {
-            socket.write(",");
-        }
+    const DeviceInfo currentDevice = m_registry.device(DiscoveryCache::Player, QBluetoothAddress(address).toUInt64());
+
+    if (currentDevice.isValid()) {
+        qCInfo(lcUi) << "connect player device"
+                     << currentDevice.getAddress();
+        m_config->setPlayer(currentDevice.getAddress(), currentDevice.getName());
+        setPlayer(currentDevice.getAddress(), currentDevice.getName());
+        m_player->open();
     }
 
-    socket.write("\n");
+    clearMessages();
 }
 
-void DeviceFinder::readServer() {
-    qInfo() << "ready to read from server";
-
-    while (socket.canReadLine()) {
-        QByteArray lineData = socket.readLine();
-        QString line = QString::fromUtf8(lineData.constData(), lineData.length());
-        auto cmdv = parseCmd(line.trimmed().toStdString());
-
-        for (const auto &v : cmdv) {
-            qInfo() << "CMD" << v.c_str();
-        }
-
-
-        std::map<std::string, std::function<void()>> cmd_dispatch;
-
-        cmd_dispatch.emplace("BT_DEVICE", [this, &cmdv]() {
-            for (const auto &device : m_speakerDevices) {
-                if (static_cast<DeviceInfo *>(device)->getAddress().toStdString() == cmdv[1]) {
-                    qInfo() << "speaker device already known"
-                            << static_cast<DeviceInfo *>(device)->getAddress();
-                    return;
-                }
-            }
-            qInfo() << "discovered speaker"
-                    << QString::fromStdString(cmdv[1])
-                    << QString::fromStdString(cmdv[2]);
+void DeviceFinder::ensureConnected() {
+    // Someone is waiting for the players, don't sit out a long backoff
+    for (PlayerSession *session : m_sessions.sessions())
+        session->connectNow();
+}
 
-            m_speakerDevices.append(new DeviceInfo(QString::fromStdString(cmdv[1]),
-                                                   QString::fromStdString(cmdv[2])));
-            emit speakerDevicesChanged();
-        });
+bool DeviceFinder::inGroup(const QString &address) const
+{
+    return m_config->group().contains(address);
+}
 
-        cmd_dispatch.emplace("CONNECTED_SPEAKER", [this, &cmdv]() {
-            qInfo() << "player reported speaker connected"
-                    << cmdv[1].c_str();
-            m_speakerConnected = true;
-            emit speakerConnectedChanged();
-        });
+void DeviceFinder::addToGroup(const QString &address)
+{
+    QStringList group = m_config->group();
+    if (group.contains(address))
+        return;
 
-        cmd_dispatch.emplace("DISCONNECTED_SPEAKER", [this]() {
-            qInfo() << "player reported speaker disconnected";
-            m_speakerConnected = false;
-            emit speakerConnectedChanged();
-        });
+    group.append(address);
+    m_config->setGroup(group);
 
-        cmd_dispatch.emplace("VOL", [this, &cmdv]() {
-            qInfo() << "player reported volume"
-                    << cmdv[1].c_str();
-            m_volume = static_cast<unsigned int>(std::atoi(cmdv[1].c_str()));
-            emit volumeChanged();
-        });
+    const DeviceInfo device = m_registry.device(DiscoveryCache::Player, QBluetoothAddress(address).toUInt64());
+    const QString name = device.isValid() ? device.getName() : address;
 
-        cmd_dispatch.emplace("PLAYING", [this]() {
-            qInfo() << "player reported playing";
-            m_playing = true;
-            emit playingChanged();
-        });
+    qCInfo(lcUi) << "adding player to group" << address;
+    m_sessions.addSession(address, name)->open();
+    setInfo(tr("%1 joined the group").arg(name));
+}
 
-        cmd_dispatch.emplace("STOPPED", [this]() {
-            qInfo() << "player reported stopped";
-            m_playing = false;
-            emit playingChanged();
-        });
+void DeviceFinder::removeFromGroup(const QString &address)
+{
+    QStringList group = m_config->group();
+    if (!group.removeOne(address))
+        return;
 
-        auto cmd_it = cmd_dispatch.find(cmdv[0]);
+    m_config->setGroup(group);
 
-        if (cmd_it != cmd_dispatch.end()) {
-          cmd_dispatch[cmd_it->first]();
-        } else {
-          qInfo() << "unrecognized command";
-        }
-    }
+    qCInfo(lcUi) << "removing player from group" << address;
+    if (!m_player || m_player->address() != address)
+        m_sessions.removeSession(address);
 }
 
-void DeviceFinder::handlePlayerConnection()
+void DeviceFinder::toggleGroupMember(const QString &address)
 {
-    qInfo() << "connected to service";
-    m_playerConnected = true;
-    emit playerConnectedChanged();
+    if (inGroup(address))
+        removeFromGroup(address);
+    else
+        addToGroup(address);
 }
 
-void DeviceFinder::connectToService(const QString &address)
+void DeviceFinder::startSpeakerSearch()
 {
-    m_deviceDiscoveryAgent.stop();
+    populateFromCache(DiscoveryCache::Speaker);
 
-    DeviceInfo *currentDevice = nullptr;
-    for (int i = 0; i < m_devices.size(); i++) {
-        if (static_cast<DeviceInfo *>(m_devices.at(i))->getAddress() == address ) {
-            currentDevice = static_cast<DeviceInfo *>(m_devices.at(i));
-            break;
-        }
-    }
+    if (m_player)
+        m_player->scan();
+}
 
-    if (currentDevice) {
-        qInfo() << "connect player device"
-                << currentDevice->getAddress();
-        m_settings->setValue("player.address", currentDevice->getAddress());
-        m_settings->setValue("player.name", currentDevice->getName());
-        if (socket.state() != QBluetoothSocket::UnconnectedState) {
-            m_playerConnected = false;
-            emit playerConnectedChanged();
-            socket.close();
-        }
-        ensureConnected();
+QString DeviceFinder::dumpTrace()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
 
-    }
+    QSaveFile file(dir + QStringLiteral("/trace.txt"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return QString();
 
-    clearMessages();
-}
+    TraceBuffer::instance().dump(&file);
+    if (!file.commit())
+        return QString();
 
-void DeviceFinder::ensureConnected() {
-    if (!m_serviceDiscoveryAgent.isActive() && m_settings->contains("player.address") && socket.state() == QBluetoothSocket::UnconnectedState) {
-        socket.connectToService(QBluetoothAddress(m_settings->value("player.address").toString()), QBluetoothUuid(BT_SERVER_UUID));
-    }
+    qCInfo(lcUi) << "trace written to" << file.fileName();
+    return file.fileName();
 }
 
-void DeviceFinder::startSpeakerSearch()
+void DeviceFinder::uploadAsset(const QUrl &file)
 {
-    qDeleteAll(m_speakerDevices);
-    m_speakerDevices.clear();
-
-    if (m_settings->contains("speaker.address")) {
-        qInfo() << "adding saved speaker to list"
-                << m_settings->value("speaker.address").toString()
-                << m_settings->value("speaker.name").toString();
-        m_speakerDevices.append(new DeviceInfo(m_settings->value("speaker.address").toString(), m_settings->value("speaker.name").toString()));
+    if (!m_player) {
+        setError(tr("No player to upload to."));
+        return;
     }
 
-    emit speakerDevicesChanged();
-
-    qInfo() << "sending SCAN command";
+    const QString fileName = file.isLocalFile() ? file.toLocalFile() : file.toString();
+    qCInfo(lcUi) << "uploading" << fileName << "to" << m_player->address();
+    if (!m_player->startUpload(fileName))
+        setError(m_player->upload()->errorString());
+}
 
-    sendCmd({"SCAN"});
+void DeviceFinder::cancelUpload()
+{
+    if (m_player)
+        m_player->cancelUpload();
 }
 
 void DeviceFinder::connectToSpeaker(const QString &address)
 {
-
-    DeviceInfo *currentDevice = nullptr;
-    for (int i = 0; i < m_speakerDevices.size(); i++) {
-        if (static_cast<DeviceInfo *>(m_speakerDevices.at(i))->getAddress() == address ) {
-            currentDevice = static_cast<DeviceInfo *>(m_speakerDevices.at(i));
-            break;
-        }
+    const DeviceInfo currentDevice = m_registry.device(DiscoveryCache::Speaker, QBluetoothAddress(address).toUInt64());
+    if (!currentDevice.isValid() || !m_player) {
+        qCInfo(lcUi) << "not connecting unknown speaker"
+                     << address;
+        return;
     }
 
-    m_settings->setValue("speaker.address", currentDevice->getAddress());
-    m_settings->setValue("speaker.name", currentDevice->getName());
+    m_config->setSpeaker(currentDevice.getAddress(), currentDevice.getName());
 
-    qInfo() << "sending request to connect to speaker"
-            << address;
-    sendCmd({"CONNECT", address.toStdString()});
+    DiscoveryCache::Entry entry;
+    entry.address = currentDevice.getAddressValue();
+    entry.name = currentDevice.getName();
+    entry.kind = DiscoveryCache::Speaker;
+    m_cache.update(entry);
+
+    m_player->connectSpeaker(currentDevice.getAddressValue());
 }
 
 void DeviceFinder::disconnectAllSpeakers()
 {
-    qInfo() << "sending request to remove all speakers";
-    sendCmd({"UNPAIR_SPEAKER"});
+    if (m_player)
+        m_player->unpairSpeakers();
 }
 
 void DeviceFinder::play()
 {
-    qInfo() << "sending request to play";
-    sendCmd({"PLAY"});
-    m_playing = true;
-    emit playingChanged();
+    m_sessions.play();
 }
 
 void DeviceFinder::stop()
 {
-    qInfo() << "sending request to stop";
-    sendCmd({"STOP"});
-    m_playing = false;
-    emit playingChanged();
+    m_sessions.stop();
 }
 
 void DeviceFinder::setVolume(unsigned int vol)
 {
-    qInfo() << "sending request to set volume";
-    m_volControlTimer.stop();
-    m_volControlTimer.setInterval(500);
-    m_volControlTimer.setSingleShot(true);
-    m_volControlTimer.start();
-    m_volume = vol;
-    emit volumeChanged();
+    m_sessions.setVolume(vol);
+}
+
+void DeviceFinder::fadeVolume(unsigned int vol, int duration)
+{
+    m_sessions.rampVolume(vol, duration);
+}
+
+void DeviceFinder::startSleepTimer(int duration)
+{
+    qCInfo(lcUi) << "sleep timer set for" << duration / 1000 << "s";
+    m_sessions.startSleepTimer(duration);
+}
+
+void DeviceFinder::fadeOut(int duration)
+{
+    qCInfo(lcUi) << "fading out over" << duration / 1000 << "s";
+    m_sessions.fadeOut(duration);
+}
+
+void DeviceFinder::cancelFade()
+{
+    m_sessions.cancelRamp();
+}
+
+int DeviceFinder::volumeSendInterval() const
+{
+    return m_sessions.volumeSendInterval();
 }
 
-void DeviceFinder::sendVolCmd() {
-    qInfo() << "sending request to set volume";
-    sendCmd({"SET_VOL", QString::number(m_volume).toStdString()});
+void DeviceFinder::setVolumeSendInterval(int interval)
+{
+    if (interval == m_sessions.volumeSendInterval())
+        return;
+
+    m_sessions.setVolumeSendInterval(qMax(0, interval));
+    emit volumeSendIntervalChanged();
 }
 
 bool DeviceFinder::scanning() const
 {
-    return m_serviceDiscoveryAgent.isActive();
+    return m_discovery.isActive();
 }
 
-QVariant DeviceFinder::devices()
+DeviceListModel *DeviceFinder::devices()
 {
-    return QVariant::fromValue(m_devices);
+    return &m_devices;
 }
 
 QVariant DeviceFinder::volume()
 {
-    return QVariant::fromValue(m_volume);
+    return QVariant::fromValue(m_sessions.volume());
 }
 
 QVariant DeviceFinder::playing()
 {
-    return QVariant::fromValue(m_playing);
+    return QVariant::fromValue(m_sessions.playing());
 }
 
 QVariant DeviceFinder::playerConfigured()
 {
-    if (m_settings->contains("player.address")) {
-        return QVariant::fromValue(true);
-    } else {
-        return QVariant::fromValue(false);
-    }
+    return QVariant::fromValue(m_config->playerConfigured());
 }
 
 QVariant DeviceFinder::speakerConfigured()
 {
-    if (m_settings->contains("speaker.address")) {
-        return QVariant::fromValue(true);
-    } else {
-        return QVariant::fromValue(false);
-    }
+    return QVariant::fromValue(m_config->speakerConfigured());
 }
 
 QVariant DeviceFinder::playerConnected()
 {
-    return QVariant::fromValue(m_playerConnected);
+    return QVariant::fromValue(m_player && m_player->isConnected());
 }
 
 QVariant DeviceFinder::speakerConnected()
 {
-    return QVariant::fromValue(m_speakerConnected);
+    return QVariant::fromValue(m_player && m_player->speakerConnected());
+}
+
+DeviceListModel *DeviceFinder::speakerDevices()
+{
+    return &m_speakerDevices;
+}
+
+Metrics *DeviceFinder::metrics()
+{
+    return &m_metrics;
+}
+
+PlayerSessionManager *DeviceFinder::group()
+{
+    return &m_sessions;
+}
+
+QVariant DeviceFinder::roundTripTime()
+{
+    return QVariant::fromValue(m_player ? m_player->roundTripTime() : qreal(-1));
+}
+
+QVariant DeviceFinder::commandLatencies()
+{
+    return m_player ? m_player->latencyStats() : QVariantMap();
+}
+
+QVariant DeviceFinder::upload()
+{
+    return m_player && m_player->upload() ? m_player->upload()->toVariantMap() : QVariantMap();
+}
+
+QVariant DeviceFinder::ramping()
+{
+    return QVariant::fromValue(m_sessions.ramping());
+}
+
+QVariant DeviceFinder::sleepTimerRemaining()
+{
+    return QVariant::fromValue(m_sessions.sleepTimerRemaining());
 }
 
-QVariant DeviceFinder::speakerDevices()
+QVariant DeviceFinder::connectionState()
 {
-    return QVariant::fromValue(m_speakerDevices);
+    return ConnectionStateMachine::stateName(m_player ? m_player->connectionState() : ConnectionStateMachine::Idle);
 }
@@ -52,48 +52,82 @@
 #define DEVICEFINDER_H
 
 #include "app-global.h"
+#include "appconfig.h"
 #include "bluetoothbaseclass.h"
+#include "playertransport.h"
+#include "playersessionmanager.h"
+#include "discoverycache.h"
+#include "deviceregistry.h"
+#include "devicelistmodel.h"
+#include "discoverypipeline.h"
+#include "metrics.h"
 
 #include <QTimer>
 #include <QBluetoothLocalDevice>
 #include <QBluetoothDeviceDiscoveryAgent>
-#include <QBluetoothServiceDiscoveryAgent>
-#include <QBluetoothDeviceInfo>
 #include <QBluetoothServiceInfo>
-#include <QBluetoothSocket>
 #include <QBluetoothAddress>
+#include <QUrl>
 #include <QVariant>
-#include <QSettings>
-
-class DeviceInfo;
 
 class DeviceFinder: public BluetoothBaseClass
 {
     Q_OBJECT
 
     Q_PROPERTY(bool scanning READ scanning NOTIFY scanningChanged)
-    Q_PROPERTY(QVariant devices READ devices NOTIFY devicesChanged)
-    Q_PROPERTY(QVariant speakerDevices READ speakerDevices NOTIFY speakerDevicesChanged)
+    Q_PROPERTY(DeviceListModel *devices READ devices CONSTANT)
+    Q_PROPERTY(DeviceListModel *speakerDevices READ speakerDevices CONSTANT)
     Q_PROPERTY(QVariant volume READ volume NOTIFY volumeChanged)
     Q_PROPERTY(QVariant playing READ playing NOTIFY playingChanged)
     Q_PROPERTY(QVariant playerConfigured READ playerConfigured NOTIFY playerConfiguredChanged)
     Q_PROPERTY(QVariant playerConnected READ playerConnected NOTIFY playerConnectedChanged)
+    Q_PROPERTY(QVariant connectionState READ connectionState NOTIFY connectionStateChanged)
     Q_PROPERTY(QVariant speakerConfigured READ speakerConfigured NOTIFY speakerConfiguredChanged)
     Q_PROPERTY(QVariant speakerConnected READ speakerConnected NOTIFY speakerConnectedChanged)
+    Q_PROPERTY(QVariant roundTripTime READ roundTripTime NOTIFY roundTripTimeChanged)
+    Q_PROPERTY(QVariant commandLatencies READ commandLatencies NOTIFY commandLatenciesChanged)
+    Q_PROPERTY(int volumeSendInterval READ volumeSendInterval WRITE setVolumeSendInterval NOTIFY volumeSendIntervalChanged)
+    Q_PROPERTY(Metrics *metrics READ metrics CONSTANT)
+    // Upload to the configured player: name, state, size, acknowledged,
+    // progress, throughput and error; empty before the first
+    Q_PROPERTY(QVariant upload READ upload NOTIFY uploadChanged)
+    // A fade or sleep timer is running on any player in the group
+    Q_PROPERTY(QVariant ramping READ ramping NOTIFY rampingChanged)
+    // ms until the sleep timer stops playback, 0 without one; read it again
+    // to count down
+    Q_PROPERTY(QVariant sleepTimerRemaining READ sleepTimerRemaining NOTIFY rampingChanged)
+    // Every player controlled from the Noise page, the configured one included
+    Q_PROPERTY(PlayerSessionManager *group READ group CONSTANT)
 
 public:
-    DeviceFinder(QSettings *settings, QObject *parent = nullptr);
+    DeviceFinder(AppConfig *config, QObject *parent = nullptr);
     ~DeviceFinder();
 
     bool scanning() const;
-    QVariant devices();
+    DeviceListModel *devices();
     QVariant volume();
     QVariant playing();
     QVariant playerConfigured();
     QVariant speakerConfigured();
     QVariant playerConnected();
+    QVariant connectionState();
     QVariant speakerConnected();
-    QVariant speakerDevices();
+    DeviceListModel *speakerDevices();
+    QVariant roundTripTime();
+    QVariant commandLatencies();
+    int volumeSendInterval() const;
+    void setVolumeSendInterval(int interval);
+    Metrics *metrics();
+    QVariant upload();
+    QVariant ramping();
+    QVariant sleepTimerRemaining();
+    PlayerSessionManager *group();
+
+    PlayerTransport::Kind transportKind() const;
+    void setTransportKind(PlayerTransport::Kind kind);
+
+    // Starts connecting to the saved player, if there is one
+    void connectSavedPlayer();
 
 public slots:
     void startSearch();
@@ -104,47 +138,60 @@ public slots:
     void play();
     void stop();
     void setVolume(unsigned int vol);
-    void sendVolCmd();
+    // Moves the volume to vol over duration ms, each player on its own
+    void fadeVolume(unsigned int vol, int duration);
+    // Fades out over duration ms and stops
+    void startSleepTimer(int duration);
+    // The same, but not shown as a sleep timer
+    void fadeOut(int duration);
+    void cancelFade();
     void ensureConnected();
+    bool inGroup(const QString &address) const;
+    void addToGroup(const QString &address);
+    void removeFromGroup(const QString &address);
+    void toggleGroupMember(const QString &address);
+    // Writes the trace ring to the app data directory, returns the file
+    QString dumpTrace();
+    // Sends a noise recording or preset to the configured player
+    void uploadAsset(const QUrl &file);
+    void cancelUpload();
 private slots:
-    void addDevice(const QBluetoothDeviceInfo&);
     void serviceDiscovered(const QBluetoothServiceInfo&);
     void scanError(QBluetoothDeviceDiscoveryAgent::Error error);
     void scanFinished();
 
 signals:
     void scanningChanged();
-    void devicesChanged();
-    void speakerDevicesChanged();
     void volumeChanged();
     void playingChanged();
     void playerConfiguredChanged();
     void playerConnectedChanged();
+    void connectionStateChanged();
     void speakerConfiguredChanged();
     void speakerConnectedChanged();
+    void roundTripTimeChanged();
+    void commandLatenciesChanged();
+    void volumeSendIntervalChanged();
+    void uploadChanged();
+    void rampingChanged();
 
 private:
-    QSettings *m_settings;
+    AppConfig *m_config;
     QBluetoothLocalDevice m_localDevice;
 
-    QBluetoothSocket socket;
-
-    QBluetoothDeviceDiscoveryAgent m_deviceDiscoveryAgent;
-    QBluetoothServiceDiscoveryAgent m_serviceDiscoveryAgent;
-    QList<QObject*> m_devices;
-    QList<QObject*> m_speakerDevices;
-    QTimer m_volControlTimer;
-    QTimer m_connWatchdogTimer;
-
-    unsigned int m_volume = 0;
-    bool m_playing = false;
-    bool m_playerConnected = false;
-    bool m_speakerConnected = false;
-
-    void sendCmd(const std::vector<std::string> &cmdv);
-    void readServer();
-    std::vector<std::string> parseCmd(const std::string &cmd);
-    void handlePlayerConnection();
+    DiscoveryPipeline m_discovery;
+    DeviceRegistry m_registry;
+    DeviceListModel m_devices;
+    DeviceListModel m_speakerDevices;
+    DiscoveryCache m_cache;
+    Metrics m_metrics;
+    PlayerSessionManager m_sessions;
+    // Session of the configured player, owned by m_sessions
+    PlayerSession *m_player = nullptr;
+
+    void setPlayer(const QString &address, const QString &name);
+    void speakerDiscovered(quint64 address, const QString &speakerName);
+    void populateFromCache(DiscoveryCache::Kind kind);
 };
 
 #endif // DEVICEFINDER_H
@@ -53,26 +53,31 @@
 #include <QBluetoothAddress>
 #include <QBluetoothUuid>
 
+DeviceInfo::DeviceInfo(quint64 address, const QString &name, qint16 rssi):
+    m_address(address),
+    m_name(name),
+    m_rssi(rssi)
+{
+}
+
 DeviceInfo::DeviceInfo(const QBluetoothDeviceInfo &info):
-    QObject(),
-    m_address(info.address().toString()),
-    m_name(info.name())
+    m_address(info.address().toUInt64()),
+    m_name(info.name()),
+    m_rssi(info.rssi())
 {
 }
 
 DeviceInfo::DeviceInfo(const QBluetoothServiceInfo &service):
-    QObject(),
-    m_address(service.device().address().toString()),
+    m_address(service.device().address().toUInt64()),
     m_name(service.device().name()),
-    m_svcInfo(service)
+    m_rssi(service.device().rssi()),
+    m_rfcommChannel(static_cast<quint16>(qMax(0, service.protocolServiceMultiplexer())))
 {
 }
 
-DeviceInfo::DeviceInfo(const QString &address, const QString &name):
-    QObject(),
-    m_address(address),
-    m_name(name)
+bool DeviceInfo::isValid() const
 {
+    return m_address != 0;
 }
 
 QString DeviceInfo::getName() const
@@ -81,11 +86,36 @@ QString DeviceInfo::getName() const
 }
 
 QString DeviceInfo::getAddress() const
+{
+    return QBluetoothAddress(m_address).toString();
+}
+
+quint64 DeviceInfo::getAddressValue() const
 {
     return m_address;
 }
 
-QBluetoothServiceInfo DeviceInfo::getServiceInfo() const
+qint16 DeviceInfo::getRssi() const
+{
+    return m_rssi;
+}
+
+quint16 DeviceInfo::getRfcommChannel() const
+{
+    return m_rfcommChannel;
+}
+
+void DeviceInfo::setName(const QString &name)
+{
+    m_name = name;
+}
+
+void DeviceInfo::setRssi(qint16 rssi)
+{
+    m_rssi = rssi;
+}
+
+void DeviceInfo::setRfcommChannel(quint16 channel)
 {
-    return m_svcInfo;
+    m_rfcommChannel = channel;
 }
@@ -53,31 +53,46 @@
 
 #include <QString>
 #include <QObject>
+#include <QMetaType>
 #include <QBluetoothDeviceInfo>
 #include <QBluetoothServiceInfo>
 
-class DeviceInfo: public QObject
+// Kept by value in the device registry. Only what the lists and the
+// connection need is stored, the full SDP record is dropped and the
+// discovery cache keeps the few service fields worth remembering.
+class DeviceInfo
 {
-    Q_OBJECT
-    Q_PROPERTY(QString deviceName READ getName NOTIFY deviceChanged)
-    Q_PROPERTY(QString deviceAddress READ getAddress NOTIFY deviceChanged)
+    Q_GADGET
+    Q_PROPERTY(QString deviceName READ getName)
+    Q_PROPERTY(QString deviceAddress READ getAddress)
+    Q_PROPERTY(int deviceRssi READ getRssi)
 
 public:
-    DeviceInfo(const QBluetoothDeviceInfo &device);
-    DeviceInfo(const QBluetoothServiceInfo &service);
-    DeviceInfo(const QString &address, const QString &name);
+    DeviceInfo() = default;
+    DeviceInfo(quint64 address, const QString &name, qint16 rssi = 0);
+    explicit DeviceInfo(const QBluetoothDeviceInfo &device);
+    explicit DeviceInfo(const QBluetoothServiceInfo &service);
+
+    bool isValid() const;
 
     QString getName() const;
     QString getAddress() const;
-    QBluetoothServiceInfo getServiceInfo() const;
+    quint64 getAddressValue() const;
+    qint16 getRssi() const;
+    quint16 getRfcommChannel() const;
 
-signals:
-    void deviceChanged();
+    void setName(const QString &name);
+    void setRssi(qint16 rssi);
+    void setRfcommChannel(quint16 channel);
 
 private:
-    QString m_address;
+    quint64 m_address = 0;
     QString m_name;
-    QBluetoothServiceInfo m_svcInfo;
+    qint16 m_rssi = 0;
+    quint16 m_rfcommChannel = 0;
 };
 
+Q_DECLARE_TYPEINFO(DeviceInfo, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(DeviceInfo)
+
 #endif // DEVICEINFO_H
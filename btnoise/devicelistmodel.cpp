@@ -0,0 +1,106 @@
+#include "devicelistmodel.h"
+
+DeviceListModel::DeviceListModel(DeviceRegistry *registry, DeviceRegistry::Kind kind, QObject *parent) :
+    QAbstractListModel(parent),
+    m_registry(registry),
+    m_kind(kind)
+{
+    connect(m_registry, &DeviceRegistry::deviceAdded, this, &DeviceListModel::deviceAdded);
+    connect(m_registry, &DeviceRegistry::deviceChanged, this, &DeviceListModel::deviceChanged);
+    connect(m_registry, &DeviceRegistry::deviceRemoved, this, &DeviceListModel::deviceRemoved);
+    connect(m_registry, &DeviceRegistry::cleared, this, &DeviceListModel::cleared);
+}
+
+int DeviceListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return m_rows.size();
+}
+
+QVariant DeviceListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size())
+        return QVariant();
+
+    const DeviceInfo device = m_registry->device(m_kind, m_rows.at(index.row()));
+    if (!device.isValid())
+        return QVariant();
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return device.getName();
+    case AddressRole:
+        return device.getAddress();
+    case RssiRole:
+        return device.getRssi();
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> DeviceListModel::roleNames() const
+{
+    return {
+        {NameRole, "deviceName"},
+        {AddressRole, "deviceAddress"},
+        {RssiRole, "deviceRssi"}
+    };
+}
+
+void DeviceListModel::deviceAdded(DeviceRegistry::Kind kind, quint64 address)
+{
+    if (kind != m_kind)
+        return;
+
+    beginInsertRows(QModelIndex(), m_rows.size(), m_rows.size());
+    m_rowOf.insert(address, m_rows.size());
+    m_rows.append(address);
+    endInsertRows();
+    emit countChanged();
+}
+
+void DeviceListModel::deviceChanged(DeviceRegistry::Kind kind, quint64 address)
+{
+    if (kind != m_kind)
+        return;
+
+    const int row = m_rowOf.value(address, -1);
+    if (row < 0)
+        return;
+
+    const QModelIndex changed = index(row);
+    emit dataChanged(changed, changed);
+}
+
+void DeviceListModel::deviceRemoved(DeviceRegistry::Kind kind, quint64 address)
+{
+    if (kind != m_kind)
+        return;
+
+    const int row = m_rowOf.value(address, -1);
+    if (row < 0)
+        return;
+
+    beginRemoveRows(QModelIndex(), row, row);
+    m_rows.remove(row);
+    m_rowOf.remove(address);
+    for (int i = row; i < m_rows.size(); i++)
+        m_rowOf[m_rows.at(i)] = i;
+    endRemoveRows();
+    emit countChanged();
+}
+
+void DeviceListModel::cleared(DeviceRegistry::Kind kind)
+{
+    if (kind != m_kind || m_rows.isEmpty())
+        return;
+
+    beginResetModel();
+    m_rows.clear();
+    m_rowOf.clear();
+    endResetModel();
+    emit countChanged();
+}
@@ -0,0 +1,47 @@
+#ifndef DEVICELISTMODEL_H
+#define DEVICELISTMODEL_H
+
+#include "deviceregistry.h"
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
+
+// Player or speaker list as seen by the ListViews, a view over one kind of
+// device in the registry. Rows keep discovery order and are added, updated
+// and removed one at a time so a scan doesn't rebuild every delegate.
+class DeviceListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+
+public:
+    enum Roles {
+        NameRole = Qt::UserRole + 1,
+        AddressRole,
+        RssiRole
+    };
+    Q_ENUM(Roles)
+
+    DeviceListModel(DeviceRegistry *registry, DeviceRegistry::Kind kind, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void countChanged();
+
+private:
+    void deviceAdded(DeviceRegistry::Kind kind, quint64 address);
+    void deviceChanged(DeviceRegistry::Kind kind, quint64 address);
+    void deviceRemoved(DeviceRegistry::Kind kind, quint64 address);
+    void cleared(DeviceRegistry::Kind kind);
+
+    DeviceRegistry *m_registry;
+    DeviceRegistry::Kind m_kind;
+    QVector<quint64> m_rows;
+    QHash<quint64, int> m_rowOf;
+};
+
+#endif // DEVICELISTMODEL_H
@@ -0,0 +1,93 @@
+#include "deviceregistry.h"
+
+DeviceRegistry::DeviceRegistry(QObject *parent) :
+    QObject(parent)
+{
+}
+
+DeviceRegistry::Devices &DeviceRegistry::devices(Kind kind)
+{
+    return kind == DiscoveryCache::Player ? m_players : m_speakers;
+}
+
+const DeviceRegistry::Devices &DeviceRegistry::devices(Kind kind) const
+{
+    return kind == DiscoveryCache::Player ? m_players : m_speakers;
+}
+
+bool DeviceRegistry::contains(Kind kind, quint64 address) const
+{
+    return devices(kind).index.contains(address);
+}
+
+DeviceInfo DeviceRegistry::device(Kind kind, quint64 address) const
+{
+    const Devices &known = devices(kind);
+    const int i = known.index.value(address, -1);
+    return i < 0 ? DeviceInfo() : known.list.at(i);
+}
+
+void DeviceRegistry::insert(Kind kind, const DeviceInfo &device)
+{
+    const quint64 address = device.getAddressValue();
+    if (!address)
+        return;
+
+    Devices &known = devices(kind);
+    const int i = known.index.value(address, -1);
+
+    if (i < 0) {
+        known.index.insert(address, known.list.size());
+        known.list.append(device);
+        emit deviceAdded(kind, address);
+        return;
+    }
+
+    DeviceInfo &current = known.list[i];
+    bool changed = false;
+    if (!device.getName().isEmpty() && device.getName() != current.getName()) {
+        current.setName(device.getName());
+        changed = true;
+    }
+    if (device.getRssi() && device.getRssi() != current.getRssi()) {
+        current.setRssi(device.getRssi());
+        changed = true;
+    }
+    if (device.getRfcommChannel())
+        current.setRfcommChannel(device.getRfcommChannel());
+
+    if (changed)
+        emit deviceChanged(kind, address);
+}
+
+void DeviceRegistry::remove(Kind kind, quint64 address)
+{
+    Devices &known = devices(kind);
+    const int i = known.index.value(address, -1);
+    if (i < 0)
+        return;
+
+    // Order doesn't matter here, the models keep their own, so the last
+    // device fills the hole
+    const int last = known.list.size() - 1;
+    if (i != last) {
+        known.list[i] = known.list.at(last);
+        known.index[known.list.at(i).getAddressValue()] = i;
+    }
+    known.list.removeLast();
+    known.index.remove(address);
+
+    emit deviceRemoved(kind, address);
+}
+
+void DeviceRegistry::clear(Kind kind)
+{
+    Devices &known = devices(kind);
+    if (known.list.isEmpty())
+        return;
+
+    // Keeps the capacity, a rescan refills the same storage
+    known.list.clear();
+    known.index.clear();
+    emit cleared(kind);
+}
@@ -0,0 +1,53 @@
+#ifndef DEVICEREGISTRY_H
+#define DEVICEREGISTRY_H
+
+#include "deviceinfo.h"
+#include "discoverycache.h"
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+
+// Every player and speaker currently listed, keyed by the 48 bit Bluetooth
+// address. Devices are stored by value in one array per kind, the list
+// models only keep addresses.
+class DeviceRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Kind = DiscoveryCache::Kind;
+
+    explicit DeviceRegistry(QObject *parent = nullptr);
+
+    bool contains(Kind kind, quint64 address) const;
+    // An invalid DeviceInfo if the address isn't known
+    DeviceInfo device(Kind kind, quint64 address) const;
+
+    // Adds the device or merges it into the known one. An empty name or a
+    // zero RSSI / channel doesn't overwrite what is already known.
+    void insert(Kind kind, const DeviceInfo &device);
+
+    void remove(Kind kind, quint64 address);
+    void clear(Kind kind);
+
+signals:
+    void deviceAdded(DeviceRegistry::Kind kind, quint64 address);
+    void deviceChanged(DeviceRegistry::Kind kind, quint64 address);
+    void deviceRemoved(DeviceRegistry::Kind kind, quint64 address);
+    void cleared(DeviceRegistry::Kind kind);
+
+private:
+    struct Devices {
+        QVector<DeviceInfo> list;
+        QHash<quint64, int> index;
+    };
+
+    Devices &devices(Kind kind);
+    const Devices &devices(Kind kind) const;
+
+    Devices m_players;
+    Devices m_speakers;
+};
+
+#endif // DEVICEREGISTRY_H
@@ -0,0 +1,172 @@
+#include "discoverycache.h"
+#include "trace.h"
+
+#include <QBluetoothAddress>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+namespace {
+
+const int CACHE_VERSION = 1;
+
+QString kindName(DiscoveryCache::Kind kind)
+{
+    return kind == DiscoveryCache::Speaker ? QStringLiteral("speaker") : QStringLiteral("player");
+}
+
+}
+
+DiscoveryCache::DiscoveryCache(const QString &path, QObject *parent) :
+    QObject(parent),
+    m_path(path)
+{
+    // Scans update many entries in a burst, write them out together
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(2000);
+    connect(&m_saveTimer, &QTimer::timeout, this, &DiscoveryCache::save);
+}
+
+DiscoveryCache::~DiscoveryCache()
+{
+    if (m_saveTimer.isActive())
+        save();
+}
+
+QString DiscoveryCache::defaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+            + QStringLiteral("/discovery-cache.json");
+}
+
+void DiscoveryCache::load()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() != CACHE_VERSION) {
+        qCInfo(lcDiscovery) << "ignoring discovery cache of unknown version";
+        return;
+    }
+
+    m_entries.clear();
+
+    for (const QJsonValue &value : root.value("devices").toArray()) {
+        const QJsonObject object = value.toObject();
+
+        Entry entry;
+        entry.address = QBluetoothAddress(object.value("address").toString()).toUInt64();
+        if (!entry.address)
+            continue;
+
+        entry.name = object.value("name").toString();
+        entry.kind = object.value("kind").toString() == kindName(Speaker) ? Speaker : Player;
+        entry.rfcommChannel = static_cast<quint16>(object.value("rfcommChannel").toInt());
+        entry.serviceName = object.value("serviceName").toString();
+        entry.serviceUuid = object.value("serviceUuid").toString();
+        entry.lastSeen = QDateTime::fromString(object.value("lastSeen").toString(), Qt::ISODate);
+
+        m_entries.insert(entry.address, entry);
+    }
+
+    qCInfo(lcDiscovery) << "loaded" << m_entries.size() << "cached devices";
+}
+
+void DiscoveryCache::save()
+{
+    m_saveTimer.stop();
+
+    QJsonArray devices;
+    for (const Entry &entry : qAsConst(m_entries)) {
+        QJsonObject object;
+        object.insert("address", QBluetoothAddress(entry.address).toString());
+        object.insert("name", entry.name);
+        object.insert("kind", kindName(entry.kind));
+        if (entry.rfcommChannel)
+            object.insert("rfcommChannel", entry.rfcommChannel);
+        if (!entry.serviceName.isEmpty())
+            object.insert("serviceName", entry.serviceName);
+        if (!entry.serviceUuid.isEmpty())
+            object.insert("serviceUuid", entry.serviceUuid);
+        object.insert("lastSeen", entry.lastSeen.toString(Qt::ISODate));
+        devices.append(object);
+    }
+
+    QJsonObject root;
+    root.insert("version", CACHE_VERSION);
+    root.insert("devices", devices);
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "can't write discovery cache" << m_path << file.errorString();
+        return;
+    }
+
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit())
+        qWarning() << "can't write discovery cache" << m_path << file.errorString();
+}
+
+bool DiscoveryCache::contains(quint64 address) const
+{
+    return m_entries.contains(address);
+}
+
+DiscoveryCache::Entry DiscoveryCache::entry(quint64 address) const
+{
+    return m_entries.value(address);
+}
+
+QList<DiscoveryCache::Entry> DiscoveryCache::entries(Kind kind) const
+{
+    QList<Entry> result;
+    for (const Entry &entry : qAsConst(m_entries)) {
+        if (entry.kind == kind)
+            result.append(entry);
+    }
+
+    std::sort(result.begin(), result.end(), [](const Entry &a, const Entry &b) {
+        return a.lastSeen > b.lastSeen;
+    });
+
+    return result;
+}
+
+void DiscoveryCache::update(const Entry &entry)
+{
+    if (!entry.address)
+        return;
+
+    Entry &cached = m_entries[entry.address];
+    cached.address = entry.address;
+    cached.kind = entry.kind;
+    if (!entry.name.isEmpty())
+        cached.name = entry.name;
+    if (entry.rfcommChannel)
+        cached.rfcommChannel = entry.rfcommChannel;
+    if (!entry.serviceName.isEmpty())
+        cached.serviceName = entry.serviceName;
+    if (!entry.serviceUuid.isEmpty())
+        cached.serviceUuid = entry.serviceUuid;
+    cached.lastSeen = QDateTime::currentDateTimeUtc();
+
+    m_saveTimer.start();
+}
+
+void DiscoveryCache::remove(quint64 address)
+{
+    if (m_entries.remove(address))
+        m_saveTimer.start();
+}
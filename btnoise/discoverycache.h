@@ -0,0 +1,58 @@
+#ifndef DISCOVERYCACHE_H
+#define DISCOVERYCACHE_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTimer>
+
+// Every player and speaker ever discovered, kept on disk so the device lists
+// can be filled at startup and known players checked without a full inquiry.
+class DiscoveryCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Kind {
+        Player,
+        Speaker
+    };
+
+    struct Entry {
+        quint64 address = 0;
+        QString name;
+        Kind kind = Player;
+        // From the player's SDP record, 0 / empty when unknown
+        quint16 rfcommChannel = 0;
+        QString serviceName;
+        QString serviceUuid;
+        QDateTime lastSeen;
+    };
+
+    explicit DiscoveryCache(const QString &path = defaultPath(), QObject *parent = nullptr);
+    ~DiscoveryCache();
+
+    static QString defaultPath();
+
+    void load();
+    void save();
+
+    bool contains(quint64 address) const;
+    Entry entry(quint64 address) const;
+    // Most recently seen first
+    QList<Entry> entries(Kind kind) const;
+
+    // Inserts or refreshes an entry and stamps it as seen now. Empty fields
+    // in entry don't overwrite known ones.
+    void update(const Entry &entry);
+    void remove(quint64 address);
+
+private:
+    QString m_path;
+    QHash<quint64, Entry> m_entries;
+    QTimer m_saveTimer;
+};
+
+#endif // DISCOVERYCACHE_H
@@ -0,0 +1,197 @@
+#include "discoverypipeline.h"
+#include "trace.h"
+
+DiscoveryPipeline::DiscoveryPipeline(const QBluetoothUuid &serviceUuid, QObject *parent) :
+    QObject(parent),
+    m_serviceUuid(serviceUuid),
+    m_deviceAgent(this)
+{
+    connect(&m_deviceAgent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered, this, &DiscoveryPipeline::deviceFound);
+    connect(&m_deviceAgent, &QBluetoothDeviceDiscoveryAgent::finished, this, &DiscoveryPipeline::inquiryDone);
+    connect(&m_deviceAgent, &QBluetoothDeviceDiscoveryAgent::canceled, this, &DiscoveryPipeline::inquiryDone);
+    connect(&m_deviceAgent, static_cast<void (QBluetoothDeviceDiscoveryAgent::*)(QBluetoothDeviceDiscoveryAgent::Error)>(&QBluetoothDeviceDiscoveryAgent::error),
+            this, [this](QBluetoothDeviceDiscoveryAgent::Error error) {
+        qCInfo(lcDiscovery) << "inquiry error" << error << m_deviceAgent.errorString();
+        emit inquiryError(error);
+        inquiryDone();
+    });
+
+    for (int i = 0; i < MaxServiceScans; i++) {
+        auto *agent = new QBluetoothServiceDiscoveryAgent(this);
+        agent->setUuidFilter(m_serviceUuid);
+
+        connect(agent, &QBluetoothServiceDiscoveryAgent::serviceDiscovered, this, &DiscoveryPipeline::serviceFound);
+        connect(agent, &QBluetoothServiceDiscoveryAgent::finished, this, [this, agent]() {
+            serviceScanDone(agent);
+        });
+        connect(agent, &QBluetoothServiceDiscoveryAgent::canceled, this, [this, agent]() {
+            serviceScanDone(agent);
+        });
+        // An unreachable device just moves on to the next candidate
+        connect(agent, static_cast<void (QBluetoothServiceDiscoveryAgent::*)(QBluetoothServiceDiscoveryAgent::Error)>(&QBluetoothServiceDiscoveryAgent::error),
+                this, [this, agent](QBluetoothServiceDiscoveryAgent::Error error) {
+            qCDebug(lcDiscovery) << "service query failed" << agent->remoteAddress().toString() << error;
+            serviceScanDone(agent);
+        });
+
+        m_serviceAgents.append(agent);
+    }
+}
+
+void DiscoveryPipeline::setStopAddress(const QBluetoothAddress &address)
+{
+    m_stopAddress = address;
+}
+
+QBluetoothAddress DiscoveryPipeline::stopAddress() const
+{
+    return m_stopAddress;
+}
+
+void DiscoveryPipeline::start(const QList<QBluetoothAddress> &known)
+{
+    if (m_active)
+        return;
+
+    m_active = true;
+    m_queue.clear();
+    m_seen.clear();
+
+    for (const QBluetoothAddress &address : known)
+        enqueue(address, false);
+
+    qCInfo(lcDiscovery) << "starting inquiry," << m_queue.size() << "known devices queued";
+    m_inquiryActive = true;
+    m_deviceAgent.start();
+
+    startServiceScans();
+}
+
+void DiscoveryPipeline::stop()
+{
+    if (!m_active)
+        return;
+
+    m_active = false;
+    m_queue.clear();
+
+    // The agents report back through canceled(), which finds nothing to do
+    const QSet<QBluetoothServiceDiscoveryAgent *> busy = m_busyAgents;
+    m_busyAgents.clear();
+    for (QBluetoothServiceDiscoveryAgent *agent : busy)
+        agent->stop();
+
+    if (m_inquiryActive) {
+        m_inquiryActive = false;
+        m_deviceAgent.stop();
+    }
+
+    emit finished();
+}
+
+bool DiscoveryPipeline::isActive() const
+{
+    return m_active;
+}
+
+void DiscoveryPipeline::deviceFound(const QBluetoothDeviceInfo &device)
+{
+    if (!m_active)
+        return;
+
+    emit deviceDiscovered(device);
+
+    // SDP needs a classic link
+    if (device.coreConfigurations() == QBluetoothDeviceInfo::LowEnergyCoreConfiguration)
+        return;
+
+    // Devices that already advertise the service, or the one being looked
+    // for, are almost certainly hits and are asked first
+    const bool urgent = device.address() == m_stopAddress || device.serviceUuids().contains(m_serviceUuid);
+    qCDebug(lcDiscovery) << "found device" << device.address().toString() << device.name()
+                         << (urgent ? "(likely)" : "");
+
+    enqueue(device.address(), urgent);
+    startServiceScans();
+}
+
+void DiscoveryPipeline::serviceFound(const QBluetoothServiceInfo &service)
+{
+    if (!m_active)
+        return;
+
+    emit serviceDiscovered(service);
+
+    if (!m_stopAddress.isNull() && service.device().address() == m_stopAddress) {
+        qCInfo(lcDiscovery) << "found" << m_stopAddress.toString() << "- ending search early";
+        // Not from inside the agent's own signal
+        QMetaObject::invokeMethod(this, &DiscoveryPipeline::stop, Qt::QueuedConnection);
+    }
+}
+
+void DiscoveryPipeline::enqueue(const QBluetoothAddress &address, bool urgent)
+{
+    if (address.isNull())
+        return;
+
+    if (m_seen.contains(address.toUInt64())) {
+        // Still waiting: an inquiry hint moves it up
+        if (urgent && m_queue.removeOne(address))
+            m_queue.prepend(address);
+        return;
+    }
+
+    m_seen.insert(address.toUInt64());
+    if (urgent)
+        m_queue.prepend(address);
+    else
+        m_queue.append(address);
+}
+
+void DiscoveryPipeline::startServiceScans()
+{
+    for (QBluetoothServiceDiscoveryAgent *agent : qAsConst(m_serviceAgents)) {
+        if (!m_active || m_queue.isEmpty())
+            break;
+        if (m_busyAgents.contains(agent))
+            continue;
+
+        const QBluetoothAddress address = m_queue.takeFirst();
+        TRACE(Discovery, ScanStarted, true, address.toUInt64());
+        qCDebug(lcDiscovery) << "querying services of" << address.toString();
+
+        m_busyAgents.insert(agent);
+        agent->setRemoteAddress(address);
+        agent->start(QBluetoothServiceDiscoveryAgent::MinimalDiscovery);
+    }
+
+    checkFinished();
+}
+
+void DiscoveryPipeline::serviceScanDone(QBluetoothServiceDiscoveryAgent *agent)
+{
+    if (!m_busyAgents.remove(agent))
+        return;
+
+    // The agent can't be restarted from inside its own signal
+    QMetaObject::invokeMethod(this, &DiscoveryPipeline::startServiceScans, Qt::QueuedConnection);
+}
+
+void DiscoveryPipeline::inquiryDone()
+{
+    if (!m_inquiryActive)
+        return;
+
+    qCInfo(lcDiscovery) << "inquiry finished," << m_queue.size() << "devices still to query";
+    m_inquiryActive = false;
+    checkFinished();
+}
+
+void DiscoveryPipeline::checkFinished()
+{
+    if (!m_active || m_inquiryActive || !m_queue.isEmpty() || !m_busyAgents.isEmpty())
+        return;
+
+    m_active = false;
+    emit finished();
+}
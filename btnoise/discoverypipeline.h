@@ -0,0 +1,72 @@
+#ifndef DISCOVERYPIPELINE_H
+#define DISCOVERYPIPELINE_H
+
+#include <QObject>
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceDiscoveryAgent>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothServiceDiscoveryAgent>
+#include <QBluetoothServiceInfo>
+#include <QBluetoothUuid>
+#include <QList>
+#include <QSet>
+#include <QVector>
+
+// Looks for devices offering one service. The inquiry and the per-device
+// service lookups run side by side: every device is queued for an SDP query
+// as soon as the inquiry reports it, instead of after the whole 10+ s
+// inquiry as a full service discovery would. Known addresses are queued
+// before anything the inquiry finds, and devices already advertising the
+// service in their inquiry response jump the queue.
+//
+// With a stop address set, the search ends as soon as that device is seen
+// offering the service.
+class DiscoveryPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    // SDP queries in flight at once; more mostly queue up in the controller
+    static const int MaxServiceScans = 2;
+
+    explicit DiscoveryPipeline(const QBluetoothUuid &serviceUuid, QObject *parent = nullptr);
+
+    void setStopAddress(const QBluetoothAddress &address);
+    QBluetoothAddress stopAddress() const;
+
+    // known: addresses to ask first, in order
+    void start(const QList<QBluetoothAddress> &known);
+    void stop();
+    bool isActive() const;
+
+signals:
+    void deviceDiscovered(const QBluetoothDeviceInfo &device);
+    void serviceDiscovered(const QBluetoothServiceInfo &service);
+    void inquiryError(QBluetoothDeviceDiscoveryAgent::Error error);
+    // Once per start(), also after stop() and early termination
+    void finished();
+
+private:
+    void deviceFound(const QBluetoothDeviceInfo &device);
+    void serviceFound(const QBluetoothServiceInfo &service);
+    void enqueue(const QBluetoothAddress &address, bool urgent);
+    void startServiceScans();
+    void serviceScanDone(QBluetoothServiceDiscoveryAgent *agent);
+    void inquiryDone();
+    void checkFinished();
+
+    QBluetoothUuid m_serviceUuid;
+    QBluetoothAddress m_stopAddress;
+
+    QBluetoothDeviceDiscoveryAgent m_deviceAgent;
+    QVector<QBluetoothServiceDiscoveryAgent *> m_serviceAgents;
+    QSet<QBluetoothServiceDiscoveryAgent *> m_busyAgents;
+
+    QList<QBluetoothAddress> m_queue;
+    // Queued or checked during this search
+    QSet<quint64> m_seen;
+    bool m_active = false;
+    bool m_inquiryActive = false;
+};
+
+#endif // DISCOVERYPIPELINE_H
@@ -0,0 +1,49 @@
+#include "app-global.h"
+#include "localtransport.h"
+
+LocalTransport::LocalTransport(QObject *parent) :
+    PlayerTransport(parent),
+    m_socket(this)
+{
+    connect(&m_socket, &QLocalSocket::connected, this, &PlayerTransport::connected);
+    connect(&m_socket, &QLocalSocket::disconnected, this, &PlayerTransport::disconnected);
+    connect(&m_socket, &QLocalSocket::readyRead, this, &PlayerTransport::readyRead);
+    connect(&m_socket, static_cast<void (QLocalSocket::*)(QLocalSocket::LocalSocketError)>(&QLocalSocket::error),
+            [this]() {
+        emit errorOccurred(m_socket.errorString());
+    });
+}
+
+PlayerTransport::Kind LocalTransport::kind() const
+{
+    return Local;
+}
+
+PlayerTransport::State LocalTransport::state() const
+{
+    switch (m_socket.state()) {
+    case QLocalSocket::ConnectedState:
+        return ConnectedState;
+    case QLocalSocket::ClosingState:
+        return ClosingState;
+    case QLocalSocket::UnconnectedState:
+        return UnconnectedState;
+    default:
+        return ConnectingState;
+    }
+}
+
+void LocalTransport::connectToPlayer(const QString &address)
+{
+    m_socket.connectToServer(address.isEmpty() ? QString(PLAYER_LOCAL_NAME) : address);
+}
+
+void LocalTransport::close()
+{
+    m_socket.close();
+}
+
+QIODevice *LocalTransport::device()
+{
+    return &m_socket;
+}
@@ -0,0 +1,25 @@
+#ifndef LOCALTRANSPORT_H
+#define LOCALTRANSPORT_H
+
+#include "playertransport.h"
+
+#include <QLocalSocket>
+
+class LocalTransport : public PlayerTransport
+{
+    Q_OBJECT
+
+public:
+    explicit LocalTransport(QObject *parent = nullptr);
+
+    Kind kind() const override;
+    State state() const override;
+    void connectToPlayer(const QString &address) override;
+    void close() override;
+    QIODevice *device() override;
+
+private:
+    QLocalSocket m_socket;
+};
+
+#endif // LOCALTRANSPORT_H
@@ -1,20 +1,71 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
-#include <QSettings>
+#include <QQuickWindow>
+#include <QCommandLineParser>
 #include <QtCore/QLoggingCategory>
 
+#include "app-global.h"
+#include "appconfig.h"
 #include "devicefinder.h"
+#include "startuptimeline.h"
+
+#ifdef SIMULATOR
+#include "simulatedplayer.h"
+#endif
 
 int main(int argc, char *argv[])
 {
+    StartupTimeline &timeline = StartupTimeline::instance();
+
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 
     QGuiApplication app(argc, argv);
 
-    QSettings settings;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption transportOption("transport", "Player transport: rfcomm, tcp or local.", "kind");
+    QCommandLineOption playerOption("player", "Player address for the selected transport.", "address");
+    parser.addOption(transportOption);
+    parser.addOption(playerOption);
+#ifdef SIMULATOR
+    QCommandLineOption simulateOption("simulate", "Run against an in-process stand-in player.");
+    QCommandLineOption simulateDelayOption("simulate-delay", "One way link delay of the stand-in player, plus up to as much jitter.", "ms");
+    QCommandLineOption simulateClockOption("simulate-clock-offset", "How far the stand-in player's clock is ahead of ours.", "ms");
+    parser.addOption(simulateOption);
+    parser.addOption(simulateDelayOption);
+    parser.addOption(simulateClockOption);
+#endif
+    parser.process(app);
+
+    AppConfig config;
+    config.load();
+
+    if (parser.isSet(transportOption)) {
+        bool ok = false;
+        const auto kind = PlayerTransport::kindFromString(parser.value(transportOption), &ok);
+        if (!ok)
+            qWarning() << "unknown transport" << parser.value(transportOption) << "- using rfcomm";
+        config.overrideTransportKind(kind);
+    }
 
-    DeviceFinder deviceFinder(&settings);
+    // Overrides are for this run, the saved player stays for the next
+    if (parser.isSet(playerOption))
+        config.overridePlayer(parser.value(playerOption), parser.value(playerOption));
+
+#ifdef SIMULATOR
+    SimulatedPlayer simulatedPlayer;
+    simulatedPlayer.setLinkDelay(parser.value(simulateDelayOption).toInt());
+    simulatedPlayer.setClockOffset(parser.value(simulateClockOption).toLongLong() * 1000);
+    if (parser.isSet(simulateOption) && simulatedPlayer.listen()) {
+        config.overrideTransportKind(PlayerTransport::Local);
+        config.overridePlayer(simulatedPlayer.serverName(), QStringLiteral("Simulated Player"));
+    }
+#endif
+
+    DeviceFinder deviceFinder(&config);
+    // The connect runs while QML loads instead of waiting for the first page
+    deviceFinder.connectSavedPlayer();
 
     QQmlApplicationEngine engine;
     engine.rootContext()->setContextProperty("deviceFinder", &deviceFinder);
@@ -22,6 +73,13 @@ int main(int argc, char *argv[])
     engine.load(QUrl(QStringLiteral("qrc:/qml/main.qml")));
     if (engine.rootObjects().isEmpty())
         return -1;
+    timeline.mark(StartupTimeline::EngineLoaded);
+
+    if (auto *window = qobject_cast<QQuickWindow *>(engine.rootObjects().first())) {
+        QObject::connect(window, &QQuickWindow::frameSwapped, &timeline, [&timeline]() {
+            timeline.mark(StartupTimeline::FirstFrame);
+        }, Qt::DirectConnection);
+    }
 
     return app.exec();
 }
@@ -0,0 +1,297 @@
+#include "metrics.h"
+#include "startuptimeline.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <cmath>
+
+namespace {
+
+// Snapshot refresh rate for QML, counters update far more often
+const int PUBLISH_INTERVAL = 500;
+
+QString opcodeKey(int opcode)
+{
+    const std::string_view name = ProtocolParser::opcodeName(static_cast<ProtocolOpcode>(opcode));
+    if (name.empty())
+        return QStringLiteral("0x%1").arg(opcode, 2, 16, QLatin1Char('0'));
+    return QString::fromLatin1(name.data(), static_cast<int>(name.size()));
+}
+
+QVariantMap opcodeCounts(const std::array<quint64, 256> &counts)
+{
+    QVariantMap result;
+    for (int opcode = 0; opcode < int(counts.size()); opcode++) {
+        if (counts[opcode])
+            result.insert(opcodeKey(opcode), counts[opcode]);
+    }
+    return result;
+}
+
+quint64 total(const std::array<quint64, 256> &counts)
+{
+    quint64 sum = 0;
+    for (quint64 count : counts)
+        sum += count;
+    return sum;
+}
+
+}
+
+double Metrics::Histogram::upperBound(int bucket)
+{
+    // 1, 2, 4 ... 2048 ms
+    return std::ldexp(1.0, bucket);
+}
+
+void Metrics::Histogram::add(double ms)
+{
+    int bucket = 0;
+    while (bucket < BUCKETS && ms > upperBound(bucket))
+        bucket++;
+
+    counts[bucket]++;
+    min = count ? qMin(min, ms) : ms;
+    max = count ? qMax(max, ms) : ms;
+    sum += ms;
+    count++;
+}
+
+double Metrics::Histogram::percentile(double p) const
+{
+    if (!count)
+        return 0;
+
+    // Upper bound of the bucket holding the p-th sample, capped by the
+    // largest sample actually seen
+    const quint64 rank = static_cast<quint64>(std::ceil(p * count));
+    quint64 seen = 0;
+    for (int bucket = 0; bucket <= BUCKETS; bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank)
+            return bucket < BUCKETS ? qMin(upperBound(bucket), max) : max;
+    }
+    return max;
+}
+
+QVariantMap Metrics::Histogram::toVariantMap() const
+{
+    QVariantList buckets;
+    for (int bucket = 0; bucket <= BUCKETS; bucket++) {
+        QVariantMap entry;
+        entry.insert(QStringLiteral("le"), bucket < BUCKETS ? QVariant(upperBound(bucket)) : QVariant(QStringLiteral("inf")));
+        entry.insert(QStringLiteral("count"), counts[bucket]);
+        buckets.append(entry);
+    }
+
+    QVariantMap result;
+    result.insert(QStringLiteral("count"), count);
+    result.insert(QStringLiteral("mean"), count ? sum / count : 0.0);
+    result.insert(QStringLiteral("min"), min);
+    result.insert(QStringLiteral("max"), max);
+    result.insert(QStringLiteral("p50"), percentile(0.5));
+    result.insert(QStringLiteral("p95"), percentile(0.95));
+    result.insert(QStringLiteral("p99"), percentile(0.99));
+    result.insert(QStringLiteral("buckets"), buckets);
+    return result;
+}
+
+Metrics::Metrics(QObject *parent) :
+    QObject(parent)
+{
+    m_publishTimer.setInterval(PUBLISH_INTERVAL);
+    m_publishTimer.setSingleShot(true);
+    connect(&m_publishTimer, &QTimer::timeout, this, &Metrics::changed);
+    connect(&StartupTimeline::instance(), &StartupTimeline::changed, this, &Metrics::touch);
+}
+
+void Metrics::touch()
+{
+    if (!m_publishTimer.isActive())
+        m_publishTimer.start();
+}
+
+void Metrics::recordBytesSent(qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+    m_bytesSent += quint64(bytes);
+    touch();
+}
+
+void Metrics::recordBytesReceived(qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+    m_bytesReceived += quint64(bytes);
+    touch();
+}
+
+void Metrics::recordCommandSent(ProtocolOpcode opcode)
+{
+    m_sent[quint8(opcode)]++;
+    touch();
+}
+
+void Metrics::recordMessageReceived(ProtocolOpcode opcode)
+{
+    m_received[quint8(opcode)]++;
+    touch();
+}
+
+void Metrics::recordCommandBytes(ProtocolOpcode opcode, qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+    m_sentBytes[quint8(opcode)] += quint64(bytes);
+    touch();
+}
+
+void Metrics::recordMessageBytes(ProtocolOpcode opcode, qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+    m_receivedBytes[quint8(opcode)] += quint64(bytes);
+    touch();
+}
+
+void Metrics::recordUnrecognized()
+{
+    m_unrecognized++;
+    touch();
+}
+
+void Metrics::recordRoundTrip(ProtocolOpcode opcode, qint64 usec)
+{
+    Q_UNUSED(opcode)
+    m_roundTrip.add(usec / 1000.0);
+    touch();
+}
+
+void Metrics::recordCommandFailed(ProtocolOpcode opcode, bool timedOut)
+{
+    Q_UNUSED(opcode)
+    m_failed++;
+    if (timedOut)
+        m_timedOut++;
+    touch();
+}
+
+void Metrics::recordConnectAttempt()
+{
+    // Time to connect runs from the first attempt, retries included
+    if (!m_connectClock.isValid())
+        m_connectClock.start();
+    m_connectAttempts++;
+    touch();
+}
+
+void Metrics::recordConnected()
+{
+    m_connects++;
+    if (m_connectClock.isValid()) {
+        m_timeToConnect.add(m_connectClock.elapsed());
+        m_connectClock.invalidate();
+    }
+    touch();
+}
+
+void Metrics::recordDiscoveryStarted()
+{
+    m_discoveryClock.start();
+}
+
+void Metrics::recordDiscoveryFinished()
+{
+    if (!m_discoveryClock.isValid())
+        return;
+
+    m_discoveries++;
+    m_discoveryDuration.add(m_discoveryClock.elapsed());
+    m_discoveryClock.invalidate();
+    touch();
+}
+
+QVariantMap Metrics::snapshot() const
+{
+    QVariantMap link;
+    link.insert(QStringLiteral("bytesSent"), m_bytesSent);
+    link.insert(QStringLiteral("bytesReceived"), m_bytesReceived);
+    link.insert(QStringLiteral("connectAttempts"), m_connectAttempts);
+    link.insert(QStringLiteral("connects"), m_connects);
+    link.insert(QStringLiteral("timeToConnect"), m_timeToConnect.toVariantMap());
+
+    QVariantMap protocol;
+    protocol.insert(QStringLiteral("commandsSent"), total(m_sent));
+    protocol.insert(QStringLiteral("messagesReceived"), total(m_received));
+    protocol.insert(QStringLiteral("sentByOpcode"), opcodeCounts(m_sent));
+    protocol.insert(QStringLiteral("receivedByOpcode"), opcodeCounts(m_received));
+    protocol.insert(QStringLiteral("bytesSentByOpcode"), opcodeCounts(m_sentBytes));
+    protocol.insert(QStringLiteral("bytesReceivedByOpcode"), opcodeCounts(m_receivedBytes));
+    protocol.insert(QStringLiteral("unrecognized"), m_unrecognized);
+    protocol.insert(QStringLiteral("failed"), m_failed);
+    protocol.insert(QStringLiteral("timedOut"), m_timedOut);
+    protocol.insert(QStringLiteral("roundTrip"), m_roundTrip.toVariantMap());
+
+    QVariantMap discovery;
+    discovery.insert(QStringLiteral("searches"), m_discoveries);
+    discovery.insert(QStringLiteral("duration"), m_discoveryDuration.toVariantMap());
+
+    QVariantMap result;
+    result.insert(QStringLiteral("link"), link);
+    result.insert(QStringLiteral("protocol"), protocol);
+    result.insert(QStringLiteral("discovery"), discovery);
+    result.insert(QStringLiteral("startup"), StartupTimeline::instance().toVariantMap());
+    return result;
+}
+
+QJsonObject Metrics::toJson() const
+{
+    return QJsonObject::fromVariantMap(snapshot());
+}
+
+QString Metrics::exportJson(const QString &path)
+{
+    QString fileName = path;
+    if (fileName.isEmpty()) {
+        const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(dir);
+        fileName = dir + QStringLiteral("/metrics.json");
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return QString();
+
+    file.write(QJsonDocument(toJson()).toJson());
+    if (!file.commit())
+        return QString();
+
+    qCInfo(lcUi) << "metrics written to" << fileName;
+    return fileName;
+}
+
+void Metrics::reset()
+{
+    m_bytesSent = 0;
+    m_bytesReceived = 0;
+    m_sent.fill(0);
+    m_received.fill(0);
+    m_sentBytes.fill(0);
+    m_receivedBytes.fill(0);
+    m_unrecognized = 0;
+    m_failed = 0;
+    m_timedOut = 0;
+    m_connectAttempts = 0;
+    m_connects = 0;
+    m_discoveries = 0;
+    m_roundTrip = Histogram();
+    m_timeToConnect = Histogram();
+    m_discoveryDuration = Histogram();
+
+    emit changed();
+}
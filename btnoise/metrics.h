@@ -0,0 +1,95 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "protocol.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <array>
+
+// Counters for the player link, the protocol and discovery. Recording is a
+// few integer updates, QML sees a snapshot refreshed at most twice a second.
+class Metrics : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QVariantMap snapshot READ snapshot NOTIFY changed)
+
+public:
+    explicit Metrics(QObject *parent = nullptr);
+
+    void recordBytesSent(qint64 bytes);
+    void recordBytesReceived(qint64 bytes);
+    void recordCommandSent(ProtocolOpcode opcode);
+    void recordMessageReceived(ProtocolOpcode opcode);
+    // Encoded or parsed size of one command or message, framing included
+    void recordCommandBytes(ProtocolOpcode opcode, qint64 bytes);
+    void recordMessageBytes(ProtocolOpcode opcode, qint64 bytes);
+    void recordUnrecognized();
+    void recordRoundTrip(ProtocolOpcode opcode, qint64 usec);
+    void recordCommandFailed(ProtocolOpcode opcode, bool timedOut);
+
+    void recordConnectAttempt();
+    void recordConnected();
+    void recordDiscoveryStarted();
+    void recordDiscoveryFinished();
+
+    QVariantMap snapshot() const;
+    QJsonObject toJson() const;
+
+public slots:
+    // Writes the metrics to path, or to the app data directory if empty.
+    // Returns the file written, empty on failure.
+    QString exportJson(const QString &path = QString());
+    void reset();
+
+signals:
+    void changed();
+
+private:
+    // Exponential buckets in milliseconds, the last one catches the rest
+    struct Histogram {
+        static const int BUCKETS = 12;
+
+        std::array<quint64, BUCKETS + 1> counts{};
+        quint64 count = 0;
+        double sum = 0;
+        double min = 0;
+        double max = 0;
+
+        void add(double ms);
+        double percentile(double p) const;
+        QVariantMap toVariantMap() const;
+
+        static double upperBound(int bucket);
+    };
+
+    void touch();
+
+    quint64 m_bytesSent = 0;
+    quint64 m_bytesReceived = 0;
+    std::array<quint64, 256> m_sent{};
+    std::array<quint64, 256> m_received{};
+    std::array<quint64, 256> m_sentBytes{};
+    std::array<quint64, 256> m_receivedBytes{};
+    quint64 m_unrecognized = 0;
+    quint64 m_failed = 0;
+    quint64 m_timedOut = 0;
+
+    quint64 m_connectAttempts = 0;
+    quint64 m_connects = 0;
+    quint64 m_discoveries = 0;
+
+    Histogram m_roundTrip;
+    Histogram m_timeToConnect;
+    Histogram m_discoveryDuration;
+
+    QElapsedTimer m_connectClock;
+    QElapsedTimer m_discoveryClock;
+    QTimer m_publishTimer;
+};
+
+#endif // METRICS_H
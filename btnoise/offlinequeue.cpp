@@ -0,0 +1,192 @@
+#include "offlinequeue.h"
+#include "trace.h"
+
+namespace {
+
+bool isTransportCommand(ProtocolOpcode opcode)
+{
+    return opcode == ProtocolOpcode::Play || opcode == ProtocolOpcode::Stop;
+}
+
+}
+
+OfflineQueue::OfflineQueue(QObject *parent) :
+    QObject(parent)
+{
+    m_clock.start();
+
+    m_expiryTimer.setSingleShot(true);
+    connect(&m_expiryTimer, &QTimer::timeout, this, &OfflineQueue::expire);
+}
+
+int OfflineQueue::maxAgeFor(ProtocolOpcode opcode)
+{
+    switch (opcode) {
+    case ProtocolOpcode::Scan:
+        // Results nobody waits for anymore
+        return 10000;
+    case ProtocolOpcode::ConnectSpeaker:
+    case ProtocolOpcode::UnpairSpeaker:
+        return 60000;
+    default:
+        return 30000;
+    }
+}
+
+void OfflineQueue::enqueue(const ProtocolMessage &message, Rollback rollback, bool sent)
+{
+    ProtocolMessage queued = message;
+    if (queued.opcode == ProtocolOpcode::PlayAt) {
+        queued.opcode = ProtocolOpcode::Play;
+        queued.times = {};
+    } else if (queued.opcode == ProtocolOpcode::SetVolumeAt) {
+        queued.opcode = ProtocolOpcode::SetVolume;
+        queued.times = {};
+    }
+
+    switch (queued.opcode) {
+    case ProtocolOpcode::Play:
+    case ProtocolOpcode::Stop: {
+        // The UI only offers the opposite of what it shows, so an opposite
+        // command queued earlier was a change this one takes back. Unless it
+        // was sent already: the player may be running it, so this one has to
+        // go out and undo it.
+        const int index = indexOf(isTransportCommand);
+        if (index >= 0) {
+            const bool wasStop = m_entries.at(index).message.opcode == ProtocolOpcode::Stop;
+            const bool wasSent = m_entries.at(index).sent;
+            m_entries.removeAt(index);
+            if (!wasSent && wasStop != (queued.opcode == ProtocolOpcode::Stop)) {
+                qCDebug(lcProtocol) << "queued PLAY and STOP cancel out";
+                scheduleExpiry();
+                return;
+            }
+        }
+        break;
+    }
+    case ProtocolOpcode::SetVolume:
+        removeQueued(ProtocolOpcode::SetVolume);
+        // Ends a ramp on the player as well as a waiting cancel would
+        removeQueued(ProtocolOpcode::Ramp);
+        break;
+    case ProtocolOpcode::Ramp:
+        // Only cancels wait here, PlayerSession never queues a ramp
+        removeQueued(ProtocolOpcode::Ramp);
+        break;
+    case ProtocolOpcode::ConnectSpeaker:
+        removeQueued(ProtocolOpcode::ConnectSpeaker);
+        break;
+    case ProtocolOpcode::UnpairSpeaker:
+        // Unpairing undoes any speaker connect queued before it
+        removeQueued(ProtocolOpcode::ConnectSpeaker, ProtocolOpcode::UnpairSpeaker);
+        break;
+    case ProtocolOpcode::Scan:
+        removeQueued(ProtocolOpcode::Scan);
+        break;
+    default:
+        break;
+    }
+
+    if (m_entries.size() >= MaxEntries) {
+        qCInfo(lcProtocol) << "offline queue full, dropping oldest command";
+        drop(0);
+    }
+
+    Entry entry;
+    entry.message = queued;
+    entry.message.sequence = 0;
+    entry.rollback = std::move(rollback);
+    entry.expires = m_clock.elapsed() + maxAgeFor(queued.opcode);
+    entry.sent = sent;
+    m_entries.append(std::move(entry));
+
+    scheduleExpiry();
+}
+
+QList<ProtocolMessage> OfflineQueue::take()
+{
+    expire();
+
+    QList<ProtocolMessage> result;
+    for (const Entry &entry : qAsConst(m_entries))
+        result.append(entry.message);
+
+    m_entries.clear();
+    m_expiryTimer.stop();
+    return result;
+}
+
+void OfflineQueue::clear()
+{
+    while (!m_entries.isEmpty())
+        drop(0);
+    m_expiryTimer.stop();
+}
+
+int OfflineQueue::size() const
+{
+    return m_entries.size();
+}
+
+bool OfflineQueue::isEmpty() const
+{
+    return m_entries.isEmpty();
+}
+
+int OfflineQueue::indexOf(bool (*matches)(ProtocolOpcode)) const
+{
+    for (int i = 0; i < m_entries.size(); i++) {
+        if (matches(m_entries.at(i).message.opcode))
+            return i;
+    }
+    return -1;
+}
+
+void OfflineQueue::removeQueued(ProtocolOpcode opcode, ProtocolOpcode alternative)
+{
+    // Superseded, so the newer command's rollback covers them
+    for (int i = m_entries.size() - 1; i >= 0; i--) {
+        const ProtocolOpcode queued = m_entries.at(i).message.opcode;
+        if (queued == opcode || queued == alternative)
+            m_entries.removeAt(i);
+    }
+}
+
+void OfflineQueue::drop(int index)
+{
+    // Taken out first, the rollback may queue something new
+    Entry entry = m_entries.takeAt(index);
+    if (entry.rollback)
+        entry.rollback();
+}
+
+void OfflineQueue::expire()
+{
+    const qint64 now = m_clock.elapsed();
+
+    for (int i = 0; i < m_entries.size(); ) {
+        if (m_entries.at(i).expires <= now) {
+            qCInfo(lcProtocol) << "offline command expired"
+                               << int(m_entries.at(i).message.opcode);
+            drop(i);
+        } else {
+            i++;
+        }
+    }
+
+    scheduleExpiry();
+}
+
+void OfflineQueue::scheduleExpiry()
+{
+    if (m_entries.isEmpty()) {
+        m_expiryTimer.stop();
+        return;
+    }
+
+    qint64 next = m_entries.first().expires;
+    for (const Entry &entry : qAsConst(m_entries))
+        next = qMin(next, entry.expires);
+
+    m_expiryTimer.start(int(qMax<qint64>(0, next - m_clock.elapsed())));
+}
@@ -0,0 +1,67 @@
+#ifndef OFFLINEQUEUE_H
+#define OFFLINEQUEUE_H
+
+#include "commandtracker.h"
+#include "protocol.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTimer>
+
+// Commands issued while the player is unreachable, replayed once the link
+// is back. Only the net effect is kept: the latest SET_VOL wins, a PLAY
+// followed by a STOP (or the other way round) cancels out, and repeated
+// speaker commands collapse into the last one. Commands left waiting too
+// long expire and run their rollback, so the UI doesn't keep promising a
+// change that will never be made.
+//
+// PLAY_AT and SET_VOL_AT are queued as plain PLAY and SET_VOL: their time
+// is on a clock estimate that doesn't survive the link, and they are
+// replayed before the clock is synchronized again.
+class OfflineQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Rollback = CommandTracker::Rollback;
+
+    static const int MaxEntries = 16;
+
+    explicit OfflineQueue(QObject *parent = nullptr);
+
+    // message must not carry text, the view would dangle. A sent command
+    // went out before the link dropped and may have been applied already, so
+    // a PLAY or STOP queued after it replaces it instead of cancelling out.
+    void enqueue(const ProtocolMessage &message, Rollback rollback = Rollback(), bool sent = false);
+    // Empties the queue, returning what is still fresh in issue order
+    QList<ProtocolMessage> take();
+    // Drops everything, running the rollbacks
+    void clear();
+
+    int size() const;
+    bool isEmpty() const;
+
+    // How long a command stays worth sending, in ms
+    static int maxAgeFor(ProtocolOpcode opcode);
+
+private:
+    struct Entry {
+        ProtocolMessage message;
+        Rollback rollback;
+        qint64 expires = 0;
+        bool sent = false;
+    };
+
+    int indexOf(bool (*matches)(ProtocolOpcode)) const;
+    void removeQueued(ProtocolOpcode opcode, ProtocolOpcode alternative = ProtocolOpcode::Invalid);
+    void drop(int index);
+    void expire();
+    void scheduleExpiry();
+
+    QList<Entry> m_entries;
+    QElapsedTimer m_clock;
+    QTimer m_expiryTimer;
+};
+
+#endif // OFFLINEQUEUE_H
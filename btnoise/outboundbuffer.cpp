@@ -0,0 +1,125 @@
+#include "outboundbuffer.h"
+#include "trace.h"
+
+OutboundBuffer::OutboundBuffer(QObject *parent) :
+    QObject(parent)
+{
+    m_buffer.reserve(InitialCapacity);
+
+    // Zero interval: fires once control returns to the event loop
+    m_flushTimer.setInterval(0);
+    m_flushTimer.setSingleShot(true);
+    connect(&m_flushTimer, &QTimer::timeout, this, &OutboundBuffer::flush);
+}
+
+void OutboundBuffer::setDevice(QIODevice *device)
+{
+    if (m_device)
+        disconnect(m_device, nullptr, this, nullptr);
+
+    m_device = device;
+    clear();
+
+    if (m_device)
+        connect(m_device, &QIODevice::bytesWritten, this, &OutboundBuffer::bytesWritten);
+}
+
+void OutboundBuffer::setBinaryFraming(bool binary)
+{
+    m_binaryFraming = binary;
+}
+
+bool OutboundBuffer::binaryFraming() const
+{
+    return m_binaryFraming;
+}
+
+ProtocolWriter OutboundBuffer::command(ProtocolOpcode opcode)
+{
+    return open(m_buffer, opcode);
+}
+
+void OutboundBuffer::send(const ProtocolMessage &message)
+{
+    settle();
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+
+    const std::size_t before = m_buffer.size();
+    ProtocolWriter::encode(message, m_binaryFraming, m_buffer);
+    emit encoded(message.opcode, static_cast<qint64>(m_buffer.size() - before));
+}
+
+ProtocolWriter OutboundBuffer::bulkCommand(ProtocolOpcode opcode)
+{
+    return open(m_bulkBuffer, opcode);
+}
+
+ProtocolWriter OutboundBuffer::open(std::string &buffer, ProtocolOpcode opcode)
+{
+    settle();
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+
+    m_openOpcode = opcode;
+    m_openBuffer = &buffer;
+    m_openAt = buffer.size();
+
+    ProtocolWriter writer(buffer, m_binaryFraming);
+    writer.begin(opcode);
+    return writer;
+}
+
+void OutboundBuffer::settle()
+{
+    if (!m_openBuffer)
+        return;
+
+    const qint64 bytes = static_cast<qint64>(m_openBuffer->size() - m_openAt);
+    m_openBuffer = nullptr;
+    emit encoded(m_openOpcode, bytes);
+}
+
+qint64 OutboundBuffer::queuedBytes() const
+{
+    const qint64 batched = static_cast<qint64>(m_buffer.size() + m_bulkBuffer.size());
+    return batched + (m_device && m_device->isOpen() ? m_device->bytesToWrite() : 0);
+}
+
+bool OutboundBuffer::isEmpty() const
+{
+    return m_buffer.empty() && m_bulkBuffer.empty();
+}
+
+void OutboundBuffer::clear()
+{
+    // Nothing of it goes out
+    m_openBuffer = nullptr;
+    m_flushTimer.stop();
+    // clear() keeps the capacity around for the next batch
+    m_buffer.clear();
+    m_bulkBuffer.clear();
+}
+
+void OutboundBuffer::flush()
+{
+    m_flushTimer.stop();
+    settle();
+
+    if (isEmpty())
+        return;
+
+    // Commands first, then bulk data, still in one write
+    if (!m_bulkBuffer.empty()) {
+        m_buffer += m_bulkBuffer;
+        m_bulkBuffer.clear();
+    }
+
+    qint64 written = 0;
+    if (m_device && m_device->isOpen())
+        written = m_device->write(m_buffer.data(), static_cast<qint64>(m_buffer.size()));
+
+    TRACE(Transport, BytesFlushed, written, m_buffer.size());
+    m_buffer.clear();
+    emit flushed(written);
+}
@@ -0,0 +1,74 @@
+#ifndef OUTBOUNDBUFFER_H
+#define OUTBOUNDBUFFER_H
+
+#include "protocol.h"
+
+#include <QObject>
+#include <QIODevice>
+#include <QTimer>
+
+#include <string>
+
+// Collects the commands issued during one event loop iteration and hands
+// them to the transport in a single write. On RFCOMM every write tends to
+// become its own packet, so batching saves both syscalls and air time.
+//
+// Bulk data is collected apart and written after the commands of the same
+// batch, so a STOP issued while upload chunks are being queued still goes
+// out ahead of them.
+class OutboundBuffer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit OutboundBuffer(QObject *parent = nullptr);
+
+    void setDevice(QIODevice *device);
+    void setBinaryFraming(bool binary);
+    bool binaryFraming() const;
+
+    // Starts a command in the buffer and schedules a flush; finish it with
+    // end() after adding the arguments.
+    ProtocolWriter command(ProtocolOpcode opcode);
+    void send(const ProtocolMessage &message);
+    // Like command(), for bulk data
+    ProtocolWriter bulkCommand(ProtocolOpcode opcode);
+
+    // Bytes not yet handed to the link: batched here or buffered by the
+    // device
+    qint64 queuedBytes() const;
+
+    bool isEmpty() const;
+    void clear();
+
+public slots:
+    void flush();
+
+signals:
+    void flushed(qint64 bytes);
+    // Size of each command as encoded, framing included. One started with
+    // command() or bulkCommand() is measured once the next one starts or
+    // the batch is flushed.
+    void encoded(ProtocolOpcode opcode, qint64 bytes);
+    // The device passed data on, there may be room for more bulk data
+    void bytesWritten();
+
+private:
+    static const std::size_t InitialCapacity = 512;
+
+    ProtocolWriter open(std::string &buffer, ProtocolOpcode opcode);
+    void settle();
+
+    QIODevice *m_device = nullptr;
+    bool m_binaryFraming = false;
+    std::string m_buffer;
+    std::string m_bulkBuffer;
+    QTimer m_flushTimer;
+
+    // The command being built with a ProtocolWriter, not yet measured
+    ProtocolOpcode m_openOpcode = ProtocolOpcode::Invalid;
+    const std::string *m_openBuffer = nullptr;
+    std::size_t m_openAt = 0;
+};
+
+#endif // OUTBOUNDBUFFER_H
@@ -0,0 +1,928 @@
+#include "playersession.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <QBluetoothAddress>
+
+// A player line never comes close to this, anything longer is garbage
+static const int MAX_LINE_LENGTH = 4096;
+
+PlayerSession::PlayerSession(const QString &address, const QString &name, PlayerTransport::Kind kind,
+                             Metrics *metrics, QObject *parent) :
+    QObject(parent),
+    m_address(address),
+    m_name(name),
+    m_metrics(metrics),
+    m_commands(&m_outbound)
+{
+    setTransportKind(kind);
+
+    connect(&m_commands, &CommandTracker::roundTripTimeChanged, this, &PlayerSession::roundTripTimeChanged);
+    connect(&m_commands, &CommandTracker::latencyStatsChanged, this, &PlayerSession::latencyStatsChanged);
+
+    connect(&m_commands, &CommandTracker::commandAcknowledged, this, &PlayerSession::commandSettled);
+    connect(&m_commands, &CommandTracker::commandFailed, this, &PlayerSession::commandSettled);
+
+    connect(&m_commands, &CommandTracker::commandSent, m_metrics, &Metrics::recordCommandSent);
+    connect(&m_commands, &CommandTracker::commandAcknowledged, m_metrics, &Metrics::recordRoundTrip);
+    connect(&m_commands, &CommandTracker::commandFailed, m_metrics, &Metrics::recordCommandFailed);
+    connect(&m_outbound, &OutboundBuffer::flushed, m_metrics, &Metrics::recordBytesSent);
+    connect(&m_outbound, &OutboundBuffer::encoded, m_metrics, &Metrics::recordCommandBytes);
+
+    m_volControlTimer.setSingleShot(true);
+    m_volControlTimer.setInterval(DefaultVolumeSendInterval);
+    connect(&m_volControlTimer, &QTimer::timeout, this, &PlayerSession::sendVolCmd);
+
+    connect(&m_timeSyncTimer, &QTimer::timeout, this, &PlayerSession::sendTimeRequest);
+
+    m_rampTimer.setInterval(RampStepInterval);
+    connect(&m_rampTimer, &QTimer::timeout, this, &PlayerSession::stepRamp);
+
+    connect(&m_connection, &ConnectionStateMachine::connected, this, &PlayerSession::handleConnection);
+    connect(&m_connection, &ConnectionStateMachine::disconnected, this, &PlayerSession::handleDisconnection);
+    connect(&m_connection, &ConnectionStateMachine::stateChanged, this, &PlayerSession::connectionStateChanged);
+    connect(&m_connection, &ConnectionStateMachine::stateChanged, this, [this](ConnectionStateMachine::State state) {
+        if (state == ConnectionStateMachine::Connecting)
+            m_metrics->recordConnectAttempt();
+        else if (state == ConnectionStateMachine::Connected)
+            m_metrics->recordConnected();
+    });
+
+    m_connection.setAddress(m_address);
+}
+
+QString PlayerSession::address() const
+{
+    return m_address;
+}
+
+QString PlayerSession::name() const
+{
+    return m_name;
+}
+
+PlayerTransport::Kind PlayerSession::transportKind() const
+{
+    return m_transport->kind();
+}
+
+void PlayerSession::setTransportKind(PlayerTransport::Kind kind)
+{
+    if (m_transport && m_transport->kind() == kind)
+        return;
+
+    if (m_transport) {
+        m_connection.setTransport(nullptr);
+        m_transport->disconnect(this);
+        m_transport->close();
+        m_transport->deleteLater();
+
+        if (m_connected)
+            handleDisconnection();
+    }
+
+    qCInfo(lcTransport) << "using player transport" << PlayerTransport::kindToString(kind)
+                        << "for" << m_address;
+
+    m_transport = PlayerTransport::create(kind, this);
+    m_outbound.setDevice(m_transport->device());
+
+    connect(m_transport, &PlayerTransport::readyRead, this, &PlayerSession::readServer);
+    connect(m_transport, &PlayerTransport::errorOccurred, this, [this](const QString &message) {
+        qCInfo(lcTransport) << "player transport error" << m_address << message;
+    });
+
+    m_connection.setTransport(m_transport);
+}
+
+bool PlayerSession::isConnected() const
+{
+    return m_connected;
+}
+
+ConnectionStateMachine::State PlayerSession::connectionState() const
+{
+    return m_connection.state();
+}
+
+unsigned int PlayerSession::volume() const
+{
+    return m_volume;
+}
+
+bool PlayerSession::playing() const
+{
+    return m_playing;
+}
+
+bool PlayerSession::speakerConnected() const
+{
+    return m_speakerConnected;
+}
+
+qreal PlayerSession::roundTripTime() const
+{
+    return m_commands.roundTripTime();
+}
+
+QVariantMap PlayerSession::latencyStats() const
+{
+    return m_commands.latencyStats();
+}
+
+bool PlayerSession::isClockSynchronized() const
+{
+    return m_timeSync && m_clock.isSynchronized();
+}
+
+const ClockEstimator &PlayerSession::clock() const
+{
+    return m_clock;
+}
+
+int PlayerSession::volumeSendInterval() const
+{
+    return m_volControlTimer.interval();
+}
+
+void PlayerSession::setVolumeSendInterval(int interval)
+{
+    m_volControlTimer.setInterval(qMax(0, interval));
+}
+
+bool PlayerSession::ramping() const
+{
+    return m_ramping;
+}
+
+unsigned int PlayerSession::rampTarget() const
+{
+    return m_rampTo;
+}
+
+int PlayerSession::rampRemaining() const
+{
+    if (!m_ramping)
+        return 0;
+
+    const qint64 left = m_rampDuration - (ClockEstimator::now() - m_rampStart);
+    return int(qMax<qint64>(0, left + 999) / 1000);
+}
+
+bool PlayerSession::sleepTimerActive() const
+{
+    return m_ramping && m_rampSleepTimer;
+}
+
+BulkUpload *PlayerSession::upload() const
+{
+    return m_upload;
+}
+
+QVariantMap PlayerSession::toVariantMap() const
+{
+    QVariantMap result;
+    result.insert(QStringLiteral("address"), m_address);
+    result.insert(QStringLiteral("name"), m_name);
+    result.insert(QStringLiteral("connectionState"), ConnectionStateMachine::stateName(m_connection.state()));
+    result.insert(QStringLiteral("connected"), m_connected);
+    result.insert(QStringLiteral("playing"), m_playing);
+    result.insert(QStringLiteral("volume"), m_volume);
+    result.insert(QStringLiteral("speakerConnected"), m_speakerConnected);
+    result.insert(QStringLiteral("queuedCommands"), m_offline.size());
+    result.insert(QStringLiteral("ramping"), m_ramping);
+    if (m_ramping) {
+        result.insert(QStringLiteral("rampTarget"), m_rampTo);
+        result.insert(QStringLiteral("rampRemaining"), rampRemaining());
+        result.insert(QStringLiteral("sleepTimer"), sleepTimerActive());
+        result.insert(QStringLiteral("rampOnPlayer"), m_rampOnPlayer);
+    }
+    if (m_upload)
+        result.insert(QStringLiteral("upload"), m_upload->toVariantMap());
+    result.insert(QStringLiteral("clockSynchronized"), isClockSynchronized());
+    if (isClockSynchronized()) {
+        result.insert(QStringLiteral("clockOffset"), qreal(m_clock.offset()) / 1000);
+        result.insert(QStringLiteral("clockDrift"), m_clock.drift());
+        result.insert(QStringLiteral("clockDelay"), qreal(m_clock.delay()) / 1000);
+    }
+    return result;
+}
+
+void PlayerSession::open()
+{
+    m_connection.start();
+}
+
+void PlayerSession::close()
+{
+    m_connection.stop();
+    m_offline.clear();
+    clearRamp();
+    cancelUpload();
+}
+
+void PlayerSession::connectNow()
+{
+    m_connection.connectNow();
+}
+
+void PlayerSession::readServer()
+{
+    QIODevice *socket = m_transport->device();
+
+    // Lines are parsed in place in m_readBuffer, which keeps its capacity
+    // between reads so steady traffic doesn't allocate per line.
+    const int buffered = m_readBuffer.size();
+    const qint64 available = socket->bytesAvailable();
+    if (available <= 0)
+        return;
+
+    m_readBuffer.resize(buffered + static_cast<int>(available));
+    const qint64 read = socket->read(m_readBuffer.data() + buffered, available);
+    m_readBuffer.resize(buffered + static_cast<int>(qMax<qint64>(read, 0)));
+    TRACE(Transport, BytesRead, read, buffered);
+    m_metrics->recordBytesReceived(read);
+
+    const std::size_t consumed = ProtocolParser::parse(m_readBuffer.constData(),
+                                                       static_cast<std::size_t>(m_readBuffer.size()),
+                                                       *this);
+    m_readBuffer.remove(0, static_cast<int>(consumed));
+
+    if (m_readBuffer.size() > MAX_LINE_LENGTH) {
+        TRACE(Protocol, LineDropped, m_readBuffer.size(), 0);
+        qCInfo(lcProtocol) << "dropping overlong line from player";
+        m_readBuffer.clear();
+    }
+}
+
+void PlayerSession::onHello(unsigned int version, std::uint32_t capabilities)
+{
+    m_metrics->recordMessageReceived(ProtocolOpcode::Hello);
+    qCInfo(lcProtocol) << "player" << m_address << "speaks protocol version"
+                       << version;
+    m_outbound.setBinaryFraming(version >= 2 && (capabilities & CapBinaryFraming));
+    m_commands.setEnabled(version >= 2 && (capabilities & CapAcknowledge));
+
+    // Catch up with whatever happened while disconnected in one round trip
+    // rather than waiting for the player to mention it
+    m_stateVersions = version >= 2 && (capabilities & CapStateVersion) && (capabilities & CapAcknowledge);
+    m_stateVersion = 0;
+    if (m_stateVersions)
+        requestState(0);
+
+    m_timeSync = version >= 2 && (capabilities & CapTimeSync);
+    if (m_timeSync) {
+        m_clock.reset();
+        m_timeSyncBurst = TimeSyncBurstSize;
+        sendTimeRequest();
+    }
+
+    // Chunks are raw bytes, they need frames
+    m_bulkTransfer = version >= 2 && (capabilities & CapBulkTransfer) && m_outbound.binaryFraming();
+    if (m_upload && !m_upload->isFinished()) {
+        if (m_bulkTransfer)
+            m_upload->begin();
+        else
+            m_upload->fail(tr("The player doesn't take uploads"));
+    }
+
+    // A ramp driven from here until now is handed over
+    m_volumeRamps = version >= 2 && (capabilities & CapVolumeRamp);
+    if (m_ramping && !m_rampOnPlayer && m_volumeRamps) {
+        sendRamp();
+        emit rampChanged();
+    }
+}
+
+void PlayerSession::onSpeakerDiscovered(std::uint64_t address, std::string_view name)
+{
+    m_metrics->recordMessageReceived(ProtocolOpcode::BtDevice);
+    emit speakerDiscovered(address, QString::fromUtf8(name.data(), static_cast<int>(name.size())));
+}
+
+void PlayerSession::onSpeakerConnected(std::uint64_t address)
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::ConnectedSpeaker, address);
+    m_metrics->recordMessageReceived(ProtocolOpcode::ConnectedSpeaker);
+    qCDebug(lcProtocol) << "player reported speaker connected"
+                        << QBluetoothAddress(address).toString();
+    m_speakerConnected = true;
+    emit speakerConnectedChanged();
+}
+
+void PlayerSession::onSpeakerDisconnected()
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::DisconnectedSpeaker, 0);
+    m_metrics->recordMessageReceived(ProtocolOpcode::DisconnectedSpeaker);
+    qCDebug(lcProtocol) << "player reported speaker disconnected";
+    m_speakerConnected = false;
+    emit speakerConnectedChanged();
+}
+
+void PlayerSession::onVolume(unsigned int volume)
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::Volume, volume);
+    m_metrics->recordMessageReceived(ProtocolOpcode::Volume);
+    m_playerVolume = volume;
+    emit stateReceived();
+
+    // Ends a ramp the player ran, or says someone else ended it
+    if (m_ramping && m_rampOnPlayer)
+        clearRamp();
+
+    // Echoes of values sent earlier in a slider drag would make the
+    // slider jump back, only take the player's value once the stream is idle
+    if (m_volumePending || m_volumeInFlight || m_volControlTimer.isActive())
+        return;
+
+    m_volume = volume;
+    emit volumeChanged();
+}
+
+void PlayerSession::onPlaying()
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::Playing, 0);
+    m_metrics->recordMessageReceived(ProtocolOpcode::Playing);
+    emit stateReceived();
+    qCDebug(lcProtocol) << "player reported playing";
+    m_playing = true;
+    emit playingChanged();
+}
+
+void PlayerSession::onStopped()
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::Stopped, 0);
+    m_metrics->recordMessageReceived(ProtocolOpcode::Stopped);
+    emit stateReceived();
+    qCDebug(lcProtocol) << "player reported stopped";
+    m_playing = false;
+    emit playingChanged();
+}
+
+void PlayerSession::onAck(std::uint64_t sequence, std::uint32_t status)
+{
+    m_metrics->recordMessageReceived(ProtocolOpcode::Ack);
+    m_commands.acknowledge(sequence, status);
+}
+
+void PlayerSession::onTimeReply(std::uint64_t origin, std::uint64_t receive, std::uint64_t transmit)
+{
+    const qint64 arrived = ClockEstimator::now();
+    m_metrics->recordMessageReceived(ProtocolOpcode::TimeReply);
+
+    if (!m_timeSync)
+        return;
+
+    const bool wasSynchronized = m_clock.isSynchronized();
+    if (!m_clock.addSample(qint64(origin), qint64(receive), qint64(transmit), arrived)) {
+        qCDebug(lcProtocol) << "dropping inconsistent clock sample from" << m_address;
+        return;
+    }
+
+    TRACE(Protocol, ClockSampled, arrived - qint64(origin), m_clock.offset());
+    if (!wasSynchronized && m_clock.isSynchronized())
+        qCInfo(lcProtocol) << "clock of" << m_address << "is offset by"
+                           << m_clock.offset() << "usec, round trip" << m_clock.delay() << "usec";
+    emit clockChanged();
+}
+
+void PlayerSession::onState(std::uint64_t version, unsigned int volume, bool playing, std::uint64_t speakerAddress)
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::State, version);
+    m_metrics->recordMessageReceived(ProtocolOpcode::State);
+    emit stateReceived();
+    qCDebug(lcProtocol) << "player state" << version << "volume" << volume
+                        << "playing" << playing << "speaker" << QBluetoothAddress(speakerAddress).toString();
+
+    m_stateVersion = version;
+
+    // A RAMPING follows if a ramp is still running
+    if (m_ramping && m_rampOnPlayer)
+        clearRamp();
+
+    if (m_playing != playing) {
+        m_playing = playing;
+        emit playingChanged();
+    }
+
+    const bool speakerConnected = speakerAddress != 0;
+    if (m_speakerConnected != speakerConnected) {
+        m_speakerConnected = speakerConnected;
+        emit speakerConnectedChanged();
+    }
+
+    // Same rule as VOL: a slider drag in progress wins
+    m_playerVolume = volume;
+    if (!m_volumePending && !m_volumeInFlight && !m_volControlTimer.isActive() && m_volume != volume) {
+        m_volume = volume;
+        emit volumeChanged();
+    }
+}
+
+void PlayerSession::onUploadAck(std::uint64_t offset, std::uint32_t status)
+{
+    m_metrics->recordMessageReceived(ProtocolOpcode::UploadAck);
+    if (m_upload)
+        m_upload->acknowledge(offset, status);
+}
+
+void PlayerSession::onRamping(unsigned int volume, std::uint32_t flags, std::uint64_t remaining)
+{
+    TRACE(Protocol, MessageReceived, ProtocolOpcode::Ramping, volume);
+    m_metrics->recordMessageReceived(ProtocolOpcode::Ramping);
+    qCDebug(lcProtocol) << "player ramping to" << volume << "in" << remaining / 1000 << "ms";
+
+    const qint64 now = ClockEstimator::now();
+    const qint64 left = qint64(qMin<std::uint64_t>(remaining, std::uint64_t(MaxRampDuration) * 1000));
+
+    // Our own RAMP coming back: only the end may move, the curve so far is
+    // already on screen
+    if (m_ramping && m_rampOnPlayer && m_rampTo == qMin(volume, 100U) && m_rampFlags == flags) {
+        m_rampDuration = now - m_rampStart + left;
+        return;
+    }
+
+    // Only shown from here, the player's VOL at the end settles it
+    if (!(m_ramping && (flags & RampStopAtEnd) && (m_rampFlags & RampStopAtEnd)))
+        m_rampRestore = m_volume;
+    m_ramping = true;
+    m_rampOnPlayer = true;
+    m_rampSleepTimer = flags & RampStopAtEnd;
+    m_rampFrom = m_volume;
+    m_rampTo = qMin(volume, 100U);
+    m_rampFlags = flags;
+    m_rampStart = now;
+    m_rampDuration = left;
+    m_rampTimer.start();
+    emit rampChanged();
+}
+
+void PlayerSession::onStateVersion(std::uint64_t version)
+{
+    if (!m_stateVersions)
+        return;
+
+    // Replayed events are at or below what was already seen. The event that
+    // revealed a gap is applied already; the replay ends with it again, so
+    // the state ends up current either way.
+    if (m_stateVersion && version > m_stateVersion + 1) {
+        qCInfo(lcProtocol) << "missed player state" << m_stateVersion + 1 << "to" << version - 1;
+        requestState(m_stateVersion);
+    }
+
+    m_stateVersion = qMax(m_stateVersion, version);
+}
+
+void PlayerSession::onMessageBytes(ProtocolOpcode opcode, std::size_t bytes)
+{
+    m_metrics->recordMessageBytes(opcode, qint64(bytes));
+}
+
+void PlayerSession::onUnrecognized(std::string_view line)
+{
+    m_metrics->recordUnrecognized();
+    qCInfo(lcProtocol) << "unrecognized command"
+                       << QByteArray::fromRawData(line.data(), static_cast<int>(line.size()));
+}
+
+void PlayerSession::handleConnection()
+{
+    qCInfo(lcTransport) << "connected to player" << m_address;
+
+    // Offer binary framing; old players ignore this and stay on text
+    m_outbound.setBinaryFraming(false);
+    m_commands.setEnabled(false);
+    m_readBuffer.clear();
+    m_outbound.command(ProtocolOpcode::Hello).addUInt(PROTOCOL_VERSION).addUInt(CapBinaryFraming | CapAcknowledge | CapTimeSync | CapStateVersion | CapBulkTransfer | CapVolumeRamp).end();
+    m_metrics->recordCommandSent(ProtocolOpcode::Hello);
+
+    m_connected = true;
+    replayOfflineCommands();
+    emit connectedChanged();
+}
+
+void PlayerSession::handleDisconnection()
+{
+    qCInfo(lcTransport) << "disconnected from player" << m_address;
+    // Down first, so whatever is sent from here on goes to the offline
+    // queue rather than the dead link's buffer
+    m_connected = false;
+    m_volControlTimer.stop();
+    m_volumeInFlight = false;
+
+    // What the player may never have seen goes out again once it is back,
+    // and the UI keeps showing it. It may have been applied already, so a
+    // PLAY or STOP issued while away undoes it rather than cancelling out.
+    m_commands.handOver([this](const ProtocolMessage &message, CommandTracker::Rollback rollback) {
+        // The state is asked for afresh after the HELLO, and a ramp runs on
+        // as below
+        if (message.opcode == ProtocolOpcode::GetState
+                || (message.opcode == ProtocolOpcode::Ramp && !(message.flags & RampCancel)))
+            return;
+        m_offline.enqueue(message, std::move(rollback), true);
+    });
+    m_outbound.clear();
+    m_outbound.setBinaryFraming(false);
+    m_commands.setEnabled(false);
+    m_readBuffer.clear();
+    m_timeSyncTimer.stop();
+    m_timeSync = false;
+    m_clock.reset();
+    m_stateVersions = false;
+    m_stateVersion = 0;
+    m_stateRequested = false;
+    m_stateStale = false;
+    m_bulkTransfer = false;
+    if (m_upload)
+        m_upload->suspend();
+    // A ramp on the player runs on without us, one driven from here goes on
+    // into the offline queue
+    m_volumeRamps = false;
+    // A slider value held back behind the lost SET_VOL supersedes it
+    sendVolCmd();
+    emit connectedChanged();
+    emit clockChanged();
+}
+
+void PlayerSession::scan()
+{
+    qCInfo(lcUi) << "sending SCAN command";
+    sendCommand({ProtocolOpcode::Scan});
+}
+
+void PlayerSession::connectSpeaker(quint64 address)
+{
+    qCInfo(lcUi) << "sending request to connect to speaker"
+                 << QBluetoothAddress(address).toString();
+    sendCommand({ProtocolOpcode::ConnectSpeaker, address});
+}
+
+void PlayerSession::unpairSpeakers()
+{
+    qCInfo(lcUi) << "sending request to remove all speakers";
+    sendCommand({ProtocolOpcode::UnpairSpeaker});
+}
+
+bool PlayerSession::startUpload(const QString &fileName)
+{
+    cancelUpload();
+    if (m_upload)
+        m_upload->deleteLater();
+
+    m_upload = new BulkUpload(fileName, &m_outbound, this);
+    connect(m_upload, &BulkUpload::stateChanged, this, &PlayerSession::uploadChanged);
+    connect(m_upload, &BulkUpload::progressChanged, this, &PlayerSession::uploadChanged);
+
+    const bool opened = m_upload->open();
+    if (opened && m_bulkTransfer)
+        m_upload->begin();
+
+    emit uploadChanged();
+    return opened;
+}
+
+void PlayerSession::cancelUpload()
+{
+    if (m_upload)
+        m_upload->cancel();
+}
+
+void PlayerSession::sendCommand(const ProtocolMessage &message, CommandTracker::Rollback rollback)
+{
+    if (m_connected) {
+        m_commands.send(message, std::move(rollback));
+        return;
+    }
+
+    qCDebug(lcProtocol) << "player away, queueing command" << int(message.opcode);
+    m_offline.enqueue(message, std::move(rollback));
+}
+
+void PlayerSession::replayOfflineCommands()
+{
+    if (m_offline.isEmpty())
+        return;
+
+    // Right behind the HELLO, as text every player understands. They go out
+    // untracked, so their rollbacks are dropped; with state versions the
+    // snapshot asked for after the HELLO arrives after these took effect
+    // and corrects the UI if the player refused any of them.
+    const QList<ProtocolMessage> held = m_offline.take();
+    qCInfo(lcProtocol) << "replaying" << held.size() << "commands queued while away";
+    for (const ProtocolMessage &message : held)
+        m_commands.send(message);
+}
+
+CommandTracker::Rollback PlayerSession::rollbackPlaying()
+{
+    const bool wasPlaying = m_playing;
+    return [this, wasPlaying]() {
+        if (m_playing != wasPlaying) {
+            qCInfo(lcUi) << "play state change failed, restoring"
+                         << wasPlaying;
+            m_playing = wasPlaying;
+            emit playingChanged();
+        }
+    };
+}
+
+void PlayerSession::play()
+{
+    TRACE(Ui, PlayRequested, 0, 0);
+    sendCommand({ProtocolOpcode::Play}, rollbackPlaying());
+    m_playing = true;
+    emit playingChanged();
+}
+
+void PlayerSession::stop()
+{
+    TRACE(Ui, StopRequested, 0, 0);
+
+    // STOP ends a ramp on the player too, a sleep timer or fade out with
+    // the volume back where it was
+    const bool restore = m_ramping && (m_rampFlags & RampStopAtEnd) && (m_rampFlags & RampRestoreVolume);
+    const bool onPlayer = m_rampOnPlayer;
+    const unsigned int restoreVolume = m_rampRestore;
+    clearRamp();
+
+    sendCommand({ProtocolOpcode::Stop}, rollbackPlaying());
+    m_playing = false;
+    emit playingChanged();
+
+    if (restore) {
+        if (onPlayer) {
+            m_volume = restoreVolume;
+            emit volumeChanged();
+        } else {
+            applyVolume(restoreVolume);
+        }
+    }
+}
+
+void PlayerSession::playAt(qint64 localTime)
+{
+    if (!isClockSynchronized()) {
+        play();
+        return;
+    }
+
+    TRACE(Ui, PlayRequested, 0, localTime);
+
+    ProtocolMessage message{ProtocolOpcode::PlayAt};
+    message.times[0] = std::uint64_t(m_clock.toRemote(localTime));
+    sendCommand(message, rollbackPlaying());
+    m_playing = true;
+    emit playingChanged();
+}
+
+void PlayerSession::setVolumeAt(unsigned int volume, qint64 localTime)
+{
+    if (!isClockSynchronized()) {
+        setVolume(volume);
+        return;
+    }
+
+    TRACE(Ui, VolumeSet, volume, localTime);
+    clearRamp();
+
+    ProtocolMessage message{ProtocolOpcode::SetVolumeAt, 0, volume};
+    message.times[0] = std::uint64_t(m_clock.toRemote(localTime));
+    sendCommand(message, rollbackVolume(volume));
+    m_volume = volume;
+    emit volumeChanged();
+}
+
+void PlayerSession::setVolume(unsigned int volume)
+{
+    // SET_VOL ends a ramp on the player as well
+    clearRamp();
+    applyVolume(volume);
+}
+
+void PlayerSession::applyVolume(unsigned int volume)
+{
+    TRACE(Ui, VolumeSet, volume, 0);
+    m_volume = volume;
+    emit volumeChanged();
+
+    // Latest value wins: the first change goes out at once, while the slider
+    // keeps moving the newest value follows at most once per interval and
+    // not before the previous SET_VOL was acknowledged. Values in between
+    // are dropped, the last one is always sent.
+    m_volumePending = true;
+    if (!m_volControlTimer.isActive())
+        sendVolCmd();
+}
+
+void PlayerSession::sendVolCmd()
+{
+    if (!m_volumePending || m_volumeInFlight)
+        return;
+
+    TRACE(Ui, VolumeSent, m_volume, 0);
+
+    const unsigned int vol = m_volume;
+    m_volumePending = false;
+    m_volumeInFlight = m_commands.isEnabled();
+    m_volControlTimer.start();
+
+    sendCommand({ProtocolOpcode::SetVolume, 0, vol}, rollbackVolume(vol));
+}
+
+void PlayerSession::rampVolume(unsigned int volume, int duration, unsigned int curve)
+{
+    startRamp(volume, curve & RampCurveMask, qint64(qBound(0, duration, int(MaxRampDuration))) * 1000);
+}
+
+void PlayerSession::startSleepTimer(int duration)
+{
+    startRamp(0, RampPerceptual | RampStopAtEnd | RampRestoreVolume, qint64(qBound(0, duration, int(MaxRampDuration))) * 1000, true);
+}
+
+void PlayerSession::fadeOut(int duration)
+{
+    startRamp(0, RampPerceptual | RampStopAtEnd | RampRestoreVolume, qint64(qBound(0, duration, int(MaxRampDuration))) * 1000);
+}
+
+void PlayerSession::cancelRamp()
+{
+    if (!m_ramping)
+        return;
+
+    qCInfo(lcUi) << "canceling volume ramp";
+    const bool onPlayer = m_rampOnPlayer;
+    clearRamp();
+    // The volume stays where the ramp got to
+    if (onPlayer)
+        sendCommand({ProtocolOpcode::Ramp, 0, 0, RampCancel});
+}
+
+void PlayerSession::startRamp(unsigned int volume, std::uint32_t flags, qint64 duration, bool sleepTimer)
+{
+    TRACE(Ui, RampRequested, volume, duration);
+    qCInfo(lcUi) << "ramping volume from" << m_volume << "to" << volume << "in" << duration / 1000 << "ms";
+
+    // A slider value not yet sent would end the ramp on arrival
+    m_volumePending = false;
+
+    // Re-armed, a sleep timer fades on from here but still restores the
+    // volume the first one started from
+    if (!(m_ramping && (flags & RampStopAtEnd) && (m_rampFlags & RampStopAtEnd)))
+        m_rampRestore = m_volume;
+
+    m_ramping = true;
+    m_rampOnPlayer = false;
+    m_rampFrom = m_volume;
+    m_rampTo = qMin(volume, 100U);
+    m_rampFlags = flags;
+    m_rampSleepTimer = sleepTimer;
+    m_rampStart = ClockEstimator::now();
+    m_rampDuration = duration;
+    m_rampTimer.start();
+
+    // Otherwise driven from here, and handed over by onHello() if the
+    // player turns out to be able to run it
+    if (m_volumeRamps)
+        sendRamp();
+
+    emit rampChanged();
+    stepRamp();
+}
+
+void PlayerSession::sendRamp()
+{
+    // Not queued while away: the duration would be stale by the time it
+    // went out
+    const qint64 left = qMax<qint64>(0, m_rampDuration - (ClockEstimator::now() - m_rampStart));
+    ProtocolMessage message{ProtocolOpcode::Ramp, 0, m_rampTo, m_rampFlags};
+    message.times[0] = std::uint64_t(left);
+
+    m_rampOnPlayer = true;
+    const qint64 start = m_rampStart;
+    m_commands.send(message, [this, start]() {
+        if (m_ramping && m_rampStart == start) {
+            qCInfo(lcUi) << "volume ramp failed, restoring" << m_playerVolume;
+            clearRamp();
+            m_volume = m_playerVolume;
+            emit volumeChanged();
+        }
+    });
+}
+
+void PlayerSession::stepRamp()
+{
+    if (!m_ramping)
+        return;
+
+    const qint64 elapsed = ClockEstimator::now() - m_rampStart;
+    const unsigned int volume = protocolRampVolume(m_rampFrom, m_rampTo, m_rampFlags,
+                                                   std::uint64_t(qMax<qint64>(0, elapsed)),
+                                                   std::uint64_t(m_rampDuration));
+
+    // The player only needs to be told when it isn't running the ramp
+    const bool onPlayer = m_rampOnPlayer;
+    if (volume != m_volume) {
+        if (onPlayer) {
+            m_volume = volume;
+            emit volumeChanged();
+        } else {
+            applyVolume(volume);
+        }
+    }
+
+    if (elapsed < m_rampDuration)
+        return;
+
+    // Driven from here, the end is up to us; otherwise this is what the
+    // player's events are about to say
+    const std::uint32_t flags = m_rampFlags;
+    const unsigned int restoreVolume = m_rampRestore;
+    clearRamp();
+    if (!(flags & RampStopAtEnd))
+        return;
+
+    if (!onPlayer) {
+        stop();
+        if (flags & RampRestoreVolume)
+            applyVolume(restoreVolume);
+        return;
+    }
+
+    m_playing = false;
+    emit playingChanged();
+    if (flags & RampRestoreVolume) {
+        m_volume = restoreVolume;
+        emit volumeChanged();
+    }
+}
+
+void PlayerSession::clearRamp()
+{
+    if (!m_ramping)
+        return;
+
+    m_ramping = false;
+    m_rampOnPlayer = false;
+    m_rampTimer.stop();
+    emit rampChanged();
+}
+
+CommandTracker::Rollback PlayerSession::rollbackVolume(unsigned int volume)
+{
+    return [this, volume]() {
+        // Only undo if nothing newer has been asked for since
+        if (m_volume == volume && !m_volumePending && m_volume != m_playerVolume) {
+            qCInfo(lcUi) << "volume change failed, restoring"
+                         << m_playerVolume;
+            m_volume = m_playerVolume;
+            emit volumeChanged();
+        }
+    };
+}
+
+void PlayerSession::commandSettled(ProtocolOpcode opcode)
+{
+    if (opcode == ProtocolOpcode::GetState) {
+        m_stateRequested = false;
+        if (m_stateStale) {
+            m_stateStale = false;
+            requestState(0);
+        }
+        return;
+    }
+
+    if (opcode != ProtocolOpcode::SetVolume)
+        return;
+
+    m_volumeInFlight = false;
+    if (!m_volControlTimer.isActive())
+        sendVolCmd();
+}
+
+void PlayerSession::requestState(std::uint64_t since)
+{
+    if (m_stateRequested) {
+        m_stateStale = true;
+        return;
+    }
+
+    m_stateRequested = true;
+    m_commands.send({ProtocolOpcode::GetState, 0, since});
+}
+
+void PlayerSession::sendTimeRequest()
+{
+    if (!m_timeSync)
+        return;
+
+    // Written out right away rather than with the next batch, any time the
+    // ping spends queued here would count as link delay
+    m_outbound.command(ProtocolOpcode::TimeRequest).addUInt(std::uint64_t(ClockEstimator::now())).end();
+    m_outbound.flush();
+    m_metrics->recordCommandSent(ProtocolOpcode::TimeRequest);
+
+    if (m_timeSyncBurst > 0 && --m_timeSyncBurst > 0)
+        m_timeSyncTimer.start(TimeSyncBurstInterval);
+    else
+        m_timeSyncTimer.start(TimeSyncInterval);
+}
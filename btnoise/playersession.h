@@ -0,0 +1,229 @@
+#ifndef PLAYERSESSION_H
+#define PLAYERSESSION_H
+
+#include "playertransport.h"
+#include "protocol.h"
+#include "outboundbuffer.h"
+#include "commandtracker.h"
+#include "connectionstatemachine.h"
+#include "clockestimator.h"
+#include "offlinequeue.h"
+#include "bulkupload.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+class Metrics;
+
+// One connection to one player: transport, reconnects, protocol state and
+// the player's playback state as last known.
+class PlayerSession : public QObject, private PlayerEventHandler
+{
+    Q_OBJECT
+
+public:
+    // Volume updates per second while the slider moves: 1000 / interval
+    static const int DefaultVolumeSendInterval = 100;
+    // Clock pings: a quick burst after connecting, then a slow refresh
+    static const int TimeSyncBurstSize = 8;
+    static const int TimeSyncBurstInterval = 50;
+    static const int TimeSyncInterval = 5000;
+    // How often a running ramp moves the slider, and the SET_VOL rate when
+    // ramping for a player that can't
+    static const int RampStepInterval = 100;
+    // Longest ramp or sleep timer, in ms
+    static const int MaxRampDuration = 4 * 60 * 60 * 1000;
+
+    PlayerSession(const QString &address, const QString &name, PlayerTransport::Kind kind,
+                  Metrics *metrics, QObject *parent = nullptr);
+
+    QString address() const;
+    QString name() const;
+
+    PlayerTransport::Kind transportKind() const;
+    void setTransportKind(PlayerTransport::Kind kind);
+
+    bool isConnected() const;
+    ConnectionStateMachine::State connectionState() const;
+
+    unsigned int volume() const;
+    bool playing() const;
+    bool speakerConnected() const;
+    qreal roundTripTime() const;
+    QVariantMap latencyStats() const;
+
+    // True once the player's clock is known well enough for playAt()
+    bool isClockSynchronized() const;
+    const ClockEstimator &clock() const;
+
+    int volumeSendInterval() const;
+    void setVolumeSendInterval(int interval);
+
+    bool ramping() const;
+    unsigned int rampTarget() const;
+    // ms left of the running ramp
+    int rampRemaining() const;
+    // The running ramp is a sleep timer, rather than a fade out
+    bool sleepTimerActive() const;
+
+    // The current or last upload, null before the first
+    BulkUpload *upload() const;
+
+    // For QML lists of players
+    QVariantMap toVariantMap() const;
+
+public slots:
+    // Keeps the player connected until close()
+    void open();
+    void close();
+    void connectNow();
+
+    void play();
+    void stop();
+    void setVolume(unsigned int volume);
+    // localTime is on ClockEstimator::now(); without a synchronized clock
+    // these act at once
+    void playAt(qint64 localTime);
+    void setVolumeAt(unsigned int volume, qint64 localTime);
+    void scan();
+    void connectSpeaker(quint64 address);
+    void unpairSpeakers();
+
+    // Moves the volume to volume over duration ms, curve as in
+    // ProtocolRampFlags. The player runs the ramp on its own; one without
+    // CapVolumeRamp is sent a stream of SET_VOL from here instead.
+    void rampVolume(unsigned int volume, int duration, unsigned int curve = RampPerceptual);
+    // Fades out over duration ms and stops, with the volume back where it
+    // was for the next play
+    void startSleepTimer(int duration);
+    // The same fade and stop, but meant to end the listening now rather than
+    // at bedtime: not counted as a sleep timer
+    void fadeOut(int duration);
+    void cancelRamp();
+
+    // Replaces any earlier upload. Sent once the player is connected and
+    // takes uploads; false if the file can't be read.
+    bool startUpload(const QString &fileName);
+    void cancelUpload();
+
+signals:
+    void connectedChanged();
+    void connectionStateChanged();
+    void volumeChanged();
+    void playingChanged();
+    void speakerConnectedChanged();
+    void speakerDiscovered(quint64 address, const QString &name);
+    void roundTripTimeChanged();
+    void latencyStatsChanged();
+    void clockChanged();
+    // The player told us about its playback state: VOL, PLAYING, STOPPED or
+    // STATE
+    void stateReceived();
+    // A ramp started, ended or was replaced
+    void rampChanged();
+    // Upload replaced, progressed or changed state
+    void uploadChanged();
+
+private:
+    void readServer();
+    void handleConnection();
+    void handleDisconnection();
+    void sendVolCmd();
+    // setVolume() without ending a ramp
+    void applyVolume(unsigned int volume);
+    // duration in usec
+    void startRamp(unsigned int volume, std::uint32_t flags, qint64 duration, bool sleepTimer = false);
+    // Hands what is left of the ramp to the player
+    void sendRamp();
+    void stepRamp();
+    void clearRamp();
+    // Queues the command while the player is away
+    void sendCommand(const ProtocolMessage &message, CommandTracker::Rollback rollback = CommandTracker::Rollback());
+    void replayOfflineCommands();
+    void commandSettled(ProtocolOpcode opcode);
+    // since 0 asks for a full snapshot
+    void requestState(std::uint64_t since);
+    CommandTracker::Rollback rollbackPlaying();
+    CommandTracker::Rollback rollbackVolume(unsigned int volume);
+    void sendTimeRequest();
+
+    void onHello(unsigned int version, std::uint32_t capabilities) override;
+    void onSpeakerDiscovered(std::uint64_t address, std::string_view name) override;
+    void onSpeakerConnected(std::uint64_t address) override;
+    void onSpeakerDisconnected() override;
+    void onVolume(unsigned int volume) override;
+    void onPlaying() override;
+    void onStopped() override;
+    void onAck(std::uint64_t sequence, std::uint32_t status) override;
+    void onTimeReply(std::uint64_t origin, std::uint64_t receive, std::uint64_t transmit) override;
+    void onState(std::uint64_t version, unsigned int volume, bool playing, std::uint64_t speakerAddress) override;
+    void onUploadAck(std::uint64_t offset, std::uint32_t status) override;
+    void onRamping(unsigned int volume, std::uint32_t flags, std::uint64_t remaining) override;
+    void onStateVersion(std::uint64_t version) override;
+    void onUnrecognized(std::string_view line) override;
+    void onMessageBytes(ProtocolOpcode opcode, std::size_t bytes) override;
+
+    QString m_address;
+    QString m_name;
+    Metrics *m_metrics;
+
+    PlayerTransport *m_transport = nullptr;
+    ConnectionStateMachine m_connection;
+    QByteArray m_readBuffer;
+    OutboundBuffer m_outbound;
+    CommandTracker m_commands;
+    OfflineQueue m_offline;
+    QTimer m_volControlTimer;
+    ClockEstimator m_clock;
+    QTimer m_timeSyncTimer;
+    bool m_timeSync = false;
+    int m_timeSyncBurst = 0;
+
+    // The player numbers its state changes
+    bool m_stateVersions = false;
+    // Newest state version seen, 0 before the first
+    std::uint64_t m_stateVersion = 0;
+    // A GET_STATE is awaiting its ACK
+    bool m_stateRequested = false;
+    // A gap was seen while it was, fetch a snapshot once it settles
+    bool m_stateStale = false;
+
+    // The player runs RAMP on its own
+    bool m_volumeRamps = false;
+    bool m_ramping = false;
+    // The player was given the ramp, or started it itself. Otherwise it is
+    // driven from here with SET_VOL: the player can't ramp, or is away.
+    bool m_rampOnPlayer = false;
+    unsigned int m_rampFrom = 0;
+    unsigned int m_rampTo = 0;
+    // Volume a StopAtEnd ramp puts back, kept when another one replaces it
+    unsigned int m_rampRestore = 0;
+    // Started by startSleepTimer(). A StopAtEnd ramp from another controller
+    // counts as one too, a fade out looks the same on the wire.
+    bool m_rampSleepTimer = false;
+    std::uint32_t m_rampFlags = 0;
+    // On ClockEstimator::now(), usec
+    qint64 m_rampStart = 0;
+    qint64 m_rampDuration = 0;
+    QTimer m_rampTimer;
+
+    // The player takes uploads on this connection
+    bool m_bulkTransfer = false;
+    BulkUpload *m_upload = nullptr;
+
+    unsigned int m_volume = 0;
+    // Last volume the player reported, the rollback target for SET_VOL
+    unsigned int m_playerVolume = 0;
+    // A newer volume than the one last sent is waiting
+    bool m_volumePending = false;
+    // A SET_VOL is awaiting its ACK
+    bool m_volumeInFlight = false;
+    bool m_playing = false;
+    bool m_connected = false;
+    bool m_speakerConnected = false;
+};
+
+#endif // PLAYERSESSION_H
@@ -0,0 +1,248 @@
+#include "playersessionmanager.h"
+#include "trace.h"
+
+PlayerSessionManager::PlayerSessionManager(Metrics *metrics, QObject *parent) :
+    QObject(parent),
+    m_metrics(metrics)
+{
+    m_changedTimer.setInterval(0);
+    m_changedTimer.setSingleShot(true);
+    connect(&m_changedTimer, &QTimer::timeout, this, &PlayerSessionManager::changed);
+}
+
+PlayerTransport::Kind PlayerSessionManager::transportKind() const
+{
+    return m_transportKind;
+}
+
+void PlayerSessionManager::setTransportKind(PlayerTransport::Kind kind)
+{
+    m_transportKind = kind;
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->setTransportKind(kind);
+}
+
+int PlayerSessionManager::volumeSendInterval() const
+{
+    return m_volumeSendInterval;
+}
+
+void PlayerSessionManager::setVolumeSendInterval(int interval)
+{
+    m_volumeSendInterval = interval;
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->setVolumeSendInterval(interval);
+}
+
+PlayerSession *PlayerSessionManager::addSession(const QString &address, const QString &name)
+{
+    if (PlayerSession *existing = session(address))
+        return existing;
+
+    qCInfo(lcTransport) << "adding player session" << address;
+
+    auto *session = new PlayerSession(address, name, m_transportKind, m_metrics, this);
+    session->setVolumeSendInterval(m_volumeSendInterval);
+
+    connect(session, &PlayerSession::connectedChanged, this, &PlayerSessionManager::scheduleChanged);
+    connect(session, &PlayerSession::connectionStateChanged, this, &PlayerSessionManager::scheduleChanged);
+    connect(session, &PlayerSession::playingChanged, this, &PlayerSessionManager::scheduleChanged);
+    connect(session, &PlayerSession::volumeChanged, this, &PlayerSessionManager::scheduleChanged);
+    connect(session, &PlayerSession::speakerConnectedChanged, this, &PlayerSessionManager::scheduleChanged);
+    connect(session, &PlayerSession::clockChanged, this, &PlayerSessionManager::scheduleChanged);
+    connect(session, &PlayerSession::rampChanged, this, &PlayerSessionManager::scheduleChanged);
+
+    m_sessions.append(session);
+    emit sessionAdded(session);
+    scheduleChanged();
+    return session;
+}
+
+void PlayerSessionManager::removeSession(const QString &address)
+{
+    PlayerSession *removed = session(address);
+    if (!removed)
+        return;
+
+    qCInfo(lcTransport) << "removing player session" << address;
+
+    m_sessions.removeOne(removed);
+    removed->disconnect(this);
+    removed->close();
+    removed->deleteLater();
+
+    emit sessionRemoved(address);
+    scheduleChanged();
+}
+
+PlayerSession *PlayerSessionManager::session(const QString &address) const
+{
+    for (PlayerSession *session : m_sessions) {
+        if (session->address() == address)
+            return session;
+    }
+    return nullptr;
+}
+
+QList<PlayerSession *> PlayerSessionManager::sessions() const
+{
+    return m_sessions;
+}
+
+int PlayerSessionManager::count() const
+{
+    return m_sessions.size();
+}
+
+int PlayerSessionManager::connectedCount() const
+{
+    int connected = 0;
+    for (const PlayerSession *session : m_sessions) {
+        if (session->isConnected())
+            connected++;
+    }
+    return connected;
+}
+
+bool PlayerSessionManager::playing() const
+{
+    for (const PlayerSession *session : m_sessions) {
+        if (session->playing())
+            return true;
+    }
+    return false;
+}
+
+unsigned int PlayerSessionManager::volume() const
+{
+    unsigned int sum = 0;
+    int counted = 0;
+    const bool anyConnected = connectedCount() > 0;
+
+    for (const PlayerSession *session : m_sessions) {
+        if (anyConnected && !session->isConnected())
+            continue;
+        sum += session->volume();
+        counted++;
+    }
+
+    return counted ? (sum + counted / 2) / counted : 0;
+}
+
+bool PlayerSessionManager::ramping() const
+{
+    for (const PlayerSession *session : m_sessions) {
+        if (session->ramping())
+            return true;
+    }
+    return false;
+}
+
+int PlayerSessionManager::sleepTimerRemaining() const
+{
+    int remaining = 0;
+    for (const PlayerSession *session : m_sessions) {
+        if (session->sleepTimerActive())
+            remaining = qMax(remaining, session->rampRemaining());
+    }
+    return remaining;
+}
+
+QVariantList PlayerSessionManager::players() const
+{
+    QVariantList result;
+    for (const PlayerSession *session : m_sessions)
+        result.append(session->toVariantMap());
+    return result;
+}
+
+qint64 PlayerSessionManager::synchronizedStartTime() const
+{
+    qint64 slowest = 0;
+    int connected = 0;
+
+    for (const PlayerSession *session : m_sessions) {
+        if (!session->isConnected())
+            continue;
+        if (!session->isClockSynchronized())
+            return -1;
+        slowest = qMax(slowest, qint64(session->clock().delay()));
+        connected++;
+    }
+
+    if (!connected)
+        return -1;
+
+    // The command has to reach the slowest player before its start time
+    const qint64 lead = qMin<qint64>(slowest / 1000 + SyncStartMargin, MaxSyncStartDelay);
+    return ClockEstimator::now() + lead * 1000;
+}
+
+void PlayerSessionManager::play()
+{
+    const qint64 start = m_sessions.size() > 1 ? synchronizedStartTime() : -1;
+    if (start >= 0)
+        qCInfo(lcUi) << "starting" << connectedCount() << "players in"
+                     << (start - ClockEstimator::now()) / 1000 << "ms";
+
+    for (PlayerSession *session : qAsConst(m_sessions)) {
+        if (start >= 0 && session->isConnected())
+            session->playAt(start);
+        else
+            session->play();
+    }
+}
+
+void PlayerSessionManager::stop()
+{
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->stop();
+}
+
+void PlayerSessionManager::setVolume(unsigned int volume)
+{
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->setVolume(volume);
+}
+
+void PlayerSessionManager::setVolumeSynchronized(unsigned int volume)
+{
+    const qint64 at = synchronizedStartTime();
+
+    for (PlayerSession *session : qAsConst(m_sessions)) {
+        if (at >= 0 && session->isConnected())
+            session->setVolumeAt(volume, at);
+        else
+            session->setVolume(volume);
+    }
+}
+
+void PlayerSessionManager::rampVolume(unsigned int volume, int duration, unsigned int curve)
+{
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->rampVolume(volume, duration, curve);
+}
+
+void PlayerSessionManager::startSleepTimer(int duration)
+{
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->startSleepTimer(duration);
+}
+
+void PlayerSessionManager::fadeOut(int duration)
+{
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->fadeOut(duration);
+}
+
+void PlayerSessionManager::cancelRamp()
+{
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->cancelRamp();
+}
+
+void PlayerSessionManager::scheduleChanged()
+{
+    if (!m_changedTimer.isActive())
+        m_changedTimer.start();
+}
@@ -0,0 +1,96 @@
+#ifndef PLAYERSESSIONMANAGER_H
+#define PLAYERSESSIONMANAGER_H
+
+#include "playersession.h"
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QVariantList>
+
+class Metrics;
+
+// All players controlled together, one session each. Group commands go to
+// every session in the same event loop pass, each over its own link, so
+// three rooms cost one round trip instead of three reconnects.
+//
+// When every connected player has a synchronized clock, play() schedules a
+// common start with PLAY_AT instead, so the rooms don't start a round trip
+// apart.
+class PlayerSessionManager : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ count NOTIFY changed)
+    Q_PROPERTY(int connectedCount READ connectedCount NOTIFY changed)
+    Q_PROPERTY(bool playing READ playing NOTIFY changed)
+    Q_PROPERTY(unsigned int volume READ volume NOTIFY changed)
+    Q_PROPERTY(bool ramping READ ramping NOTIFY changed)
+    Q_PROPERTY(int sleepTimerRemaining READ sleepTimerRemaining NOTIFY changed)
+    Q_PROPERTY(QVariantList players READ players NOTIFY changed)
+
+public:
+    // Added to the slowest player's round trip when scheduling a common start
+    static const int SyncStartMargin = 100;
+    static const int MaxSyncStartDelay = 2000;
+
+    explicit PlayerSessionManager(Metrics *metrics, QObject *parent = nullptr);
+
+    PlayerTransport::Kind transportKind() const;
+    void setTransportKind(PlayerTransport::Kind kind);
+
+    int volumeSendInterval() const;
+    void setVolumeSendInterval(int interval);
+
+    // Returns the existing session for address if there is one
+    PlayerSession *addSession(const QString &address, const QString &name);
+    void removeSession(const QString &address);
+    PlayerSession *session(const QString &address) const;
+    QList<PlayerSession *> sessions() const;
+
+    int count() const;
+    int connectedCount() const;
+    // True if any player is playing
+    bool playing() const;
+    // Mean volume of the connected players, of all if none is connected
+    unsigned int volume() const;
+    // True if any player's volume is ramping
+    bool ramping() const;
+    // ms until the last sleep timer runs out, 0 without one. Not notified as
+    // it counts down.
+    int sleepTimerRemaining() const;
+    QVariantList players() const;
+
+    // ClockEstimator::now() time at which all connected players can act
+    // together, or -1 if not all of them can be scheduled
+    qint64 synchronizedStartTime() const;
+
+public slots:
+    void play();
+    void stop();
+    void setVolume(unsigned int volume);
+    // One SET_VOL_AT per player instead of a stream of SET_VOL, for
+    // discrete steps that should land everywhere at once
+    void setVolumeSynchronized(unsigned int volume);
+    // Each player runs the ramp on its own, see PlayerSession::rampVolume()
+    void rampVolume(unsigned int volume, int duration, unsigned int curve = RampPerceptual);
+    void startSleepTimer(int duration);
+    void fadeOut(int duration);
+    void cancelRamp();
+
+signals:
+    // Coalesced, at most once per event loop pass
+    void changed();
+    void sessionAdded(PlayerSession *session);
+    void sessionRemoved(const QString &address);
+
+private:
+    void scheduleChanged();
+
+    Metrics *m_metrics;
+    PlayerTransport::Kind m_transportKind = PlayerTransport::Rfcomm;
+    int m_volumeSendInterval = PlayerSession::DefaultVolumeSendInterval;
+    QList<PlayerSession *> m_sessions;
+    QTimer m_changedTimer;
+};
+
+#endif // PLAYERSESSIONMANAGER_H
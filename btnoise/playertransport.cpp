@@ -0,0 +1,51 @@
+#include "playertransport.h"
+#include "rfcommtransport.h"
+#include "tcptransport.h"
+#include "localtransport.h"
+
+PlayerTransport::PlayerTransport(QObject *parent) : QObject(parent)
+{
+}
+
+PlayerTransport *PlayerTransport::create(Kind kind, QObject *parent)
+{
+    switch (kind) {
+    case Tcp:
+        return new TcpTransport(parent);
+    case Local:
+        return new LocalTransport(parent);
+    case Rfcomm:
+    default:
+        return new RfcommTransport(parent);
+    }
+}
+
+PlayerTransport::Kind PlayerTransport::kindFromString(const QString &name, bool *ok)
+{
+    const QString kind = name.trimmed().toLower();
+
+    if (ok)
+        *ok = true;
+
+    if (kind == QLatin1String("tcp"))
+        return Tcp;
+    if (kind == QLatin1String("local"))
+        return Local;
+    if (kind != QLatin1String("rfcomm") && ok)
+        *ok = false;
+
+    return Rfcomm;
+}
+
+QString PlayerTransport::kindToString(Kind kind)
+{
+    switch (kind) {
+    case Tcp:
+        return QStringLiteral("tcp");
+    case Local:
+        return QStringLiteral("local");
+    case Rfcomm:
+    default:
+        return QStringLiteral("rfcomm");
+    }
+}
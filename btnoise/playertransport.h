@@ -0,0 +1,53 @@
+#ifndef PLAYERTRANSPORT_H
+#define PLAYERTRANSPORT_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QString>
+
+// Byte stream to a player. The RFCOMM backend talks to real players over
+// Bluetooth, the TCP and local socket backends reach players on the LAN or a
+// stand-in player on the same machine.
+class PlayerTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Kind {
+        Rfcomm,
+        Tcp,
+        Local
+    };
+    Q_ENUM(Kind)
+
+    enum State {
+        UnconnectedState,
+        ConnectingState,
+        ConnectedState,
+        ClosingState
+    };
+    Q_ENUM(State)
+
+    explicit PlayerTransport(QObject *parent = nullptr);
+
+    static PlayerTransport *create(Kind kind, QObject *parent = nullptr);
+    static Kind kindFromString(const QString &name, bool *ok = nullptr);
+    static QString kindToString(Kind kind);
+
+    virtual Kind kind() const = 0;
+    virtual State state() const = 0;
+    // Address format depends on the backend: a Bluetooth address for RFCOMM,
+    // "host[:port]" for TCP and a server name for local sockets.
+    virtual void connectToPlayer(const QString &address) = 0;
+    virtual void close() = 0;
+    // Readable/writable stream, valid for the lifetime of the transport.
+    virtual QIODevice *device() = 0;
+
+signals:
+    void connected();
+    void disconnected();
+    void readyRead();
+    void errorOccurred(const QString &message);
+};
+
+#endif // PLAYERTRANSPORT_H
@@ -0,0 +1,752 @@
+#include "protocol.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+enum class Field : std::uint8_t {
+    None,
+    Address,    // 6 raw bytes / XX:XX:XX:XX:XX:XX
+    Value,      // varint / decimal
+    Flags,      // varint / decimal
+    Time,       // varint / decimal, fills times[] in order
+    Text        // rest of frame / rest of line, always last
+};
+
+struct OpcodeSpec {
+    ProtocolOpcode opcode;
+    std::string_view name;
+    std::array<Field, 3> fields;
+};
+
+constexpr OpcodeSpec OPCODES[] = {
+    { ProtocolOpcode::Hello, "HELLO", { Field::Value, Field::Flags, Field::None } },
+    { ProtocolOpcode::Scan, "SCAN", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::ConnectSpeaker, "CONNECT", { Field::Address, Field::None, Field::None } },
+    { ProtocolOpcode::UnpairSpeaker, "UNPAIR_SPEAKER", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::Play, "PLAY", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::Stop, "STOP", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::SetVolume, "SET_VOL", { Field::Value, Field::None, Field::None } },
+    { ProtocolOpcode::TimeRequest, "TIME", { Field::Time, Field::None, Field::None } },
+    { ProtocolOpcode::PlayAt, "PLAY_AT", { Field::Time, Field::None, Field::None } },
+    { ProtocolOpcode::SetVolumeAt, "SET_VOL_AT", { Field::Value, Field::Time, Field::None } },
+    { ProtocolOpcode::GetState, "GET_STATE", { Field::Value, Field::None, Field::None } },
+    { ProtocolOpcode::Upload, "UPLOAD", { Field::Value, Field::Flags, Field::Text } },
+    { ProtocolOpcode::Chunk, "CHUNK", { Field::Value, Field::Flags, Field::Text } },
+    { ProtocolOpcode::Ramp, "RAMP", { Field::Value, Field::Flags, Field::Time } },
+    { ProtocolOpcode::BtDevice, "BT_DEVICE", { Field::Address, Field::Text, Field::None } },
+    { ProtocolOpcode::ConnectedSpeaker, "CONNECTED_SPEAKER", { Field::Address, Field::None, Field::None } },
+    { ProtocolOpcode::DisconnectedSpeaker, "DISCONNECTED_SPEAKER", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::Volume, "VOL", { Field::Value, Field::None, Field::None } },
+    { ProtocolOpcode::Playing, "PLAYING", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::Stopped, "STOPPED", { Field::None, Field::None, Field::None } },
+    { ProtocolOpcode::Ack, "ACK", { Field::Value, Field::Flags, Field::None } },
+    { ProtocolOpcode::TimeReply, "TIME_REPLY", { Field::Time, Field::Time, Field::Time } },
+    { ProtocolOpcode::State, "STATE", { Field::Value, Field::Flags, Field::Address } },
+    { ProtocolOpcode::UploadAck, "UPLOAD_ACK", { Field::Value, Field::Flags, Field::None } },
+    { ProtocolOpcode::Ramping, "RAMPING", { Field::Value, Field::Flags, Field::Time } }
+};
+
+const OpcodeSpec *findSpec(ProtocolOpcode opcode)
+{
+    for (const auto &spec : OPCODES) {
+        if (spec.opcode == opcode)
+            return &spec;
+    }
+    return nullptr;
+}
+
+// FNV-1a, evaluated at compile time for the case labels in opcodeFromName.
+// Duplicate hashes among known commands would fail to compile.
+constexpr std::uint32_t nameHash(std::string_view name)
+{
+    std::uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::string_view trimmed(std::string_view text)
+{
+    const char *ws = " \t\r\n";
+    const auto first = text.find_first_not_of(ws);
+    if (first == std::string_view::npos)
+        return std::string_view();
+    return text.substr(first, text.find_last_not_of(ws) - first + 1);
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Time fields take the times[] slots in the order they appear in the schema
+std::uint64_t *numericSlot(ProtocolMessage &message, Field field, std::size_t &timeIndex)
+{
+    if (field == Field::Time)
+        return &message.times[timeIndex++];
+    return field == Field::Flags ? &message.flags : &message.value;
+}
+
+std::uint64_t numericSlot(const ProtocolMessage &message, Field field, std::size_t &timeIndex)
+{
+    if (field == Field::Time)
+        return message.times[timeIndex++];
+    return field == Field::Flags ? message.flags : message.value;
+}
+
+void appendDecimal(std::uint64_t value, std::string &out)
+{
+    char digits[20];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, static_cast<std::size_t>(result.ptr - digits));
+}
+
+void appendAddressText(std::uint64_t address, std::string &out)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+
+    for (int shift = 40; shift >= 0; shift -= 8) {
+        const unsigned int byte = (address >> shift) & 0xFF;
+        out += HEX[byte >> 4];
+        out += HEX[byte & 0xF];
+        if (shift)
+            out += ':';
+    }
+}
+
+// Text: an optional "#<n>" right after the schema fields, anything after it
+// is ignored like any other surplus argument
+bool decodeSequence(const ProtocolLine &line, std::size_t index, ProtocolMessage &message)
+{
+    const std::string_view arg = line.arg(index);
+    if (arg.size() < 2 || arg[0] != '#')
+        return true;
+
+    const auto result = std::from_chars(arg.data() + 1, arg.data() + arg.size(), message.sequence);
+    return result.ec == std::errc() && result.ptr == arg.data() + arg.size();
+}
+
+// Frames: an optional varint ending the frame
+bool decodeSequence(const char *cursor, const char *end, ProtocolMessage &message)
+{
+    if (cursor == end)
+        return true;
+
+    const std::size_t used = ProtocolParser::readVarint(cursor, static_cast<std::size_t>(end - cursor), message.sequence);
+    return used && cursor + used == end;
+}
+
+bool fitsUInt(std::uint64_t value)
+{
+    return value <= std::numeric_limits<unsigned int>::max();
+}
+
+void deliver(const ProtocolMessage &message, std::string_view raw, PlayerEventHandler &handler)
+{
+    bool handled = true;
+
+    switch (message.opcode) {
+    case ProtocolOpcode::Hello:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onHello(static_cast<unsigned int>(message.value), static_cast<std::uint32_t>(message.flags));
+        break;
+    case ProtocolOpcode::BtDevice:
+        handler.onSpeakerDiscovered(message.address, message.text);
+        break;
+    case ProtocolOpcode::ConnectedSpeaker:
+        handler.onSpeakerConnected(message.address);
+        break;
+    case ProtocolOpcode::DisconnectedSpeaker:
+        handler.onSpeakerDisconnected();
+        break;
+    case ProtocolOpcode::Volume:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onVolume(static_cast<unsigned int>(message.value));
+        break;
+    case ProtocolOpcode::Playing:
+        handler.onPlaying();
+        break;
+    case ProtocolOpcode::Stopped:
+        handler.onStopped();
+        break;
+    case ProtocolOpcode::Ack:
+        handler.onAck(message.value, static_cast<std::uint32_t>(message.flags));
+        break;
+    case ProtocolOpcode::TimeReply:
+        handler.onTimeReply(message.times[0], message.times[1], message.times[2]);
+        break;
+    case ProtocolOpcode::State:
+        handler.onState(message.value,
+                        static_cast<unsigned int>((message.flags & StateVolumeMask) >> StateVolumeShift),
+                        message.flags & StatePlaying,
+                        message.address);
+        break;
+    case ProtocolOpcode::UploadAck:
+        handler.onUploadAck(message.value, static_cast<std::uint32_t>(message.flags));
+        break;
+    case ProtocolOpcode::Ramping:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onRamping(static_cast<unsigned int>(message.value), static_cast<std::uint32_t>(message.flags),
+                          message.times[0]);
+        break;
+    default:
+        handled = false;
+        break;
+    }
+
+    if (!handled)
+        handler.onUnrecognized(raw);
+    else if (message.sequence)
+        handler.onStateVersion(message.sequence);
+}
+
+void deliver(const ProtocolMessage &message, std::string_view raw, PlayerCommandHandler &handler)
+{
+    bool handled = true;
+
+    switch (message.opcode) {
+    case ProtocolOpcode::Hello:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onHello(static_cast<unsigned int>(message.value), static_cast<std::uint32_t>(message.flags));
+        break;
+    case ProtocolOpcode::Scan:
+        handler.onScan();
+        break;
+    case ProtocolOpcode::ConnectSpeaker:
+        handler.onConnectSpeaker(message.address);
+        break;
+    case ProtocolOpcode::UnpairSpeaker:
+        handler.onUnpairSpeaker();
+        break;
+    case ProtocolOpcode::Play:
+        handler.onPlay();
+        break;
+    case ProtocolOpcode::Stop:
+        handler.onStop();
+        break;
+    case ProtocolOpcode::SetVolume:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onSetVolume(static_cast<unsigned int>(message.value));
+        break;
+    case ProtocolOpcode::TimeRequest:
+        handler.onTimeRequest(message.times[0]);
+        break;
+    case ProtocolOpcode::PlayAt:
+        handler.onPlayAt(message.times[0]);
+        break;
+    case ProtocolOpcode::SetVolumeAt:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onSetVolumeAt(static_cast<unsigned int>(message.value), message.times[0]);
+        break;
+    case ProtocolOpcode::GetState:
+        handler.onGetState(message.value);
+        break;
+    case ProtocolOpcode::Upload:
+        handler.onUpload(message.value, static_cast<std::uint32_t>(message.flags), message.text);
+        break;
+    case ProtocolOpcode::Chunk:
+        handler.onChunk(message.value, static_cast<std::uint32_t>(message.flags), message.text);
+        break;
+    case ProtocolOpcode::Ramp:
+        if (!fitsUInt(message.value)) {
+            handled = false;
+            break;
+        }
+        handler.onRamp(static_cast<unsigned int>(message.value), static_cast<std::uint32_t>(message.flags),
+                       message.times[0]);
+        break;
+    default:
+        handled = false;
+        break;
+    }
+
+    if (!handled)
+        handler.onUnrecognized(raw);
+    if (message.sequence)
+        handler.onSequenced(message.sequence, handled);
+}
+
+template<typename Handler>
+std::size_t parseStream(const char *data, std::size_t size, Handler &handler)
+{
+    std::size_t consumed = 0;
+    ProtocolMessage message;
+
+    while (consumed < size) {
+        const char *begin = data + consumed;
+        const std::size_t remaining = size - consumed;
+
+        if (static_cast<unsigned char>(*begin) == FRAME_MARKER) {
+            std::uint64_t length = 0;
+            const std::size_t prefix = ProtocolParser::readVarint(begin + 1, remaining - 1, length);
+            if (!prefix && remaining - 1 < 10)
+                break;
+
+            if (!prefix || length == 0 || length > MAX_FRAME_SIZE) {
+                // Corrupt header, drop the marker and resynchronize
+                handler.onUnrecognized(std::string_view(begin, 1));
+                consumed += 1;
+                continue;
+            }
+
+            if (remaining - 1 - prefix < length)
+                break;
+
+            const std::string_view frame(begin + 1 + prefix, static_cast<std::size_t>(length));
+            const std::size_t frameSize = 1 + prefix + static_cast<std::size_t>(length);
+            if (ProtocolParser::decodeFrame(frame, message)) {
+                handler.onMessageBytes(message.opcode, frameSize);
+                deliver(message, frame, handler);
+            } else {
+                handler.onUnrecognized(frame);
+            }
+
+            consumed += frameSize;
+            continue;
+        }
+
+        const void *newline = std::memchr(begin, '\n', remaining);
+        if (!newline)
+            break;
+
+        const std::string_view line(begin, static_cast<std::size_t>(static_cast<const char *>(newline) - begin));
+        if (ProtocolParser::decodeLine(line, message)) {
+            handler.onMessageBytes(message.opcode, line.size() + 1);
+            deliver(message, trimmed(line), handler);
+        } else if (!trimmed(line).empty()) {
+            handler.onUnrecognized(trimmed(line));
+        }
+
+        consumed += line.size() + 1;
+    }
+
+    return consumed;
+}
+
+}
+
+bool ProtocolLine::parse(std::string_view line)
+{
+    m_line = trimmed(line);
+    m_count = 0;
+
+    if (m_line.empty())
+        return false;
+
+    std::size_t start = 0;
+    while (m_count < MaxFields) {
+        const std::size_t end = m_line.find(',', start);
+        m_fields[m_count++] = m_line.substr(start, end == std::string_view::npos ? end : end - start);
+        if (end == std::string_view::npos)
+            break;
+        start = end + 1;
+    }
+
+    return true;
+}
+
+std::string_view ProtocolLine::arg(std::size_t i) const
+{
+    return i + 1 < m_count ? m_fields[i + 1] : std::string_view();
+}
+
+std::string_view ProtocolLine::argTail(std::size_t i) const
+{
+    if (i + 1 >= m_count)
+        return std::string_view();
+    return m_line.substr(static_cast<std::size_t>(m_fields[i + 1].data() - m_line.data()));
+}
+
+bool ProtocolLine::uintArg(std::size_t i, std::uint64_t &value) const
+{
+    const std::string_view text = arg(i);
+    if (text.empty())
+        return false;
+
+    const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool ProtocolLine::addressArg(std::size_t i, std::uint64_t &address) const
+{
+    return ProtocolParser::parseAddress(arg(i), address);
+}
+
+std::size_t ProtocolParser::parse(const char *data, std::size_t size, PlayerEventHandler &handler)
+{
+    return parseStream(data, size, handler);
+}
+
+std::size_t ProtocolParser::parse(const char *data, std::size_t size, PlayerCommandHandler &handler)
+{
+    return parseStream(data, size, handler);
+}
+
+std::uint32_t protocolChecksum(const char *data, std::size_t size, std::uint32_t crc)
+{
+    static const auto table = []() {
+        std::array<std::uint32_t, 256> result{};
+        for (std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            result[i] = value;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++)
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+unsigned int protocolRampVolume(unsigned int from, unsigned int to, std::uint32_t flags,
+                                std::uint64_t elapsed, std::uint64_t duration)
+{
+    if (elapsed >= duration)
+        return to;
+
+    double t = double(elapsed) / double(duration);
+    double a = from;
+    double b = to;
+
+    switch (flags & RampCurveMask) {
+    case RampPerceptual:
+        // Loudness goes roughly with the cube root of the level
+        a = std::cbrt(a);
+        b = std::cbrt(b);
+        break;
+    case RampSmooth:
+        t = t * t * (3 - 2 * t);
+        break;
+    default:
+        break;
+    }
+
+    double level = a + (b - a) * t;
+    if ((flags & RampCurveMask) == RampPerceptual)
+        level = level * level * level;
+    return static_cast<unsigned int>(std::lround(level));
+}
+
+ProtocolOpcode ProtocolParser::opcodeFromName(std::string_view name)
+{
+    ProtocolOpcode opcode = ProtocolOpcode::Invalid;
+
+    switch (nameHash(name)) {
+    case nameHash("HELLO"): opcode = ProtocolOpcode::Hello; break;
+    case nameHash("SCAN"): opcode = ProtocolOpcode::Scan; break;
+    case nameHash("CONNECT"): opcode = ProtocolOpcode::ConnectSpeaker; break;
+    case nameHash("UNPAIR_SPEAKER"): opcode = ProtocolOpcode::UnpairSpeaker; break;
+    case nameHash("PLAY"): opcode = ProtocolOpcode::Play; break;
+    case nameHash("STOP"): opcode = ProtocolOpcode::Stop; break;
+    case nameHash("SET_VOL"): opcode = ProtocolOpcode::SetVolume; break;
+    case nameHash("TIME"): opcode = ProtocolOpcode::TimeRequest; break;
+    case nameHash("PLAY_AT"): opcode = ProtocolOpcode::PlayAt; break;
+    case nameHash("SET_VOL_AT"): opcode = ProtocolOpcode::SetVolumeAt; break;
+    case nameHash("GET_STATE"): opcode = ProtocolOpcode::GetState; break;
+    case nameHash("UPLOAD"): opcode = ProtocolOpcode::Upload; break;
+    case nameHash("CHUNK"): opcode = ProtocolOpcode::Chunk; break;
+    case nameHash("RAMP"): opcode = ProtocolOpcode::Ramp; break;
+    case nameHash("BT_DEVICE"): opcode = ProtocolOpcode::BtDevice; break;
+    case nameHash("CONNECTED_SPEAKER"): opcode = ProtocolOpcode::ConnectedSpeaker; break;
+    case nameHash("DISCONNECTED_SPEAKER"): opcode = ProtocolOpcode::DisconnectedSpeaker; break;
+    case nameHash("VOL"): opcode = ProtocolOpcode::Volume; break;
+    case nameHash("PLAYING"): opcode = ProtocolOpcode::Playing; break;
+    case nameHash("STOPPED"): opcode = ProtocolOpcode::Stopped; break;
+    case nameHash("ACK"): opcode = ProtocolOpcode::Ack; break;
+    case nameHash("TIME_REPLY"): opcode = ProtocolOpcode::TimeReply; break;
+    case nameHash("STATE"): opcode = ProtocolOpcode::State; break;
+    case nameHash("UPLOAD_ACK"): opcode = ProtocolOpcode::UploadAck; break;
+    case nameHash("RAMPING"): opcode = ProtocolOpcode::Ramping; break;
+    default: return ProtocolOpcode::Invalid;
+    }
+
+    // The hash only picks the candidate, unknown names may collide with it
+    return opcodeName(opcode) == name ? opcode : ProtocolOpcode::Invalid;
+}
+
+std::string_view ProtocolParser::opcodeName(ProtocolOpcode opcode)
+{
+    const OpcodeSpec *spec = findSpec(opcode);
+    return spec ? spec->name : std::string_view();
+}
+
+bool ProtocolParser::decodeLine(std::string_view text, ProtocolMessage &message)
+{
+    ProtocolLine line;
+    if (!line.parse(text))
+        return false;
+
+    const OpcodeSpec *spec = findSpec(opcodeFromName(line.command()));
+    if (!spec)
+        return false;
+
+    message = ProtocolMessage();
+    message.opcode = spec->opcode;
+    std::size_t timeIndex = 0;
+
+    for (std::size_t i = 0; i < spec->fields.size(); i++) {
+        switch (spec->fields[i]) {
+        case Field::None:
+            return decodeSequence(line, i, message);
+        case Field::Address:
+            if (!line.addressArg(i, message.address))
+                return false;
+            break;
+        case Field::Value:
+        case Field::Flags:
+        case Field::Time:
+            if (!line.uintArg(i, *numericSlot(message, spec->fields[i], timeIndex)))
+                return false;
+            break;
+        case Field::Text:
+            if (line.argCount() <= i)
+                return false;
+            message.text = line.argTail(i);
+            return true;
+        }
+    }
+
+    return decodeSequence(line, spec->fields.size(), message);
+}
+
+bool ProtocolParser::decodeFrame(std::string_view frame, ProtocolMessage &message)
+{
+    if (frame.empty())
+        return false;
+
+    const OpcodeSpec *spec = findSpec(static_cast<ProtocolOpcode>(static_cast<unsigned char>(frame[0])));
+    if (!spec)
+        return false;
+
+    message = ProtocolMessage();
+    message.opcode = spec->opcode;
+
+    const char *cursor = frame.data() + 1;
+    const char *end = frame.data() + frame.size();
+    std::size_t timeIndex = 0;
+
+    for (Field field : spec->fields) {
+        switch (field) {
+        case Field::None:
+            return decodeSequence(cursor, end, message);
+        case Field::Address:
+            if (end - cursor < 6)
+                return false;
+            message.address = 0;
+            for (int i = 0; i < 6; i++)
+                message.address = (message.address << 8) | static_cast<unsigned char>(*cursor++);
+            break;
+        case Field::Value:
+        case Field::Flags:
+        case Field::Time: {
+            const std::size_t used = readVarint(cursor, static_cast<std::size_t>(end - cursor), *numericSlot(message, field, timeIndex));
+            if (!used)
+                return false;
+            cursor += used;
+            break;
+        }
+        case Field::Text:
+            message.text = std::string_view(cursor, static_cast<std::size_t>(end - cursor));
+            return true;
+        }
+    }
+
+    return decodeSequence(cursor, end, message);
+}
+
+bool ProtocolParser::parseAddress(std::string_view text, std::uint64_t &address)
+{
+    // XX:XX:XX:XX:XX:XX
+    if (text.size() != 17)
+        return false;
+
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < text.size(); i += 3) {
+        const int hi = hexDigit(text[i]);
+        const int lo = hexDigit(text[i + 1]);
+        if (hi < 0 || lo < 0 || (i + 2 < text.size() && text[i + 2] != ':'))
+            return false;
+        value = (value << 8) | static_cast<std::uint64_t>(hi << 4 | lo);
+    }
+
+    address = value;
+    return true;
+}
+
+std::size_t ProtocolParser::readVarint(const char *data, std::size_t size, std::uint64_t &value)
+{
+    std::uint64_t result = 0;
+
+    for (std::size_t i = 0; i < size && i < 10; i++) {
+        const auto byte = static_cast<unsigned char>(data[i]);
+        result |= static_cast<std::uint64_t>(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+ProtocolWriter::ProtocolWriter(std::string &out, bool binary) :
+    m_out(out),
+    m_binary(binary)
+{
+}
+
+ProtocolWriter &ProtocolWriter::begin(ProtocolOpcode opcode)
+{
+    if (!m_binary) {
+        m_out.append(ProtocolParser::opcodeName(opcode));
+        return *this;
+    }
+
+    // The length is patched in by end(). It almost always fits one varint
+    // byte; otherwise the payload is shifted to make room.
+    m_out += static_cast<char>(FRAME_MARKER);
+    m_lengthAt = m_out.size();
+    m_out += '\0';
+    m_out += static_cast<char>(opcode);
+    return *this;
+}
+
+ProtocolWriter &ProtocolWriter::addUInt(std::uint64_t value)
+{
+    if (m_binary) {
+        appendVarint(value, m_out);
+    } else {
+        m_out += ',';
+        appendDecimal(value, m_out);
+    }
+    return *this;
+}
+
+ProtocolWriter &ProtocolWriter::addAddress(std::uint64_t address)
+{
+    if (m_binary) {
+        for (int shift = 40; shift >= 0; shift -= 8)
+            m_out += static_cast<char>((address >> shift) & 0xFF);
+    } else {
+        m_out += ',';
+        appendAddressText(address, m_out);
+    }
+    return *this;
+}
+
+ProtocolWriter &ProtocolWriter::addString(std::string_view text)
+{
+    if (!m_binary)
+        m_out += ',';
+    m_out.append(text);
+    return *this;
+}
+
+ProtocolWriter &ProtocolWriter::addSequence(std::uint64_t sequence)
+{
+    if (!sequence)
+        return *this;
+
+    if (m_binary) {
+        appendVarint(sequence, m_out);
+    } else {
+        m_out += ",#";
+        appendDecimal(sequence, m_out);
+    }
+    return *this;
+}
+
+void ProtocolWriter::end()
+{
+    if (!m_binary) {
+        m_out += '\n';
+        return;
+    }
+
+    const std::size_t length = m_out.size() - m_lengthAt - 1;
+    if (length < 0x80) {
+        m_out[m_lengthAt] = static_cast<char>(length);
+        return;
+    }
+
+    std::string prefix;
+    appendVarint(length, prefix);
+    m_out.replace(m_lengthAt, 1, prefix);
+}
+
+void ProtocolWriter::encode(const ProtocolMessage &message, bool binary, std::string &out)
+{
+    const OpcodeSpec *spec = findSpec(message.opcode);
+    if (!spec)
+        return;
+
+    ProtocolWriter writer(out, binary);
+    writer.begin(message.opcode);
+
+    bool hasText = false;
+    std::size_t timeIndex = 0;
+    for (Field field : spec->fields) {
+        switch (field) {
+        case Field::Address:
+            writer.addAddress(message.address);
+            break;
+        case Field::Value:
+        case Field::Flags:
+        case Field::Time:
+            writer.addUInt(numericSlot(message, field, timeIndex));
+            break;
+        case Field::Text:
+            writer.addString(message.text);
+            hasText = true;
+            break;
+        case Field::None:
+            break;
+        }
+    }
+
+    if (!hasText)
+        writer.addSequence(message.sequence);
+    writer.end();
+}
+
+void ProtocolWriter::appendVarint(std::uint64_t value, std::string &out)
+{
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
@@ -0,0 +1,294 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Player link protocol. Kept free of Qt so it can be exercised on its own.
+//
+// Version 1 is text only: "COMMAND,arg,arg\n".
+// Version 2 adds length-prefixed binary frames which may be interleaved with
+// text lines: FRAME_MARKER, varint length, one-byte opcode, payload. Integers
+// are varints, addresses 6 raw bytes (most significant first) and a text
+// argument runs to the end of the frame. The marker byte never occurs in
+// UTF-8, so the two forms can't be confused.
+//
+// Both sides start in text. The controller sends "HELLO,<version>,<caps>"
+// right after connecting; a version 2 player answers with its own HELLO and
+// from then on both ends may send frames. Old players just report the HELLO
+// as unknown and the link stays text.
+//
+// With CapAcknowledge negotiated, commands may carry a sequence number as a
+// trailing ",#<n>" (text) or a trailing varint (frames). The player answers
+// every numbered command with ACK,<n>,<status> once it has acted on it.
+// Messages ending in a text argument can't be numbered.
+//
+// With CapTimeSync the controller sends TIME,<t1> pings, which the player
+// answers at once with TIME_REPLY,<t1>,<t2>,<t3>: the echoed origin time and
+// its own clock when the ping arrived and when the reply left. PLAY_AT and
+// SET_VOL_AT take a time on the player's clock at which to act. Times are
+// microseconds on a monotonic clock; each side's epoch is its own.
+//
+// With CapStateVersion every playback and speaker event from the player
+// carries the player's state version in the sequence slot, one higher than
+// the event before it. GET_STATE,<since> asks for what changed after
+// version since: the missed events again, in order, or, when since is 0 or
+// too old, one STATE,<version>,<flags>,<speaker> snapshot.
+//
+// With CapBulkTransfer, which needs binary framing, the controller can upload
+// files. UPLOAD,<size>,<crc>,<name> announces one; the player answers
+// UPLOAD_ACK,<offset>,<status> with how much of it it already holds, so an
+// interrupted upload resumes there. CHUNK,<offset>,<crc>,<data> frames carry
+// the data, each acknowledged with the offset the player expects next; a
+// chunk that fails its checksum or arrives out of order is answered with
+// StatusCorrupt and the expected offset, and the controller goes back to it.
+// The last acknowledgement, of the full size, also vouches for the checksum
+// of the whole file. Checksums are CRC-32 (IEEE). Neither UPLOAD nor CHUNK is
+// numbered, bulk data stays out of the command window.
+//
+// With CapVolumeRamp, RAMP,<volume>,<flags>,<duration> has the player move
+// its volume to volume over duration microseconds along the curve in flags,
+// on its own, so a fade needs neither the link nor the controller once
+// sent. The player announces the ramp with RAMPING,<volume>,<flags>,
+// <remaining>, and again after every GET_STATE reply while it runs. RAMPING
+// is never numbered: it only says what the coming VOL will be, and the steps
+// in between aren't reported at all. The numbered VOL that ends the ramp
+// is. SET_VOL, SET_VOL_AT, STOP and the next RAMP end a running ramp.
+// RampStopAtEnd makes it a sleep timer.
+
+constexpr unsigned int PROTOCOL_VERSION = 2;
+constexpr unsigned char FRAME_MARKER = 0xFE;
+constexpr std::size_t MAX_FRAME_SIZE = 4096;
+
+enum ProtocolCapability : std::uint32_t {
+    CapBinaryFraming = 1u << 0,
+    CapAcknowledge = 1u << 1,
+    CapTimeSync = 1u << 2,
+    CapStateVersion = 1u << 3,
+    CapBulkTransfer = 1u << 4,
+    CapVolumeRamp = 1u << 5
+};
+
+enum ProtocolStatus : std::uint32_t {
+    StatusOk = 0,
+    StatusRejected = 1,
+    // Bulk data failed its checksum or arrived out of order
+    StatusCorrupt = 2
+};
+
+// Layout of the STATE flags
+enum ProtocolStateFlags : std::uint32_t {
+    StatePlaying = 1u << 0,
+    StateVolumeShift = 8,
+    StateVolumeMask = 0xFFu << StateVolumeShift
+};
+
+// Layout of the RAMP and RAMPING flags
+enum ProtocolRampFlags : std::uint32_t {
+    RampCurveMask = 0x0Fu,
+    RampLinear = 0,
+    // Even steps in loudness rather than in volume, for fades
+    RampPerceptual = 1,
+    // Slow at both ends
+    RampSmooth = 2,
+    // Stops playback once the volume is reached
+    RampStopAtEnd = 1u << 4,
+    // After stopping, back to the volume the ramp started from, so the next
+    // PLAY isn't silent
+    RampRestoreVolume = 1u << 5,
+    // Ends a running ramp where it is, volume and duration are ignored
+    RampCancel = 1u << 6
+};
+
+enum class ProtocolOpcode : std::uint8_t {
+    Invalid = 0x00,
+
+    // Either direction
+    Hello = 0x7F,
+
+    // Controller -> player
+    Scan = 0x01,
+    ConnectSpeaker = 0x02,
+    UnpairSpeaker = 0x03,
+    Play = 0x04,
+    Stop = 0x05,
+    SetVolume = 0x06,
+    TimeRequest = 0x07,
+    PlayAt = 0x08,
+    SetVolumeAt = 0x09,
+    GetState = 0x0A,
+    Upload = 0x0B,
+    Chunk = 0x0C,
+    Ramp = 0x0D,
+
+    // Player -> controller
+    BtDevice = 0x81,
+    ConnectedSpeaker = 0x82,
+    DisconnectedSpeaker = 0x83,
+    Volume = 0x84,
+    Playing = 0x85,
+    Stopped = 0x86,
+    Ack = 0x87,
+    TimeReply = 0x88,
+    State = 0x89,
+    UploadAck = 0x8A,
+    Ramping = 0x8B
+};
+
+// Decoded form of one line or frame. Which fields are meaningful depends on
+// the opcode, see the schema in protocol.cpp.
+struct ProtocolMessage
+{
+    ProtocolOpcode opcode = ProtocolOpcode::Invalid;
+    std::uint64_t address = 0;
+    std::uint64_t value = 0;
+    std::uint64_t flags = 0;
+    std::string_view text;
+    // 0 when the message isn't numbered
+    std::uint64_t sequence = 0;
+    // Timestamps in schema order
+    std::array<std::uint64_t, 3> times{};
+};
+
+// Typed, already validated player events, as seen by the controller.
+class PlayerEventHandler
+{
+public:
+    virtual ~PlayerEventHandler() = default;
+
+    virtual void onHello(unsigned int version, std::uint32_t capabilities) = 0;
+    virtual void onSpeakerDiscovered(std::uint64_t address, std::string_view name) = 0;
+    virtual void onSpeakerConnected(std::uint64_t address) = 0;
+    virtual void onSpeakerDisconnected() = 0;
+    virtual void onVolume(unsigned int volume) = 0;
+    virtual void onPlaying() = 0;
+    virtual void onStopped() = 0;
+    virtual void onAck(std::uint64_t sequence, std::uint32_t status) = 0;
+    virtual void onTimeReply(std::uint64_t origin, std::uint64_t receive, std::uint64_t transmit) = 0;
+    // speakerAddress is 0 without a connected speaker
+    virtual void onState(std::uint64_t version, unsigned int volume, bool playing, std::uint64_t speakerAddress) = 0;
+    virtual void onUploadAck(std::uint64_t offset, std::uint32_t status) = 0;
+    virtual void onRamping(unsigned int volume, std::uint32_t flags, std::uint64_t remaining) = 0;
+    virtual void onUnrecognized(std::string_view raw) = 0;
+    // Called after an event carrying a state version was dispatched
+    virtual void onStateVersion(std::uint64_t version) = 0;
+    // Called before a decoded event is dispatched, with its size on the
+    // wire, framing included
+    virtual void onMessageBytes(ProtocolOpcode /*opcode*/, std::size_t /*bytes*/) {}
+};
+
+// Typed, already validated controller commands, as seen by the player.
+class PlayerCommandHandler
+{
+public:
+    virtual ~PlayerCommandHandler() = default;
+
+    virtual void onHello(unsigned int version, std::uint32_t capabilities) = 0;
+    virtual void onScan() = 0;
+    virtual void onConnectSpeaker(std::uint64_t address) = 0;
+    virtual void onUnpairSpeaker() = 0;
+    virtual void onPlay() = 0;
+    virtual void onStop() = 0;
+    virtual void onSetVolume(unsigned int volume) = 0;
+    virtual void onTimeRequest(std::uint64_t origin) = 0;
+    virtual void onPlayAt(std::uint64_t time) = 0;
+    virtual void onSetVolumeAt(unsigned int volume, std::uint64_t time) = 0;
+    virtual void onGetState(std::uint64_t since) = 0;
+    virtual void onUpload(std::uint64_t size, std::uint32_t checksum, std::string_view name) = 0;
+    virtual void onChunk(std::uint64_t offset, std::uint32_t checksum, std::string_view data) = 0;
+    virtual void onRamp(unsigned int volume, std::uint32_t flags, std::uint64_t duration) = 0;
+    virtual void onUnrecognized(std::string_view raw) = 0;
+    // Called after a numbered command was dispatched (handled) or rejected
+    virtual void onSequenced(std::uint64_t sequence, bool handled) = 0;
+    // Called before a decoded command is dispatched, with its size on the
+    // wire, framing included
+    virtual void onMessageBytes(ProtocolOpcode /*opcode*/, std::size_t /*bytes*/) {}
+};
+
+// Splits one text line into views over the caller's buffer, nothing is copied.
+class ProtocolLine
+{
+public:
+    static constexpr std::size_t MaxFields = 8;
+
+    bool parse(std::string_view line);
+
+    std::string_view line() const { return m_line; }
+    std::string_view command() const { return m_fields[0]; }
+    std::size_t argCount() const { return m_count ? m_count - 1 : 0; }
+
+    // Out of range arguments are empty / fail to convert
+    std::string_view arg(std::size_t i) const;
+    // Argument i up to the end of the line, commas included
+    std::string_view argTail(std::size_t i) const;
+    bool uintArg(std::size_t i, std::uint64_t &value) const;
+    bool addressArg(std::size_t i, std::uint64_t &address) const;
+
+private:
+    std::string_view m_line;
+    std::array<std::string_view, MaxFields> m_fields;
+    std::size_t m_count = 0;
+};
+
+// CRC-32 (IEEE) of data, continuing from crc to checksum data in pieces
+std::uint32_t protocolChecksum(const char *data, std::size_t size, std::uint32_t crc = 0);
+
+// Where a ramp from one volume to another stands after elapsed of duration,
+// following the curve in flags
+unsigned int protocolRampVolume(unsigned int from, unsigned int to, std::uint32_t flags,
+                                std::uint64_t elapsed, std::uint64_t duration);
+
+class ProtocolParser
+{
+public:
+    // Dispatches every complete line or frame in data and returns the number
+    // of bytes consumed; a trailing partial message is left for the next call.
+    static std::size_t parse(const char *data, std::size_t size, PlayerEventHandler &handler);
+    static std::size_t parse(const char *data, std::size_t size, PlayerCommandHandler &handler);
+
+    static bool decodeLine(std::string_view line, ProtocolMessage &message);
+    // frame is the opcode byte followed by the payload
+    static bool decodeFrame(std::string_view frame, ProtocolMessage &message);
+
+    static ProtocolOpcode opcodeFromName(std::string_view name);
+    static std::string_view opcodeName(ProtocolOpcode opcode);
+
+    static bool parseAddress(std::string_view text, std::uint64_t &address);
+    // Returns the number of bytes read, 0 if data ends before the varint does
+    static std::size_t readVarint(const char *data, std::size_t size, std::uint64_t &value);
+};
+
+// Serializes commands straight into the caller's buffer. Arguments must be
+// added in schema order:
+//
+//     ProtocolWriter(out, binary).begin(ProtocolOpcode::SetVolume).addUInt(42).end();
+class ProtocolWriter
+{
+public:
+    ProtocolWriter(std::string &out, bool binary);
+
+    ProtocolWriter &begin(ProtocolOpcode opcode);
+    ProtocolWriter &addUInt(std::uint64_t value);
+    ProtocolWriter &addAddress(std::uint64_t address);
+    // Only valid as the last argument
+    ProtocolWriter &addString(std::string_view text);
+    // Only valid as the last argument, 0 adds nothing
+    ProtocolWriter &addSequence(std::uint64_t sequence);
+    void end();
+
+    // Appends message to out, as a frame when binary is set and as a text
+    // line otherwise.
+    static void encode(const ProtocolMessage &message, bool binary, std::string &out);
+
+    static void appendVarint(std::uint64_t value, std::string &out);
+
+private:
+    std::string &m_out;
+    bool m_binary;
+    std::size_t m_lengthAt = 0;
+};
+
+#endif // PROTOCOL_H
@@ -103,7 +103,7 @@ AppPage {
                 MouseArea {
                 anchors.fill: parent
                     onClicked: {
-                        deviceFinder.connectToSpeaker(modelData.deviceAddress);
+                        deviceFinder.connectToSpeaker(model.deviceAddress);
                         app.showPage("Noise.qml")
                     }
                 }
@@ -111,7 +111,7 @@ AppPage {
                 Text {
                     id: device
                     font.pixelSize: AppSettings.smallFontSize
-                    text: modelData.deviceName
+                    text: model.deviceName
                     anchors.top: parent.top
                     anchors.topMargin: parent.height * 0.1
                     anchors.leftMargin: parent.height * 0.1
@@ -122,7 +122,7 @@ AppPage {
                 Text {
                     id: deviceAddress
                     font.pixelSize: AppSettings.smallFontSize
-                    text: modelData.deviceAddress
+                    text: model.deviceAddress
                     anchors.bottom: parent.bottom
                     anchors.bottomMargin: parent.height * 0.1
                     anchors.rightMargin: parent.height * 0.1
@@ -0,0 +1,155 @@
+import QtQuick 2.5
+
+// Hidden page, opened by holding the volume title on the Noise page
+AppPage {
+    id: page
+
+    property var metrics: deviceFinder.metrics.snapshot
+    property string exported: ""
+
+    errorMessage: deviceFinder.error
+    infoMessage: exported
+
+    function histogram(h) {
+        if (!h || h.count === 0)
+            return qsTr("no samples")
+        return qsTr("n=%1 p50=%2 p95=%3 max=%4 ms")
+            .arg(h.count).arg(h.p50.toFixed(1)).arg(h.p95.toFixed(1)).arg(h.max.toFixed(1))
+    }
+
+    function startup(ms) {
+        return ms === undefined ? "-" : ms + " ms"
+    }
+
+    function upload(u) {
+        if (!u || !u.name)
+            return "-"
+        var text = qsTr("%1 %2, %3 of %4 bytes (%5%)")
+            .arg(u.name).arg(u.state).arg(u.acknowledged).arg(u.size).arg((u.progress * 100).toFixed(0))
+        if (u.state === "sending")
+            text += qsTr(", %1 KiB/s").arg((u.throughput / 1024).toFixed(1))
+        if (u.error)
+            text += ": " + u.error
+        return text
+    }
+
+    function counts(map) {
+        var parts = []
+        for (var name in map)
+            parts.push(name + " " + map[name])
+        return parts.length ? parts.join(", ") : "-"
+    }
+
+    Rectangle {
+        id: viewContainer
+        anchors.top: parent.top
+        anchors.bottom: buttons.top
+        anchors.topMargin: AppSettings.fieldMargin + page.messageHeight
+        anchors.bottomMargin: AppSettings.fieldMargin
+        anchors.horizontalCenter: parent.horizontalCenter
+        width: parent.width - AppSettings.fieldMargin*2
+        color: AppSettings.viewColor
+        radius: AppSettings.buttonRadius
+
+        Flickable {
+            anchors.fill: parent
+            anchors.margins: AppSettings.fieldMargin / 2
+            contentHeight: lines.height
+            clip: true
+
+            Column {
+                id: lines
+                width: parent.width
+
+                Repeater {
+                    model: [
+                        qsTr("Connection: %1").arg(deviceFinder.connectionState),
+                        qsTr("Round trip: %1 ms").arg(deviceFinder.roundTripTime.toFixed(1)),
+                        "",
+                        qsTr("Bytes sent: %1").arg(metrics.link.bytesSent),
+                        counts(metrics.protocol.bytesSentByOpcode),
+                        qsTr("Bytes received: %1").arg(metrics.link.bytesReceived),
+                        counts(metrics.protocol.bytesReceivedByOpcode),
+                        qsTr("Connect attempts: %1, connects: %2").arg(metrics.link.connectAttempts).arg(metrics.link.connects),
+                        qsTr("Time to connect: %1").arg(histogram(metrics.link.timeToConnect)),
+                        "",
+                        qsTr("Commands sent: %1").arg(metrics.protocol.commandsSent),
+                        counts(metrics.protocol.sentByOpcode),
+                        qsTr("Messages received: %1").arg(metrics.protocol.messagesReceived),
+                        counts(metrics.protocol.receivedByOpcode),
+                        qsTr("Unrecognized: %1").arg(metrics.protocol.unrecognized),
+                        qsTr("Failed: %1 (timed out %2)").arg(metrics.protocol.failed).arg(metrics.protocol.timedOut),
+                        qsTr("Round trips: %1").arg(histogram(metrics.protocol.roundTrip)),
+                        qsTr("Upload: %1").arg(upload(deviceFinder.upload)),
+                        "",
+                        qsTr("Searches: %1").arg(metrics.discovery.searches),
+                        qsTr("Search time: %1").arg(histogram(metrics.discovery.duration)),
+                        "",
+                        qsTr("Connect started: %1").arg(startup(metrics.startup.connectStarted)),
+                        qsTr("Engine loaded: %1").arg(startup(metrics.startup.engineLoaded)),
+                        qsTr("First frame: %1").arg(startup(metrics.startup.firstFrame)),
+                        qsTr("Connected: %1").arg(startup(metrics.startup.connected)),
+                        qsTr("First state: %1").arg(startup(metrics.startup.firstState))
+                    ]
+
+                    Text {
+                        width: lines.width
+                        wrapMode: Text.Wrap
+                        font.pixelSize: AppSettings.tinyFontSize
+                        color: AppSettings.textColor
+                        text: modelData
+                    }
+                }
+            }
+        }
+    }
+
+    Row {
+        id: buttons
+        anchors.bottom: parent.bottom
+        anchors.bottomMargin: AppSettings.fieldMargin
+        anchors.horizontalCenter: parent.horizontalCenter
+        width: viewContainer.width
+        height: AppSettings.fieldHeight
+        spacing: AppSettings.fieldMargin / 2
+
+        AppButton {
+            width: (parent.width - parent.spacing * 2) / 3
+            height: parent.height
+            onClicked: page.exported = deviceFinder.metrics.exportJson()
+
+            Text {
+                anchors.centerIn: parent
+                font.pixelSize: AppSettings.tinyFontSize
+                text: qsTr("Export")
+                color: AppSettings.textColor
+            }
+        }
+
+        AppButton {
+            width: (parent.width - parent.spacing * 2) / 3
+            height: parent.height
+            onClicked: page.exported = deviceFinder.dumpTrace()
+
+            Text {
+                anchors.centerIn: parent
+                font.pixelSize: AppSettings.tinyFontSize
+                text: qsTr("Trace")
+                color: AppSettings.textColor
+            }
+        }
+
+        AppButton {
+            width: (parent.width - parent.spacing * 2) / 3
+            height: parent.height
+            onClicked: deviceFinder.metrics.reset()
+
+            Text {
+                anchors.centerIn: parent
+                font.pixelSize: AppSettings.tinyFontSize
+                text: qsTr("Reset")
+                color: AppSettings.textColor
+            }
+        }
+    }
+}
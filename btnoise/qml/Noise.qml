@@ -57,6 +57,41 @@ AppPage {
     errorMessage: deviceFinder.error
     infoMessage: deviceFinder.info
 
+    // Sleep timer choices in minutes, the button steps through them
+    property var sleepPresets: [15, 30, 60]
+    // Of the Fade out button, in ms
+    property int fadeOutDuration: 10000
+    // Of the running sleep timer, in ms
+    property int sleepRemaining: 0
+
+    function nextSleepTimer() {
+        var minutes = sleepRemaining / 60000
+        for (var i = 0; i < sleepPresets.length; i++) {
+            if (sleepPresets[i] > minutes + 0.5) {
+                deviceFinder.startSleepTimer(sleepPresets[i] * 60000)
+                return
+            }
+        }
+        deviceFinder.cancelFade()
+    }
+
+    function formatRemaining(msecs) {
+        var seconds = Math.ceil(msecs / 1000)
+        var minutes = Math.floor(seconds / 60)
+        seconds = seconds % 60
+        return minutes + ":" + (seconds < 10 ? "0" : "") + seconds
+    }
+
+    // The remaining time isn't notified as it counts down
+    Timer {
+        interval: 1000
+        repeat: true
+        triggeredOnStart: true
+        running: deviceFinder.ramping
+        onTriggered: sleepRemaining = deviceFinder.sleepTimerRemaining
+        onRunningChanged: if (!running) sleepRemaining = 0
+    }
+
     ColumnLayout {
 
         Rectangle {
@@ -75,6 +110,11 @@ AppPage {
             color: AppSettings.textColor
             font.pixelSize: AppSettings.mediumFontSize
             text: qsTr("Volume")
+
+            MouseArea {
+                anchors.fill: parent
+                onPressAndHold: app.showPage("Diagnostics.qml")
+            }
         }
 
         Slider {
@@ -132,6 +172,63 @@ AppPage {
             }
         }
 
+        Rectangle {
+            height: AppSettings.fieldMargin
+        }
+
+        Rectangle {
+            width: parent.width
+            height: AppSettings.fieldHeight
+            color: "transparent"
+
+            AppButton {
+                anchors.left: parent.left;
+                width: parent.width/2 - AppSettings.fieldMargin / 4
+                height: AppSettings.fieldHeight
+                enabled: deviceFinder.playing
+                // Stops like a sleep timer, the volume is back for the next
+                // play, but it isn't counted down as one
+                onClicked: deviceFinder.fadeOut(fadeOutDuration)
+
+                Text {
+                    anchors.centerIn: parent
+                    font.pixelSize: AppSettings.tinyFontSize
+                    text: qsTr("Fade out")
+                    color: AppSettings.textColor
+                }
+            }
+
+            AppButton {
+                anchors.right: parent.right;
+                width: parent.width/2 - AppSettings.fieldMargin / 4
+                height: AppSettings.fieldHeight
+                enabled: deviceFinder.playing
+                onClicked: nextSleepTimer()
+
+                Text {
+                    anchors.centerIn: parent
+                    font.pixelSize: AppSettings.tinyFontSize
+                    text: sleepRemaining > 0 ? qsTr("Sleep %1").arg(formatRemaining(sleepRemaining))
+                                             : qsTr("Sleep timer")
+                    color: AppSettings.textColor
+                }
+            }
+        }
+
+        Text {
+            width: parent.width
+            visible: deviceFinder.ramping && sleepRemaining === 0
+            height: AppSettings.fieldHeight
+            color: AppSettings.textColor
+            font.pixelSize: AppSettings.smallFontSize
+            text: qsTr("Fading...")
+
+            MouseArea {
+                anchors.fill: parent
+                onClicked: deviceFinder.cancelFade()
+            }
+        }
+
         Rectangle {
             color: "transparent"
             height: AppSettings.fieldMargin
@@ -143,7 +240,23 @@ AppPage {
             height: AppSettings.fieldHeight
             color: AppSettings.textColor
             font.pixelSize: AppSettings.mediumFontSize
-            text: qsTr("Player is disconnected")
+            text: {
+                switch (deviceFinder.connectionState) {
+                case "connecting": return qsTr("Connecting to player...")
+                case "backingOff": return qsTr("Player unreachable, retrying")
+                default: return qsTr("Player is disconnected")
+                }
+            }
+        }
+
+        Text {
+            width: parent.width
+            visible: deviceFinder.group.count > 1
+            height: AppSettings.fieldHeight
+            color: AppSettings.textColor
+            font.pixelSize: AppSettings.smallFontSize
+            text: qsTr("Controlling %1 players, %2 connected")
+                .arg(deviceFinder.group.count).arg(deviceFinder.group.connectedCount)
         }
 
         Text {
@@ -0,0 +1,56 @@
+#include "app-global.h"
+#include "rfcommtransport.h"
+
+#include <QBluetoothUuid>
+
+RfcommTransport::RfcommTransport(QObject *parent) :
+    PlayerTransport(parent),
+    m_socket(QBluetoothServiceInfo::RfcommProtocol)
+{
+    connect(&m_socket, &QBluetoothSocket::connected, this, &PlayerTransport::connected);
+    connect(&m_socket, &QBluetoothSocket::disconnected, this, &PlayerTransport::disconnected);
+    connect(&m_socket, &QBluetoothSocket::readyRead, this, &PlayerTransport::readyRead);
+    connect(&m_socket, static_cast<void (QBluetoothSocket::*)(QBluetoothSocket::SocketError)>(&QBluetoothSocket::error),
+            [this]() {
+        emit errorOccurred(m_socket.errorString());
+    });
+}
+
+PlayerTransport::Kind RfcommTransport::kind() const
+{
+    return Rfcomm;
+}
+
+PlayerTransport::State RfcommTransport::state() const
+{
+    switch (m_socket.state()) {
+    case QBluetoothSocket::ConnectedState:
+        return ConnectedState;
+    case QBluetoothSocket::ClosingState:
+        return ClosingState;
+    case QBluetoothSocket::UnconnectedState:
+        return UnconnectedState;
+    default:
+        return ConnectingState;
+    }
+}
+
+void RfcommTransport::connectToPlayer(const QString &address)
+{
+    if (address != m_addressText) {
+        m_addressText = address;
+        m_address = QBluetoothAddress(address);
+    }
+
+    m_socket.connectToService(m_address, QBluetoothUuid(BT_SERVER_UUID));
+}
+
+void RfcommTransport::close()
+{
+    m_socket.close();
+}
+
+QIODevice *RfcommTransport::device()
+{
+    return &m_socket;
+}
@@ -0,0 +1,29 @@
+#ifndef RFCOMMTRANSPORT_H
+#define RFCOMMTRANSPORT_H
+
+#include "playertransport.h"
+
+#include <QBluetoothAddress>
+#include <QBluetoothSocket>
+
+class RfcommTransport : public PlayerTransport
+{
+    Q_OBJECT
+
+public:
+    explicit RfcommTransport(QObject *parent = nullptr);
+
+    Kind kind() const override;
+    State state() const override;
+    void connectToPlayer(const QString &address) override;
+    void close() override;
+    QIODevice *device() override;
+
+private:
+    QBluetoothSocket m_socket;
+    // Reconnects reuse the parsed form of an unchanged address
+    QString m_addressText;
+    QBluetoothAddress m_address;
+};
+
+#endif // RFCOMMTRANSPORT_H
@@ -0,0 +1,544 @@
+#include "simulatedplayer.h"
+#include "clockestimator.h"
+
+#include <QDebug>
+#include <QPointer>
+#include <QRandomGenerator>
+
+namespace {
+
+struct SimulatedSpeaker {
+    std::uint64_t address;
+    const char *name;
+};
+
+const SimulatedSpeaker SPEAKERS[] = {
+    { 0x001122334401, "Simulated Speaker Kitchen" },
+    { 0x001122334402, "Simulated Speaker Bedroom" }
+};
+
+}
+
+SimulatedPlayer::SimulatedPlayer(QObject *parent) :
+    QObject(parent),
+    m_server(this)
+{
+    connect(&m_server, &QLocalServer::newConnection, this, &SimulatedPlayer::acceptClient);
+
+    m_playTimer.setSingleShot(true);
+    m_playTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_playTimer, &QTimer::timeout, this, &SimulatedPlayer::startPlaying);
+
+    m_volumeTimer.setSingleShot(true);
+    m_volumeTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_volumeTimer, &QTimer::timeout, this, [this]() {
+        applyVolume(m_scheduledVolume);
+    });
+
+    m_rampTimer.setInterval(RampStepInterval);
+    connect(&m_rampTimer, &QTimer::timeout, this, &SimulatedPlayer::stepRamp);
+
+    m_disconnectTimer.setSingleShot(true);
+    connect(&m_disconnectTimer, &QTimer::timeout, this, &SimulatedPlayer::disconnectClients);
+}
+
+SimulatedPlayer::~SimulatedPlayer()
+{
+    m_server.close();
+
+    // Each client is deleted along with its socket
+    const QList<Client*> clients = m_clients;
+    m_clients.clear();
+    for (Client *client : clients)
+        delete client->socket;
+}
+
+bool SimulatedPlayer::listen(const QString &name)
+{
+    QLocalServer::removeServer(name);
+
+    if (!m_server.listen(name)) {
+        qWarning() << "simulated player failed to listen on" << name << m_server.errorString();
+        return false;
+    }
+
+    qInfo() << "simulated player listening on" << m_server.fullServerName();
+    return true;
+}
+
+QString SimulatedPlayer::serverName() const
+{
+    return m_server.serverName();
+}
+
+void SimulatedPlayer::setLinkDelay(int delay, int jitter)
+{
+    m_linkDelay = qMax(0, delay);
+    m_linkJitter = jitter < 0 ? m_linkDelay : jitter;
+}
+
+void SimulatedPlayer::setBandwidth(int bytesPerSecond)
+{
+    m_bandwidth = qMax(0, bytesPerSecond);
+}
+
+void SimulatedPlayer::setDropRate(qreal rate)
+{
+    m_dropRate = qBound<qreal>(0, rate, 1);
+}
+
+void SimulatedPlayer::setDisconnectInterval(int interval)
+{
+    m_disconnectInterval = qMax(0, interval);
+    scheduleDisconnect();
+}
+
+void SimulatedPlayer::setScanResults(int count)
+{
+    m_scanResults = qMax(0, count);
+}
+
+void SimulatedPlayer::floodDevices(int count)
+{
+    for (int i = 0; i < count; i++) {
+        const QByteArray name = "Load Speaker " + QByteArray::number(i);
+        broadcast({ProtocolOpcode::BtDevice, 0x00AA00000000ull + std::uint64_t(i), 0, 0,
+                   std::string_view(name.constData(), std::size_t(name.size()))});
+    }
+}
+
+void SimulatedPlayer::floodVolume(int count)
+{
+    for (int i = 0; i < count; i++)
+        applyVolume((m_volume + 1) % 101);
+}
+
+void SimulatedPlayer::scheduleDisconnect()
+{
+    if (!m_disconnectInterval) {
+        m_disconnectTimer.stop();
+        return;
+    }
+
+    m_disconnectTimer.start(m_disconnectInterval / 2 + int(QRandomGenerator::global()->bounded(m_disconnectInterval + 1)));
+}
+
+void SimulatedPlayer::disconnectClients()
+{
+    if (!m_clients.isEmpty())
+        qInfo() << "simulated player dropping" << m_clients.size() << "controllers";
+
+    const QList<Client*> clients = m_clients;
+    m_clients.clear();
+    for (Client *client : clients) {
+        client->socket->abort();
+        client->socket->deleteLater();
+    }
+
+    scheduleDisconnect();
+}
+
+void SimulatedPlayer::setClockOffset(qint64 usec)
+{
+    m_clockOffset = usec;
+}
+
+std::uint64_t SimulatedPlayer::clock() const
+{
+    return std::uint64_t(ClockEstimator::now() + m_clockOffset);
+}
+
+int SimulatedPlayer::msecsUntil(std::uint64_t time) const
+{
+    const qint64 usec = qint64(time - clock());
+    return usec > 0 ? int(qMin<qint64>((usec + 999) / 1000, 60000)) : 0;
+}
+
+void SimulatedPlayer::delayed(Client *client, qint64 &due, int bytes, const std::function<void()> &work)
+{
+    if (!m_linkDelay && !m_linkJitter && !m_bandwidth) {
+        work();
+        return;
+    }
+
+    const qint64 now = ClockEstimator::now();
+    const qint64 delay = m_linkDelay + QRandomGenerator::global()->bounded(m_linkJitter + 1);
+    // With a cap the link carries one message after the other
+    const qint64 transfer = m_bandwidth ? qint64(bytes) * 1000000 / m_bandwidth : 0;
+    due = qMax(due, now + delay * 1000) + transfer;
+
+    QPointer<QLocalSocket> socket(client->socket);
+    QTimer::singleShot(int((due - now + 999) / 1000), Qt::PreciseTimer, this, [socket, work]() {
+        if (socket)
+            work();
+    });
+}
+void SimulatedPlayer::acceptClient()
+{
+    while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+        qInfo() << "simulated player accepted controller";
+
+        Client *client = new Client;
+        client->socket = socket;
+        m_clients.append(client);
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, client]() {
+            const QByteArray data = client->socket->readAll();
+            delayed(client, client->inputDue, data.size(), [this, client, data]() {
+                readClient(client, data);
+            });
+        });
+        connect(socket, &QLocalSocket::disconnected, this, [this, client]() {
+            m_clients.removeAll(client);
+            client->socket->deleteLater();
+        });
+        // Delayed reads and writes may still refer to the client until then
+        connect(socket, &QObject::destroyed, this, [client]() {
+            delete client;
+        });
+    }
+}
+
+void SimulatedPlayer::readClient(Client *client, const QByteArray &data)
+{
+    client->readBuffer.append(data);
+
+    m_current = client;
+    const std::size_t consumed = ProtocolParser::parse(client->readBuffer.constData(),
+                                                       static_cast<std::size_t>(client->readBuffer.size()),
+                                                       *this);
+    m_current = nullptr;
+
+    client->readBuffer.remove(0, static_cast<int>(consumed));
+}
+
+void SimulatedPlayer::send(Client *client, const ProtocolMessage &message)
+{
+    if (m_dropRate > 0 && QRandomGenerator::global()->generateDouble() < m_dropRate)
+        return;
+    // Only the VOL at the end of a ramp means anything to this controller
+    if (message.opcode == ProtocolOpcode::Ramping && !client->volumeRamps)
+        return;
+
+    std::string out;
+    if (message.sequence && !client->stateVersions) {
+        ProtocolMessage unversioned = message;
+        unversioned.sequence = 0;
+        ProtocolWriter::encode(unversioned, client->binaryFraming, out);
+    } else {
+        ProtocolWriter::encode(message, client->binaryFraming, out);
+    }
+    delayed(client, client->outputDue, int(out.size()), [client, out]() {
+        client->socket->write(out.data(), static_cast<qint64>(out.size()));
+    });
+}
+
+void SimulatedPlayer::reply(const ProtocolMessage &message)
+{
+    if (m_current)
+        send(m_current, message);
+}
+
+void SimulatedPlayer::broadcast(const ProtocolMessage &message)
+{
+    for (Client *client : qAsConst(m_clients))
+        send(client, message);
+}
+
+void SimulatedPlayer::broadcastState(ProtocolMessage message)
+{
+    message.sequence = ++m_stateVersion;
+
+    m_stateHistory.enqueue(message);
+    if (m_stateHistory.size() > StateHistorySize)
+        m_stateHistory.dequeue();
+
+    broadcast(message);
+}
+
+void SimulatedPlayer::onHello(unsigned int version, std::uint32_t capabilities)
+{
+    // Answer in text, the controller only switches once it has read this
+    reply({ProtocolOpcode::Hello, 0, PROTOCOL_VERSION, CapBinaryFraming | CapAcknowledge | CapTimeSync | CapStateVersion | CapBulkTransfer | CapVolumeRamp});
+    m_current->binaryFraming = version >= 2 && (capabilities & CapBinaryFraming);
+    m_current->stateVersions = version >= 2 && (capabilities & CapStateVersion);
+    m_current->volumeRamps = version >= 2 && (capabilities & CapVolumeRamp);
+}
+
+void SimulatedPlayer::onScan()
+{
+    if (!m_scanResults) {
+        for (const auto &speaker : SPEAKERS)
+            reply({ProtocolOpcode::BtDevice, speaker.address, 0, 0, speaker.name});
+        return;
+    }
+
+    for (int i = 0; i < m_scanResults; i++) {
+        const QByteArray name = "Simulated Speaker " + QByteArray::number(i + 1);
+        reply({ProtocolOpcode::BtDevice, 0x001122330000ull + std::uint64_t(i), 0, 0,
+               std::string_view(name.constData(), std::size_t(name.size()))});
+    }
+}
+
+void SimulatedPlayer::onConnectSpeaker(std::uint64_t address)
+{
+    m_speakerAddress = address;
+    broadcastState({ProtocolOpcode::ConnectedSpeaker, m_speakerAddress});
+}
+
+void SimulatedPlayer::onUnpairSpeaker()
+{
+    m_speakerAddress = 0;
+    broadcastState({ProtocolOpcode::DisconnectedSpeaker});
+}
+
+void SimulatedPlayer::onPlay()
+{
+    m_playTimer.stop();
+    m_playAt = 0;
+    startPlaying();
+}
+
+void SimulatedPlayer::onStop()
+{
+    m_playTimer.stop();
+    m_playAt = 0;
+    m_playing = false;
+    broadcastState({ProtocolOpcode::Stopped});
+    // Stopping a sleep timer early also gets the volume back
+    stopRamp(m_rampFlags & RampStopAtEnd);
+}
+
+void SimulatedPlayer::onSetVolume(unsigned int volume)
+{
+    m_volumeTimer.stop();
+    m_rampTimer.stop();
+    applyVolume(volume);
+}
+
+void SimulatedPlayer::onTimeRequest(std::uint64_t origin)
+{
+    ProtocolMessage message{ProtocolOpcode::TimeReply};
+    message.times = {origin, clock(), clock()};
+    reply(message);
+}
+
+void SimulatedPlayer::onPlayAt(std::uint64_t time)
+{
+    m_playAt = time;
+    m_playTimer.start(msecsUntil(time));
+}
+
+void SimulatedPlayer::onSetVolumeAt(unsigned int volume, std::uint64_t time)
+{
+    stopRamp(false);
+    m_scheduledVolume = volume;
+    m_volumeTimer.start(msecsUntil(time));
+}
+
+void SimulatedPlayer::onGetState(std::uint64_t since)
+{
+    // Replay if everything after since is still in the history
+    const bool replay = since && since <= m_stateVersion
+            && (m_stateHistory.isEmpty() || m_stateHistory.head().sequence <= since + 1);
+
+    if (replay) {
+        for (const ProtocolMessage &event : qAsConst(m_stateHistory)) {
+            if (event.sequence > since)
+                reply(event);
+        }
+    } else {
+        ProtocolMessage state{ProtocolOpcode::State, m_speakerAddress, m_stateVersion};
+        state.flags = (m_playing ? StatePlaying : 0) | (m_volume << StateVolumeShift);
+        reply(state);
+    }
+
+    // Neither tells how far a running ramp got
+    if (m_rampTimer.isActive())
+        reply(rampState());
+}
+
+void SimulatedPlayer::onUpload(std::uint64_t size, std::uint32_t checksum, std::string_view name)
+{
+    const QString fileName = QString::fromUtf8(name.data(), int(name.size()));
+    if (!m_current->binaryFraming || fileName.isEmpty() || size > std::uint64_t(MaxUploadSize)) {
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusRejected});
+        return;
+    }
+
+    const QString key = QStringLiteral("%1/%2/%3").arg(fileName).arg(size).arg(checksum);
+    if (!m_uploads.contains(key)) {
+        // A different version of the same file makes older partials useless
+        for (auto it = m_uploads.begin(); it != m_uploads.end();) {
+            if (it.key().startsWith(fileName + QLatin1Char('/')))
+                it = m_uploads.erase(it);
+            else
+                ++it;
+        }
+
+        Upload &upload = m_uploads[key];
+        upload.size = size;
+        upload.checksum = checksum;
+    } else {
+        qInfo() << "simulated player resuming" << fileName << "at" << m_uploads[key].data.size();
+    }
+
+    m_current->upload = key;
+    m_uploads[key].nakSent = false;
+    acknowledgeUpload(key);
+}
+
+void SimulatedPlayer::onChunk(std::uint64_t offset, std::uint32_t checksum, std::string_view data)
+{
+    const QString key = m_current->upload;
+    const auto it = m_uploads.find(key);
+    if (it == m_uploads.end()) {
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusRejected});
+        return;
+    }
+
+    Upload &upload = *it;
+    const std::uint64_t expected = std::uint64_t(upload.data.size());
+
+    // Sent again after a timeout, already here
+    if (offset < expected && offset + data.size() <= expected) {
+        acknowledgeUpload(key);
+        return;
+    }
+
+    if (offset != expected || expected + data.size() > upload.size
+            || protocolChecksum(data.data(), data.size()) != checksum) {
+        // Go back N: one request to rewind, then silence until the
+        // expected chunk shows up
+        if (!upload.nakSent) {
+            upload.nakSent = true;
+            reply({ProtocolOpcode::UploadAck, 0, expected, StatusCorrupt});
+        }
+        return;
+    }
+
+    upload.nakSent = false;
+    upload.data.append(data.data(), int(data.size()));
+    upload.received = protocolChecksum(data.data(), data.size(), upload.received);
+    acknowledgeUpload(key);
+}
+
+void SimulatedPlayer::acknowledgeUpload(const QString &key)
+{
+    Upload &upload = m_uploads[key];
+    const std::uint64_t received = std::uint64_t(upload.data.size());
+
+    if (received < upload.size) {
+        reply({ProtocolOpcode::UploadAck, 0, received, StatusOk});
+        return;
+    }
+
+    const QString name = key.section(QLatin1Char('/'), 0, -3);
+    if (upload.received != upload.checksum) {
+        qInfo() << "simulated player discarding corrupt upload" << name;
+        upload.data.clear();
+        upload.received = 0;
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusCorrupt});
+        return;
+    }
+
+    qInfo() << "simulated player received" << name << upload.size << "bytes";
+    m_assets.insert(name, qint64(upload.size));
+    m_uploads.remove(key);
+    m_current->upload.clear();
+    reply({ProtocolOpcode::UploadAck, 0, received, StatusOk});
+}
+
+void SimulatedPlayer::onRamp(unsigned int volume, std::uint32_t flags, std::uint64_t duration)
+{
+    if (flags & RampCancel) {
+        stopRamp(false);
+        return;
+    }
+
+    // Re-armed, a sleep timer fades on from here but still restores the
+    // volume the first one started from
+    if (!(m_rampTimer.isActive() && (flags & RampStopAtEnd) && (m_rampFlags & RampStopAtEnd)))
+        m_rampRestore = m_volume;
+
+    // A new ramp goes on from wherever the last one got to
+    m_volumeTimer.stop();
+    m_rampTimer.stop();
+    m_rampStart = clock();
+    m_rampDuration = duration;
+    m_rampFrom = m_volume;
+    m_rampTo = qMin(volume, 100U);
+    m_rampFlags = flags;
+
+    qInfo() << "simulated player ramping from" << m_rampFrom << "to" << m_rampTo << "in" << duration / 1000 << "ms";
+    broadcast(rampState());
+
+    m_rampTimer.start();
+    stepRamp();
+}
+
+void SimulatedPlayer::stepRamp()
+{
+    const std::uint64_t elapsed = clock() - m_rampStart;
+    const unsigned int volume = protocolRampVolume(m_rampFrom, m_rampTo, m_rampFlags, elapsed, m_rampDuration);
+
+    if (elapsed < m_rampDuration) {
+        // Steps aren't events, only the end is
+        m_volume = volume;
+        return;
+    }
+
+    m_rampTimer.stop();
+    if (m_rampFlags & RampStopAtEnd) {
+        m_playTimer.stop();
+        m_playAt = 0;
+        m_playing = false;
+        broadcastState({ProtocolOpcode::Stopped});
+    }
+    applyVolume(m_rampFlags & RampStopAtEnd && m_rampFlags & RampRestoreVolume ? m_rampRestore : volume);
+}
+
+void SimulatedPlayer::stopRamp(bool restore)
+{
+    if (!m_rampTimer.isActive())
+        return;
+
+    m_rampTimer.stop();
+    applyVolume(restore && (m_rampFlags & RampRestoreVolume) ? m_rampRestore : m_volume);
+}
+
+ProtocolMessage SimulatedPlayer::rampState() const
+{
+    const std::uint64_t elapsed = clock() - m_rampStart;
+    ProtocolMessage ramping{ProtocolOpcode::Ramping, 0, m_rampTo, m_rampFlags};
+    ramping.times[0] = elapsed < m_rampDuration ? m_rampDuration - elapsed : 0;
+    return ramping;
+}
+
+void SimulatedPlayer::startPlaying()
+{
+    if (m_playAt) {
+        qInfo() << "simulated player started" << qint64(clock() - m_playAt) << "usec after the requested time";
+        m_playAt = 0;
+    }
+
+    m_playing = true;
+    broadcastState({ProtocolOpcode::Playing});
+}
+
+void SimulatedPlayer::applyVolume(unsigned int volume)
+{
+    m_volume = qMin(volume, 100U);
+    broadcastState({ProtocolOpcode::Volume, 0, m_volume});
+}
+
+void SimulatedPlayer::onUnrecognized(std::string_view raw)
+{
+    qInfo() << "simulated player ignoring"
+            << QByteArray::fromRawData(raw.data(), static_cast<int>(raw.size()));
+}
+
+void SimulatedPlayer::onSequenced(std::uint64_t sequence, bool handled)
+{
+    reply({ProtocolOpcode::Ack, 0, sequence, handled ? StatusOk : StatusRejected});
+}
@@ -0,0 +1,171 @@
+#ifndef SIMULATEDPLAYER_H
+#define SIMULATEDPLAYER_H
+
+#include "app-global.h"
+#include "protocol.h"
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+
+#include <functional>
+
+// In-process stand-in for a player, serving the player protocol on a local
+// socket so the app can be driven on a desktop without any Bluetooth radio.
+class SimulatedPlayer : public QObject, private PlayerCommandHandler
+{
+    Q_OBJECT
+
+public:
+    explicit SimulatedPlayer(QObject *parent = nullptr);
+    ~SimulatedPlayer();
+
+    bool listen(const QString &name = QString(PLAYER_LOCAL_NAME));
+    QString serverName() const;
+
+    // Makes the link slower and the player's clock disagree with ours, to
+    // exercise clock estimation. delay is one way, in ms, and up to jitter
+    // ms more is added at random; by default jitter is as much as delay.
+    void setLinkDelay(int delay, int jitter = -1);
+    void setClockOffset(qint64 usec);
+
+    // Link impairments for load testing. bandwidth caps each direction, in
+    // bytes per second, 0 for no cap. rate is the share of replies and
+    // events that are lost, which to the controller looks the same as a
+    // lost command. With an interval set, every client is cut off at random
+    // times averaging interval ms.
+    void setBandwidth(int bytesPerSecond);
+    void setDropRate(qreal rate);
+    void setDisconnectInterval(int interval);
+
+    // How many speakers a SCAN reports, 0 for the two built-in ones
+    void setScanResults(int count);
+    // Event floods: count BT_DEVICE reports, or count VOL changes in a row
+    void floodDevices(int count);
+    void floodVolume(int count);
+
+private:
+    struct Client {
+        QLocalSocket *socket = nullptr;
+        QByteArray readBuffer;
+        bool binaryFraming = false;
+        bool stateVersions = false;
+        // Understands RAMPING, see CapVolumeRamp
+        bool volumeRamps = false;
+        // Key of the upload in m_uploads this client is sending
+        QString upload;
+        // When the last delayed read / write is due, keeps them in order
+        qint64 inputDue = 0;
+        qint64 outputDue = 0;
+    };
+
+    // An upload as far as it got, kept across reconnects
+    struct Upload {
+        QByteArray data;
+        std::uint64_t size = 0;
+        std::uint32_t checksum = 0;
+        // Checksum of data so far
+        std::uint32_t received = 0;
+        // A StatusCorrupt went out, the rest of the window is ignored quietly
+        bool nakSent = false;
+    };
+
+    // Uploads larger than this are refused
+    static const int MaxUploadSize = 16 * 1024 * 1024;
+
+    QLocalServer m_server;
+    QList<Client*> m_clients;
+    // Client whose input is being dispatched
+    Client *m_current = nullptr;
+
+    unsigned int m_volume = 50;
+    bool m_playing = false;
+    std::uint64_t m_speakerAddress = 0;
+
+    // State events kept for GET_STATE replays
+    static const int StateHistorySize = 32;
+    std::uint64_t m_stateVersion = 0;
+    QQueue<ProtocolMessage> m_stateHistory;
+
+    // Unfinished uploads by name, size and checksum
+    QHash<QString, Upload> m_uploads;
+    // Finished ones by name, the size
+    QHash<QString, qint64> m_assets;
+
+    int m_linkDelay = 0;
+    int m_linkJitter = 0;
+    int m_bandwidth = 0;
+    qreal m_dropRate = 0;
+    int m_disconnectInterval = 0;
+    QTimer m_disconnectTimer;
+    int m_scanResults = 0;
+    qint64 m_clockOffset = 0;
+    QTimer m_playTimer;
+    // Player clock time of the pending PLAY_AT, 0 if none
+    std::uint64_t m_playAt = 0;
+    QTimer m_volumeTimer;
+    unsigned int m_scheduledVolume = 0;
+
+    // Steps of a running RAMP
+    static const int RampStepInterval = 50;
+    QTimer m_rampTimer;
+    // Player clock time the ramp started at, duration in usec
+    std::uint64_t m_rampStart = 0;
+    std::uint64_t m_rampDuration = 0;
+    unsigned int m_rampFrom = 0;
+    unsigned int m_rampTo = 0;
+    // Volume a StopAtEnd ramp puts back, kept when another one replaces it
+    unsigned int m_rampRestore = 0;
+    std::uint32_t m_rampFlags = 0;
+
+    // The player's own clock, in usec
+    std::uint64_t clock() const;
+    // Runs work once bytes have crossed the link, unless the client is gone
+    // by then
+    void delayed(Client *client, qint64 &due, int bytes, const std::function<void()> &work);
+    void scheduleDisconnect();
+    void disconnectClients();
+    // Milliseconds until time on the player's clock
+    int msecsUntil(std::uint64_t time) const;
+    void startPlaying();
+    void applyVolume(unsigned int volume);
+    void stepRamp();
+    // Ends a running ramp where it is, restore as with RampRestoreVolume
+    void stopRamp(bool restore);
+    // RAMPING for the running ramp, with what is left of it
+    ProtocolMessage rampState() const;
+    // Acknowledges the upload's progress; a complete one is checked and
+    // either kept or thrown away
+    void acknowledgeUpload(const QString &key);
+
+    void acceptClient();
+    void readClient(Client *client, const QByteArray &data);
+    void reply(const ProtocolMessage &message);
+    void broadcast(const ProtocolMessage &message);
+    // Numbers a state change and sends it to every client
+    void broadcastState(ProtocolMessage message);
+    void send(Client *client, const ProtocolMessage &message);
+
+    void onHello(unsigned int version, std::uint32_t capabilities) override;
+    void onScan() override;
+    void onConnectSpeaker(std::uint64_t address) override;
+    void onUnpairSpeaker() override;
+    void onPlay() override;
+    void onStop() override;
+    void onSetVolume(unsigned int volume) override;
+    void onTimeRequest(std::uint64_t origin) override;
+    void onPlayAt(std::uint64_t time) override;
+    void onSetVolumeAt(unsigned int volume, std::uint64_t time) override;
+    void onGetState(std::uint64_t since) override;
+    void onUpload(std::uint64_t size, std::uint32_t checksum, std::string_view name) override;
+    void onChunk(std::uint64_t offset, std::uint32_t checksum, std::string_view data) override;
+    void onRamp(unsigned int volume, std::uint32_t flags, std::uint64_t duration) override;
+    void onUnrecognized(std::string_view raw) override;
+    void onSequenced(std::uint64_t sequence, bool handled) override;
+};
+
+#endif // SIMULATEDPLAYER_H
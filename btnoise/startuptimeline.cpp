@@ -0,0 +1,84 @@
+#include "startuptimeline.h"
+#include "trace.h"
+
+#include <QElapsedTimer>
+
+namespace {
+
+// Started during static initialization, as close to process start as
+// portable code gets
+struct ProcessClock {
+    ProcessClock() { timer.start(); }
+    QElapsedTimer timer;
+};
+
+ProcessClock PROCESS_CLOCK;
+
+}
+
+StartupTimeline &StartupTimeline::instance()
+{
+    static StartupTimeline timeline;
+    return timeline;
+}
+
+StartupTimeline::StartupTimeline()
+{
+    for (auto &mark : m_marks)
+        mark.store(-1, std::memory_order_relaxed);
+    m_marks[ProcessStarted].store(0, std::memory_order_relaxed);
+}
+
+void StartupTimeline::mark(Milestone milestone)
+{
+    // Cheap enough for per-frame and per-read call sites once reached
+    if (m_marks[milestone].load(std::memory_order_relaxed) >= 0)
+        return;
+
+    const qint64 now = PROCESS_CLOCK.timer.elapsed();
+    qint64 expected = -1;
+    if (!m_marks[milestone].compare_exchange_strong(expected, now))
+        return;
+
+    QMetaObject::invokeMethod(this, [this, milestone, now]() {
+        qCInfo(lcUi) << "startup:" << milestoneName(milestone) << "after" << now << "ms";
+        emit changed();
+    }, Qt::QueuedConnection);
+}
+
+qint64 StartupTimeline::elapsed(Milestone milestone) const
+{
+    return m_marks[milestone].load(std::memory_order_relaxed);
+}
+
+QVariantMap StartupTimeline::toVariantMap() const
+{
+    QVariantMap result;
+    for (int i = 0; i < MilestoneCount; i++) {
+        const qint64 ms = elapsed(Milestone(i));
+        if (ms >= 0)
+            result.insert(QLatin1String(milestoneName(Milestone(i))), ms);
+    }
+    return result;
+}
+
+const char *StartupTimeline::milestoneName(Milestone milestone)
+{
+    switch (milestone) {
+    case ProcessStarted:
+        return "processStarted";
+    case ConnectStarted:
+        return "connectStarted";
+    case EngineLoaded:
+        return "engineLoaded";
+    case FirstFrame:
+        return "firstFrame";
+    case PlayerConnected:
+        return "connected";
+    case FirstState:
+        return "firstState";
+    case MilestoneCount:
+        break;
+    }
+    return "?";
+}
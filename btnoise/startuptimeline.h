@@ -0,0 +1,49 @@
+#ifndef STARTUPTIMELINE_H
+#define STARTUPTIMELINE_H
+
+#include <QObject>
+#include <QVariantMap>
+
+#include <array>
+#include <atomic>
+
+// When the steps from process start to a controllable player happened, in
+// milliseconds since the process started. Each milestone is recorded once,
+// the first time it is reached; later marks are ignored.
+class StartupTimeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Milestone {
+        ProcessStarted,
+        ConnectStarted,
+        EngineLoaded,
+        FirstFrame,
+        PlayerConnected,
+        FirstState,
+        MilestoneCount
+    };
+
+    static StartupTimeline &instance();
+
+    // Safe to call from any thread, the render thread marks FirstFrame
+    void mark(Milestone milestone);
+    // -1 until reached
+    qint64 elapsed(Milestone milestone) const;
+
+    // Milestone name -> ms, reached milestones only
+    QVariantMap toVariantMap() const;
+
+    static const char *milestoneName(Milestone milestone);
+
+signals:
+    void changed();
+
+private:
+    StartupTimeline();
+
+    std::array<std::atomic<qint64>, MilestoneCount> m_marks;
+};
+
+#endif // STARTUPTIMELINE_H
@@ -0,0 +1,66 @@
+#include "app-global.h"
+#include "tcptransport.h"
+
+TcpTransport::TcpTransport(QObject *parent) :
+    PlayerTransport(parent),
+    m_socket(this)
+{
+    connect(&m_socket, &QTcpSocket::connected, this, [this]() {
+        // Commands are a handful of bytes, don't let Nagle hold them back
+        m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        emit connected();
+    });
+    connect(&m_socket, &QTcpSocket::disconnected, this, &PlayerTransport::disconnected);
+    connect(&m_socket, &QTcpSocket::readyRead, this, &PlayerTransport::readyRead);
+    connect(&m_socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error),
+            [this]() {
+        emit errorOccurred(m_socket.errorString());
+    });
+}
+
+PlayerTransport::Kind TcpTransport::kind() const
+{
+    return Tcp;
+}
+
+PlayerTransport::State TcpTransport::state() const
+{
+    switch (m_socket.state()) {
+    case QAbstractSocket::ConnectedState:
+        return ConnectedState;
+    case QAbstractSocket::ClosingState:
+        return ClosingState;
+    case QAbstractSocket::UnconnectedState:
+        return UnconnectedState;
+    default:
+        return ConnectingState;
+    }
+}
+
+void TcpTransport::connectToPlayer(const QString &address)
+{
+    QString host = address;
+    quint16 port = PLAYER_TCP_PORT;
+
+    const int sep = address.lastIndexOf(QLatin1Char(':'));
+    if (sep > 0 && address.indexOf(QLatin1Char(':')) == sep) {
+        bool ok = false;
+        const quint16 p = address.midRef(sep + 1).toUShort(&ok);
+        if (ok) {
+            host = address.left(sep);
+            port = p;
+        }
+    }
+
+    m_socket.connectToHost(host, port);
+}
+
+void TcpTransport::close()
+{
+    m_socket.close();
+}
+
+QIODevice *TcpTransport::device()
+{
+    return &m_socket;
+}
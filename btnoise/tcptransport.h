@@ -0,0 +1,25 @@
+#ifndef TCPTRANSPORT_H
+#define TCPTRANSPORT_H
+
+#include "playertransport.h"
+
+#include <QTcpSocket>
+
+class TcpTransport : public PlayerTransport
+{
+    Q_OBJECT
+
+public:
+    explicit TcpTransport(QObject *parent = nullptr);
+
+    Kind kind() const override;
+    State state() const override;
+    void connectToPlayer(const QString &address) override;
+    void close() override;
+    QIODevice *device() override;
+
+private:
+    QTcpSocket m_socket;
+};
+
+#endif // TCPTRANSPORT_H
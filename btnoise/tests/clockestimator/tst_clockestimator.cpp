@@ -0,0 +1,167 @@
+#include "clockestimator.h"
+#include "playersession.h"
+#include "simulatedplayer.h"
+#include "metrics.h"
+
+#include <QtTest>
+#include <QLoggingCategory>
+
+#include <cmath>
+
+namespace {
+
+const std::int64_t Offset = 1000000;
+
+// One exchange over a link taking up and down usec each way, with the
+// player offset usec ahead of us
+bool exchange(ClockEstimator &clock, std::int64_t t1, std::int64_t offset,
+              std::int64_t up, std::int64_t down, std::int64_t processing = 100)
+{
+    const std::int64_t t2 = t1 + up + offset;
+    const std::int64_t t3 = t2 + processing;
+    const std::int64_t t4 = t1 + up + processing + down;
+    return clock.addSample(t1, t2, t3, t4);
+}
+
+}
+
+class ClockEstimatorTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void rejectsInconsistentSamples();
+    void ignoresSlowRoundTrips();
+    void takesMedianOffset();
+    void fitsDrift();
+    void capsDrift();
+    void synchronizesWithSimulatedPlayer();
+};
+
+void ClockEstimatorTest::initTestCase()
+{
+    QLoggingCategory::setFilterRules(QStringLiteral("btnoise.*=false"));
+}
+
+void ClockEstimatorTest::rejectsInconsistentSamples()
+{
+    ClockEstimator clock;
+
+    // Reply received before the request was sent
+    QVERIFY(!clock.addSample(100, 0, 0, 50));
+    // The player took longer than the whole round trip
+    QVERIFY(!clock.addSample(0, 1000, 2000, 500));
+
+    QCOMPARE(clock.sampleCount(), std::size_t(0));
+    QVERIFY(!clock.isSynchronized());
+}
+
+void ClockEstimatorTest::ignoresSlowRoundTrips()
+{
+    ClockEstimator clock;
+
+    // Every third reply is held up on the way back, as by a retransmission,
+    // which alone would put the offset almost 100 ms off
+    std::int64_t t = 0;
+    for (int i = 0; i < 12; i++) {
+        QVERIFY(exchange(clock, t, Offset, 5000, i % 3 == 2 ? 200000 : 5000));
+        t += 100000;
+    }
+
+    QVERIFY(clock.isSynchronized());
+    QCOMPARE(clock.delay(), std::int64_t(10000));
+    QCOMPARE(clock.offset(), Offset);
+}
+
+void ClockEstimatorTest::takesMedianOffset()
+{
+    ClockEstimator clock;
+
+    // All within the trusted spread, each off by half its asymmetry: 0,
+    // +200, -200, 0 and +2500 usec. The mean would be 500 off.
+    const std::int64_t links[][2] = {
+        { 5000, 5000 }, { 5400, 5000 }, { 5000, 5400 }, { 5000, 5000 }, { 10000, 5000 }
+    };
+
+    std::int64_t t = 0;
+    for (const auto &link : links) {
+        QVERIFY(exchange(clock, t, Offset, link[0], link[1]));
+        t += 100000;
+    }
+
+    QCOMPARE(clock.offset(), Offset);
+    // Too short a span for drift
+    QCOMPARE(clock.drift(), 0.0);
+}
+
+void ClockEstimatorTest::fitsDrift()
+{
+    ClockEstimator clock;
+
+    // The player clock runs 100 ppm fast, sampled once a second for 20 s
+    const double ppm = 100;
+    std::int64_t t = 0;
+    for (int i = 0; i <= 20; i++) {
+        QVERIFY(exchange(clock, t, Offset + std::llround(ppm * 1e-6 * double(t)), 5000, 5000));
+        t += 1000000;
+    }
+
+    QVERIFY(qAbs(clock.drift() - ppm) < 0.5);
+
+    // Carried forward, not just the offset at the newest sample
+    const std::int64_t later = t + 5000000;
+    const std::int64_t expected = Offset + std::llround(ppm * 1e-6 * double(later));
+    QVERIFY2(qAbs(clock.offsetAt(later) - expected) < 10,
+             qPrintable(QStringLiteral("%1 vs %2").arg(clock.offsetAt(later)).arg(expected)));
+}
+
+void ClockEstimatorTest::capsDrift()
+{
+    ClockEstimator clock;
+
+    // 2000 ppm is no crystal, the fit is dropped for the median offset
+    std::int64_t t = 0;
+    for (int i = 0; i <= 20; i++) {
+        QVERIFY(exchange(clock, t, Offset + std::llround(2000e-6 * double(t)), 5000, 5000));
+        t += 1000000;
+    }
+
+    QCOMPARE(clock.drift(), 0.0);
+    QCOMPARE(clock.offset(), Offset + 20000);
+}
+
+void ClockEstimatorTest::synchronizesWithSimulatedPlayer()
+{
+    // Each way takes 10 to 20 ms, drawn apart for every message, so most
+    // exchanges are lopsided by up to 10 ms
+    const qint64 offset = 3500000;
+    SimulatedPlayer player;
+    player.setLinkDelay(10, 10);
+    player.setClockOffset(offset);
+
+    const QString name = QStringLiteral("btnoise-test-%1").arg(QCoreApplication::applicationPid());
+    QVERIFY(player.listen(name));
+
+    Metrics metrics;
+    PlayerSession session(name, QStringLiteral("test"), PlayerTransport::Local, &metrics);
+    session.open();
+
+    QTRY_VERIFY(session.isClockSynchronized());
+    // The whole burst, after which sampling slows down
+    QTRY_VERIFY(session.clock().sampleCount() >= std::size_t(PlayerSession::TimeSyncBurstSize));
+
+    // No better than the link's minimum round trip
+    QVERIFY(session.clock().delay() >= 20000);
+
+    // A trusted exchange is off by at most half the jitter; the rest is
+    // timer slack on either side
+    const qint64 error = session.clock().offset() - offset;
+    QVERIFY2(qAbs(error) <= 7000, qPrintable(QStringLiteral("offset off by %1 usec").arg(error)));
+
+    session.close();
+}
+
+QTEST_GUILESS_MAIN(ClockEstimatorTest)
+
+#include "tst_clockestimator.moc"
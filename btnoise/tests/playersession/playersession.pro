@@ -0,0 +1,46 @@
+# Session behaviour against a scripted player, see tst_playersession.cpp
+TEMPLATE = app
+TARGET = tst_playersession
+
+QT += testlib bluetooth network
+QT -= gui
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+APP = $$PWD/../..
+INCLUDEPATH += $$APP
+
+HEADERS += \
+        $$APP/playertransport.h \
+        $$APP/rfcommtransport.h \
+        $$APP/tcptransport.h \
+        $$APP/localtransport.h \
+        $$APP/protocol.h \
+        $$APP/clockestimator.h \
+        $$APP/outboundbuffer.h \
+        $$APP/commandtracker.h \
+        $$APP/offlinequeue.h \
+        $$APP/bulkupload.h \
+        $$APP/connectionstatemachine.h \
+        $$APP/playersession.h \
+        $$APP/trace.h \
+        $$APP/metrics.h \
+        $$APP/startuptimeline.h
+
+SOURCES += \
+        tst_playersession.cpp \
+        $$APP/playertransport.cpp \
+        $$APP/rfcommtransport.cpp \
+        $$APP/tcptransport.cpp \
+        $$APP/localtransport.cpp \
+        $$APP/protocol.cpp \
+        $$APP/clockestimator.cpp \
+        $$APP/outboundbuffer.cpp \
+        $$APP/commandtracker.cpp \
+        $$APP/offlinequeue.cpp \
+        $$APP/bulkupload.cpp \
+        $$APP/connectionstatemachine.cpp \
+        $$APP/playersession.cpp \
+        $$APP/trace.cpp \
+        $$APP/metrics.cpp \
+        $$APP/startuptimeline.cpp
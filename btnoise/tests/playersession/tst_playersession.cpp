@@ -0,0 +1,192 @@
+#include "protocol.h"
+#include "playersession.h"
+#include "metrics.h"
+
+#include <QtTest>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+
+#include <string>
+
+namespace {
+
+QByteArray encode(const ProtocolMessage &message)
+{
+    std::string encoded;
+    ProtocolWriter::encode(message, false, encoded);
+    return QByteArray(encoded.data(), int(encoded.size()));
+}
+
+ProtocolMessage numbered(ProtocolOpcode opcode, std::uint64_t sequence)
+{
+    ProtocolMessage message{opcode};
+    message.sequence = sequence;
+    return message;
+}
+
+ProtocolMessage setVolume(unsigned int volume, std::uint64_t sequence = 0)
+{
+    ProtocolMessage message{ProtocolOpcode::SetVolume};
+    message.value = volume;
+    message.sequence = sequence;
+    return message;
+}
+
+QString serverName()
+{
+    return QStringLiteral("btnoise-test-%1").arg(QCoreApplication::applicationPid());
+}
+
+}
+
+class PlayerSessionTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void disconnectDuringVolumeDrag_data();
+    void disconnectDuringVolumeDrag();
+    void stopAfterPlayLostWithLink();
+
+private:
+    // Accepts the session's connection as a stand-in player that offers
+    // acknowledgements but sends none, so commands stay in flight
+    void acceptPlayer(QLocalServer &server, PlayerSession &session, QLocalSocket *&player);
+    // Drops the link and keeps it down until listening again, a lost link
+    // is retried at once
+    void dropLink(QLocalServer &server, PlayerSession &session, QLocalSocket *player);
+};
+
+void PlayerSessionTest::initTestCase()
+{
+    QLoggingCategory::setFilterRules(QStringLiteral("btnoise.*=false"));
+}
+
+void PlayerSessionTest::acceptPlayer(QLocalServer &server, PlayerSession &session, QLocalSocket *&player)
+{
+    QTRY_VERIFY(server.hasPendingConnections());
+    player = server.nextPendingConnection();
+    QTRY_VERIFY(session.isConnected());
+
+    // Text only, with numbered commands. The VOL behind the HELLO tells
+    // when both have been read.
+    player->write(encode({ProtocolOpcode::Hello, 0, PROTOCOL_VERSION, CapAcknowledge}));
+    player->write(encode({ProtocolOpcode::Volume, 0, 50}));
+    QTRY_COMPARE(session.volume(), 50u);
+}
+
+void PlayerSessionTest::dropLink(QLocalServer &server, PlayerSession &session, QLocalSocket *player)
+{
+    server.close();
+    player->abort();
+    QTRY_VERIFY(!session.isConnected());
+}
+
+void PlayerSessionTest::disconnectDuringVolumeDrag_data()
+{
+    QTest::addColumn<bool>("heldBack");
+
+    QTest::newRow("last value in flight") << false;
+    QTest::newRow("last value held back") << true;
+}
+
+void PlayerSessionTest::disconnectDuringVolumeDrag()
+{
+    QFETCH(bool, heldBack);
+
+    QLocalServer server;
+    const QString name = serverName();
+    QLocalServer::removeServer(name);
+    QVERIFY(server.listen(name));
+
+    Metrics metrics;
+    PlayerSession session(name, QStringLiteral("test"), PlayerTransport::Local, &metrics);
+
+    session.open();
+    QLocalSocket *player = nullptr;
+    acceptPlayer(server, session, player);
+    if (QTest::currentTestFailed())
+        return;
+
+    // The first SET_VOL of the drag is still in flight when the link drops
+    QByteArray received;
+    session.setVolume(60);
+    QTRY_VERIFY((received += player->readAll()).contains(encode(setVolume(60, 1))));
+
+    const unsigned int last = heldBack ? 75 : 60;
+    if (heldBack) {
+        session.setVolume(70);
+        session.setVolume(75);
+    }
+
+    dropLink(server, session, player);
+    if (QTest::currentTestFailed())
+        return;
+
+    // The UI keeps what the user set, and it waits for the player
+    QCOMPARE(session.volume(), last);
+    QCOMPARE(session.toVariantMap().value(QStringLiteral("queuedCommands")).toInt(), 1);
+
+    QVERIFY(server.listen(name));
+    session.connectNow();
+    QTRY_VERIFY(server.hasPendingConnections());
+    player = server.nextPendingConnection();
+    QTRY_VERIFY(session.isConnected());
+
+    received.clear();
+    QTRY_VERIFY((received += player->readAll()).contains(encode(setVolume(last))));
+    QCOMPARE(received.count("SET_VOL"), 1);
+    QCOMPARE(session.volume(), last);
+
+    session.close();
+}
+
+void PlayerSessionTest::stopAfterPlayLostWithLink()
+{
+    QLocalServer server;
+    const QString name = serverName();
+    QLocalServer::removeServer(name);
+    QVERIFY(server.listen(name));
+
+    Metrics metrics;
+    PlayerSession session(name, QStringLiteral("test"), PlayerTransport::Local, &metrics);
+
+    session.open();
+    QLocalSocket *player = nullptr;
+    acceptPlayer(server, session, player);
+    if (QTest::currentTestFailed())
+        return;
+
+    // The player may have started playing, only the ACK is lost
+    QByteArray received;
+    session.play();
+    QTRY_VERIFY((received += player->readAll()).contains(encode(numbered(ProtocolOpcode::Play, 1))));
+
+    dropLink(server, session, player);
+    if (QTest::currentTestFailed())
+        return;
+
+    // The STOP replaces the PLAY that went out rather than cancelling it
+    session.stop();
+    QVERIFY(!session.playing());
+    QCOMPARE(session.toVariantMap().value(QStringLiteral("queuedCommands")).toInt(), 1);
+
+    QVERIFY(server.listen(name));
+    session.connectNow();
+    QTRY_VERIFY(server.hasPendingConnections());
+    player = server.nextPendingConnection();
+    QTRY_VERIFY(session.isConnected());
+
+    received.clear();
+    QTRY_VERIFY((received += player->readAll()).contains(encode({ProtocolOpcode::Stop})));
+    QCOMPARE(received.count("PLAY"), 0);
+    QVERIFY(!session.playing());
+
+    session.close();
+}
+
+QTEST_GUILESS_MAIN(PlayerSessionTest)
+
+#include "tst_playersession.moc"
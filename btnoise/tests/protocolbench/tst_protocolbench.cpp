@@ -0,0 +1,325 @@
+#include "protocol.h"
+#include "playersession.h"
+#include "metrics.h"
+
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Heap allocations made by the whole process, to check that parsing stays
+// off the heap
+static std::atomic<quint64> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace {
+
+// Traffic a controller sees from one player
+enum Mix {
+    // Clock pings and the odd state change while music plays
+    Playback,
+    // A volume slider drag: numbered VOL events and the ACKs for SET_VOL
+    Slider,
+    // A speaker scan reporting many named devices
+    Discovery
+};
+
+class CountingHandler : public PlayerEventHandler
+{
+public:
+    quint64 events = 0;
+    quint64 unrecognized = 0;
+
+    void onHello(unsigned int, std::uint32_t) override { events++; }
+    void onSpeakerDiscovered(std::uint64_t, std::string_view) override { events++; }
+    void onSpeakerConnected(std::uint64_t) override { events++; }
+    void onSpeakerDisconnected() override { events++; }
+    void onVolume(unsigned int) override { events++; }
+    void onPlaying() override { events++; }
+    void onStopped() override { events++; }
+    void onAck(std::uint64_t, std::uint32_t) override { events++; }
+    void onTimeReply(std::uint64_t, std::uint64_t, std::uint64_t) override { events++; }
+    void onState(std::uint64_t, unsigned int, bool, std::uint64_t) override { events++; }
+    void onUploadAck(std::uint64_t, std::uint32_t) override { events++; }
+    void onRamping(unsigned int, std::uint32_t, std::uint64_t) override { events++; }
+    void onUnrecognized(std::string_view) override { unrecognized++; }
+    void onStateVersion(std::uint64_t) override {}
+};
+
+ProtocolMessage message(ProtocolOpcode opcode, std::uint64_t value = 0, std::uint64_t sequence = 0)
+{
+    ProtocolMessage result;
+    result.opcode = opcode;
+    result.value = value;
+    result.sequence = sequence;
+    return result;
+}
+
+// count messages of the given mix, encoded as lines or frames
+std::string traffic(Mix mix, bool binary, int count)
+{
+    static const char *const names[] = { "Kitchen", "Living Room Speaker", "JBL Flip 4", "Bose Mini II SoundLink" };
+
+    std::string out;
+    std::uint64_t version = 1;
+    const std::uint64_t clock = 1000000000;
+
+    for (int i = 0; i < count; i++) {
+        ProtocolMessage next;
+
+        switch (mix) {
+        case Playback:
+            if (i % 8 == 7) {
+                next = message(i % 16 == 7 ? ProtocolOpcode::Playing : ProtocolOpcode::Stopped, 0, version++);
+            } else {
+                next = message(ProtocolOpcode::TimeReply);
+                next.times = { clock + 100000 * i, clock + 100000 * i + 2250, clock + 100000 * i + 2310 };
+            }
+            break;
+        case Slider:
+            if (i % 2)
+                next = message(ProtocolOpcode::Ack, i / 2 + 1);
+            else
+                next = message(ProtocolOpcode::Volume, i % 101, version++);
+            break;
+        case Discovery:
+            next = message(ProtocolOpcode::BtDevice);
+            next.address = 0x001A7DDA7100ull + i;
+            next.text = names[i % 4];
+            break;
+        }
+
+        ProtocolWriter::encode(next, binary, out);
+    }
+
+    return out;
+}
+
+const char *mixName(Mix mix)
+{
+    switch (mix) {
+    case Playback: return "playback";
+    case Slider: return "slider";
+    case Discovery: return "discovery";
+    }
+    return "";
+}
+
+void addMixRows()
+{
+    QTest::addColumn<int>("mix");
+    QTest::addColumn<bool>("binary");
+
+    for (Mix mix : { Playback, Slider, Discovery }) {
+        QTest::newRow(qPrintable(QStringLiteral("%1 text").arg(mixName(mix)))) << int(mix) << false;
+        QTest::newRow(qPrintable(QStringLiteral("%1 frames").arg(mixName(mix)))) << int(mix) << true;
+    }
+}
+
+quint64 bytesReceived(const Metrics &metrics)
+{
+    return metrics.snapshot().value(QStringLiteral("link")).toMap().value(QStringLiteral("bytesReceived")).toULongLong();
+}
+
+}
+
+// Numbers for the player link: time per parsed line, heap allocations per
+// line and bytes in to signals out through a PlayerSession. Run with
+// -tickcounter or -perf for steadier parser numbers than the default wall
+// clock.
+class ProtocolBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void parseLine_data();
+    void parseLine();
+    void parseMix_data();
+    void parseMix();
+    void allocationsPerLine_data();
+    void allocationsPerLine();
+    void sessionThroughput_data();
+    void sessionThroughput();
+};
+
+void ProtocolBench::initTestCase()
+{
+    // Measure the session, not the logging
+    QLoggingCategory::setFilterRules(QStringLiteral("btnoise.*=false"));
+}
+
+void ProtocolBench::parseLine_data()
+{
+    QTest::addColumn<QByteArray>("line");
+
+    ProtocolMessage device = message(ProtocolOpcode::BtDevice);
+    device.address = 0x001A7DDA7101ull;
+    device.text = "Living Room Speaker";
+
+    ProtocolMessage timeReply = message(ProtocolOpcode::TimeReply);
+    timeReply.times = { 1000000000, 1000002250, 1000002310 };
+
+    ProtocolMessage state = message(ProtocolOpcode::State, 1234, 1234);
+    state.flags = StatePlaying | (42u << StateVolumeShift);
+    state.address = 0x001A7DDA7101ull;
+
+    const std::vector<std::pair<const char *, ProtocolMessage>> messages = {
+        { "VOL", message(ProtocolOpcode::Volume, 42) },
+        { "VOL numbered", message(ProtocolOpcode::Volume, 42, 1234) },
+        { "PLAYING", message(ProtocolOpcode::Playing) },
+        { "ACK", message(ProtocolOpcode::Ack, 1234) },
+        { "BT_DEVICE", device },
+        { "TIME_REPLY", timeReply },
+        { "STATE", state }
+    };
+
+    for (const auto &entry : messages) {
+        for (bool binary : { false, true }) {
+            std::string encoded;
+            ProtocolWriter::encode(entry.second, binary, encoded);
+            QTest::newRow(qPrintable(QStringLiteral("%1 %2").arg(entry.first, binary ? "frame" : "text")))
+                << QByteArray(encoded.data(), int(encoded.size()));
+        }
+    }
+
+    QTest::newRow("unknown text") << QByteArray("FIRMWARE_UPDATE,3,1\n");
+    QTest::newRow("bare VOL") << QByteArray("VOL\n");
+}
+
+void ProtocolBench::parseLine()
+{
+    QFETCH(QByteArray, line);
+
+    CountingHandler handler;
+    QCOMPARE(ProtocolParser::parse(line.constData(), std::size_t(line.size()), handler), std::size_t(line.size()));
+
+    QBENCHMARK {
+        ProtocolParser::parse(line.constData(), std::size_t(line.size()), handler);
+    }
+}
+
+void ProtocolBench::parseMix_data()
+{
+    addMixRows();
+}
+
+void ProtocolBench::parseMix()
+{
+    QFETCH(int, mix);
+    QFETCH(bool, binary);
+
+    // One iteration is 1000 messages, the result is also ns per 1000 lines
+    const std::string stream = traffic(Mix(mix), binary, 1000);
+
+    CountingHandler handler;
+    QCOMPARE(ProtocolParser::parse(stream.data(), stream.size(), handler), stream.size());
+    QCOMPARE(handler.events, quint64(1000));
+    QCOMPARE(handler.unrecognized, quint64(0));
+
+    QBENCHMARK {
+        ProtocolParser::parse(stream.data(), stream.size(), handler);
+    }
+}
+
+void ProtocolBench::allocationsPerLine_data()
+{
+    addMixRows();
+}
+
+void ProtocolBench::allocationsPerLine()
+{
+    QFETCH(int, mix);
+    QFETCH(bool, binary);
+
+    const int count = 1000;
+    const std::string stream = traffic(Mix(mix), binary, count);
+    CountingHandler handler;
+
+    const quint64 before = allocations.load();
+    ProtocolParser::parse(stream.data(), stream.size(), handler);
+    const quint64 allocated = allocations.load() - before;
+
+    QTest::setBenchmarkResult(qreal(allocated) / count, QTest::Events);
+    QCOMPARE(allocated, quint64(0));
+}
+
+void ProtocolBench::sessionThroughput_data()
+{
+    addMixRows();
+}
+
+void ProtocolBench::sessionThroughput()
+{
+    QFETCH(int, mix);
+    QFETCH(bool, binary);
+
+    // A stand-in player on a local socket, writing as fast as it can
+    QLocalServer server;
+    const QString name = QStringLiteral("btnoise-bench-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+    QVERIFY(server.listen(name));
+
+    Metrics metrics;
+    PlayerSession session(name, QStringLiteral("bench"), PlayerTransport::Local, &metrics);
+
+    quint64 signalsOut = 0;
+    const auto count = [&signalsOut]() { signalsOut++; };
+    connect(&session, &PlayerSession::volumeChanged, this, count);
+    connect(&session, &PlayerSession::playingChanged, this, count);
+    connect(&session, &PlayerSession::speakerConnectedChanged, this, count);
+    connect(&session, &PlayerSession::speakerDiscovered, this, count);
+
+    session.open();
+    QTRY_VERIFY(server.hasPendingConnections());
+    QLocalSocket *player = server.nextPendingConnection();
+    QTRY_VERIFY(session.isConnected());
+
+    const std::string chunk = traffic(Mix(mix), binary, 1000);
+    const int rounds = 100;
+    const quint64 total = quint64(chunk.size()) * rounds;
+    const quint64 start = bytesReceived(metrics);
+    signalsOut = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < rounds; i++)
+        player->write(chunk.data(), qint64(chunk.size()));
+    QTRY_VERIFY_WITH_TIMEOUT(bytesReceived(metrics) - start >= total, 30000);
+    const qint64 elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+
+    QTest::setBenchmarkResult(qreal(total) * 1e9 / elapsed, QTest::BytesPerSecond);
+    qInfo("%llu bytes, %d messages, %llu signals in %.1f ms", total, rounds * 1000, signalsOut, elapsed / 1e6);
+    QVERIFY(signalsOut > 0);
+
+    session.close();
+}
+
+QTEST_GUILESS_MAIN(ProtocolBench)
+
+#include "tst_protocolbench.moc"
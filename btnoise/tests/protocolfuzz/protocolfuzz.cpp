@@ -0,0 +1,217 @@
+#include "protocol.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// libFuzzer target over the inbound byte stream, either direction. The first
+// input byte picks the direction and how the rest is cut into reads; the
+// stream is then fed to the parser the way PlayerSession::readServer does it:
+// append, parse, keep the unconsumed tail for the next read.
+//
+// Beyond not crashing, the parser must never consume more than it was given,
+// every view it hands out must point into the buffer, the events must not
+// depend on how the stream was split into reads, and every message must
+// survive being encoded again in the form it arrived in.
+
+namespace {
+
+[[noreturn]] void fail(const char *what)
+{
+    std::fprintf(stderr, "protocolfuzz: %s\n", what);
+    std::abort();
+}
+
+bool sameMessage(const ProtocolMessage &a, const ProtocolMessage &b)
+{
+    return a.opcode == b.opcode && a.address == b.address && a.value == b.value && a.flags == b.flags
+        && a.text == b.text && a.sequence == b.sequence && a.times == b.times;
+}
+
+// Decoding, encoding and decoding again must give the same message
+void checkRoundTrip(std::string_view raw, bool binary)
+{
+    ProtocolMessage first;
+    const bool decoded = binary ? ProtocolParser::decodeFrame(raw, first) : ProtocolParser::decodeLine(raw, first);
+    if (!decoded)
+        return;
+
+    std::string encoded;
+    ProtocolWriter::encode(first, binary, encoded);
+    if (encoded.empty())
+        fail("decoded message doesn't encode");
+
+    std::string_view again(encoded);
+    if (binary) {
+        std::uint64_t length = 0;
+        const std::size_t prefix = ProtocolParser::readVarint(encoded.data() + 1, encoded.size() - 1, length);
+        if (static_cast<unsigned char>(encoded[0]) != FRAME_MARKER || !prefix || 1 + prefix + length != encoded.size())
+            fail("bad frame header");
+        again = again.substr(1 + prefix);
+    } else {
+        if (encoded.back() != '\n')
+            fail("line not terminated");
+        again.remove_suffix(1);
+    }
+
+    ProtocolMessage second;
+    const bool redecoded = binary ? ProtocolParser::decodeFrame(again, second) : ProtocolParser::decodeLine(again, second);
+    if (!redecoded || !sameMessage(first, second))
+        fail("message changed in a round trip");
+}
+
+// Writes what it sees into a log, so runs can be compared
+class Recorder
+{
+public:
+    std::string log;
+
+    void setBuffer(const char *data, std::size_t size)
+    {
+        m_begin = data;
+        m_end = data + size;
+    }
+
+protected:
+    void view(std::string_view text)
+    {
+        if (!text.empty() && (text.data() < m_begin || text.data() + text.size() > m_end))
+            fail("view outside the buffer");
+        log.append(text);
+        log += '|';
+    }
+
+    void event(char kind, std::uint64_t a = 0, std::uint64_t b = 0, std::uint64_t c = 0, std::uint64_t d = 0)
+    {
+        log += kind;
+        log += std::to_string(a) + ',' + std::to_string(b) + ',' + std::to_string(c) + ',' + std::to_string(d) + ';';
+    }
+
+private:
+    const char *m_begin = nullptr;
+    const char *m_end = nullptr;
+};
+
+class EventRecorder : public Recorder, public PlayerEventHandler
+{
+public:
+    void onHello(unsigned int version, std::uint32_t capabilities) override { event('H', version, capabilities); }
+    void onSpeakerDiscovered(std::uint64_t address, std::string_view name) override { event('D', address); view(name); }
+    void onSpeakerConnected(std::uint64_t address) override { event('C', address); }
+    void onSpeakerDisconnected() override { event('d'); }
+    void onVolume(unsigned int volume) override { event('V', volume); }
+    void onPlaying() override { event('P'); }
+    void onStopped() override { event('S'); }
+    void onAck(std::uint64_t sequence, std::uint32_t status) override { event('A', sequence, status); }
+    void onTimeReply(std::uint64_t origin, std::uint64_t receive, std::uint64_t transmit) override { event('T', origin, receive, transmit); }
+    void onState(std::uint64_t version, unsigned int volume, bool playing, std::uint64_t speakerAddress) override { event('X', version, volume, playing, speakerAddress); }
+    void onUploadAck(std::uint64_t offset, std::uint32_t status) override { event('u', offset, status); }
+    void onRamping(unsigned int volume, std::uint32_t flags, std::uint64_t remaining) override { event('R', volume, flags, remaining); }
+    void onUnrecognized(std::string_view line) override { event('?'); view(line); }
+    void onStateVersion(std::uint64_t version) override { event('#', version); }
+};
+
+class CommandRecorder : public Recorder, public PlayerCommandHandler
+{
+public:
+    void onHello(unsigned int version, std::uint32_t capabilities) override { event('H', version, capabilities); }
+    void onScan() override { event('s'); }
+    void onConnectSpeaker(std::uint64_t address) override { event('C', address); }
+    void onUnpairSpeaker() override { event('U'); }
+    void onPlay() override { event('P'); }
+    void onStop() override { event('S'); }
+    void onSetVolume(unsigned int volume) override { event('V', volume); }
+    void onTimeRequest(std::uint64_t origin) override { event('T', origin); }
+    void onPlayAt(std::uint64_t time) override { event('p', time); }
+    void onSetVolumeAt(unsigned int volume, std::uint64_t time) override { event('v', volume, time); }
+    void onGetState(std::uint64_t since) override { event('G', since); }
+    void onUpload(std::uint64_t size, std::uint32_t checksum, std::string_view name) override { event('L', size, checksum); view(name); }
+    void onChunk(std::uint64_t offset, std::uint32_t checksum, std::string_view data) override { event('K', offset, checksum); view(data); }
+    void onRamp(unsigned int volume, std::uint32_t flags, std::uint64_t duration) override { event('r', volume, flags, duration); }
+    void onUnrecognized(std::string_view line) override { event('?'); view(line); }
+    void onSequenced(std::uint64_t sequence, bool handled) override { event('#', sequence, handled); }
+};
+
+template<typename Handler>
+std::size_t parseAll(const char *data, std::size_t size, Handler &handler)
+{
+    handler.setBuffer(data, size);
+    const std::size_t consumed = ProtocolParser::parse(data, size, handler);
+    if (consumed > size)
+        fail("consumed more than given");
+    return consumed;
+}
+
+template<typename Handler>
+void run(const char *data, std::size_t size, std::uint32_t seed)
+{
+    Handler whole;
+    const std::size_t consumed = parseAll(data, size, whole);
+
+    // The same bytes again, in reads of 1 to 64 bytes
+    Handler pieces;
+    std::string buffer;
+    std::size_t offset = 0;
+    while (offset < size) {
+        seed = seed * 1103515245u + 12345u;
+        const std::size_t chunk = std::min<std::size_t>(1 + (seed >> 16) % 64, size - offset);
+        buffer.append(data + offset, chunk);
+        offset += chunk;
+
+        buffer.erase(0, parseAll(buffer.data(), buffer.size(), pieces));
+    }
+
+    if (pieces.log != whole.log || buffer.size() != size - consumed)
+        fail("result depends on how the stream was split");
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size)
+{
+    if (size < 1)
+        return 0;
+
+    const std::uint8_t mode = data[0];
+    const char *stream = reinterpret_cast<const char *>(data + 1);
+
+    // The first line, or the whole input as one frame body
+    const std::string_view message(stream, size - 1);
+    checkRoundTrip(mode & 2 ? message : message.substr(0, message.find('\n')), mode & 2);
+
+    if (mode & 1)
+        run<CommandRecorder>(stream, size - 1, mode >> 1);
+    else
+        run<EventRecorder>(stream, size - 1, mode >> 1);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+// Without libFuzzer: replays the given files, e.g. the seed corpus or a
+// crash reproducer, so the target also builds and runs with gcc.
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        FILE *file = std::fopen(argv[i], "rb");
+        if (!file) {
+            std::fprintf(stderr, "protocolfuzz: can't open %s\n", argv[i]);
+            return 1;
+        }
+
+        std::string input;
+        char chunk[4096];
+        std::size_t read;
+        while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+            input.append(chunk, read);
+        std::fclose(file);
+
+        LLVMFuzzerTestOneInput(reinterpret_cast<const std::uint8_t *>(input.data()), input.size());
+        std::printf("%s: ok\n", argv[i]);
+    }
+    return 0;
+}
+#endif
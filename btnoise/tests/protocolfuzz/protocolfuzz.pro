@@ -0,0 +1,29 @@
+# Fuzz target for the protocol parser, plain C++ like the parser itself.
+#
+#     qmake CONFIG+=libfuzzer QMAKE_CXX=clang++ QMAKE_LINK=clang++ && make
+#     mkdir findings && ./protocolfuzz -max_len=4096 findings corpus
+#
+# Without CONFIG+=libfuzzer this builds a driver that replays the files given
+# on the command line; make check runs it over the seed corpus.
+TEMPLATE = app
+TARGET = protocolfuzz
+
+CONFIG += c++17 console
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += $$PWD/../..
+
+HEADERS += $$PWD/../../protocol.h
+SOURCES += \
+        protocolfuzz.cpp \
+        $$PWD/../../protocol.cpp
+
+libfuzzer {
+    QMAKE_CXXFLAGS += -fsanitize=fuzzer,address,undefined
+    QMAKE_LFLAGS += -fsanitize=fuzzer,address,undefined
+    check.commands = ./$$TARGET -runs=0 $$PWD/corpus
+} else {
+    DEFINES += FUZZ_STANDALONE
+    check.commands = ./$$TARGET $$files($$PWD/corpus/*)
+}
+QMAKE_EXTRA_TARGETS += check
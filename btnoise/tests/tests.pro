@@ -0,0 +1,11 @@
+# Tests, benchmarks and fuzzing for the player protocol, built apart from the
+# app:
+#
+#     qmake tests.pro && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS = \
+        clockestimator \
+        playersession \
+        protocolbench \
+        protocolfuzz
@@ -0,0 +1,51 @@
+#include "playerdaemon.h"
+#include "app-global.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+// Headless player serving controllers over TCP, RFCOMM and local sockets.
+//
+//     playerd                      TCP on the default port
+//     playerd --rfcomm --no-tcp    Bluetooth only
+//     playerd --local              for the desktop app's --transport local
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("playerd"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Reference btnoise player."));
+    parser.addHelpOption();
+
+    QCommandLineOption portOption("port", "TCP port.", "port", QString::number(PLAYER_TCP_PORT));
+    QCommandLineOption noTcpOption("no-tcp", "Don't listen on TCP.");
+    QCommandLineOption rfcommOption("rfcomm", "Register the player service on RFCOMM.");
+    QCommandLineOption serviceNameOption("service-name", "RFCOMM service name.", "name", "btnoise player");
+    QCommandLineOption localOption("local", "Listen on the local socket for the desktop app.");
+    QCommandLineOption localNameOption("local-name", "Local socket name.", "name", PLAYER_LOCAL_NAME);
+    QCommandLineOption assetsOption("assets", "Directory for uploaded files.", "dir");
+    parser.addOptions({ portOption, noTcpOption, rfcommOption, serviceNameOption, localOption, localNameOption, assetsOption });
+    parser.process(app);
+
+    PlayerDaemon daemon;
+    if (parser.isSet(assetsOption))
+        daemon.setAssetDirectory(parser.value(assetsOption));
+
+    bool listening = false;
+    if (!parser.isSet(noTcpOption))
+        listening |= daemon.listenTcp(quint16(parser.value(portOption).toUInt()));
+    if (parser.isSet(rfcommOption))
+        listening |= daemon.listenRfcomm(parser.value(serviceNameOption));
+    if (parser.isSet(localOption) || parser.isSet(localNameOption))
+        listening |= daemon.listenLocal(parser.value(localNameOption));
+
+    if (!listening) {
+        qWarning() << "nothing to serve on";
+        return 1;
+    }
+
+    return app.exec();
+}
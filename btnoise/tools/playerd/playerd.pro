@@ -0,0 +1,23 @@
+# Reference player daemon, see playerdaemon.h
+TEMPLATE = app
+TARGET = playerd
+
+QT += bluetooth network
+QT -= gui
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+APP = $$PWD/../..
+INCLUDEPATH += $$APP
+
+HEADERS += \
+        playerdaemon.h \
+        $$APP/app-global.h \
+        $$APP/protocol.h \
+        $$APP/clockestimator.h
+
+SOURCES += \
+        main.cpp \
+        playerdaemon.cpp \
+        $$APP/protocol.cpp \
+        $$APP/clockestimator.cpp
@@ -0,0 +1,720 @@
+#include "playerdaemon.h"
+#include "app-global.h"
+#include "clockestimator.h"
+
+#include <QBluetoothLocalDevice>
+#include <QBluetoothSocket>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QStandardPaths>
+#include <QTcpSocket>
+
+namespace {
+
+// Input without a line end or complete frame in this much is garbage
+const int MAX_READ_BUFFER = 4 * int(MAX_FRAME_SIZE);
+
+void abortDevice(QIODevice *device)
+{
+    if (auto *socket = qobject_cast<QAbstractSocket *>(device))
+        socket->abort();
+    else if (auto *socket = qobject_cast<QLocalSocket *>(device))
+        socket->abort();
+    else if (auto *socket = qobject_cast<QBluetoothSocket *>(device))
+        socket->abort();
+    else
+        device->close();
+}
+
+// The last path component, as long as it makes an ordinary file name
+QString assetName(std::string_view name)
+{
+    const QString fileName = QFileInfo(QString::fromUtf8(name.data(), int(name.size()))).fileName();
+    if (fileName.isEmpty() || fileName.startsWith(QLatin1Char('.')) || fileName.contains(QLatin1Char('\\')))
+        return QString();
+    return fileName;
+}
+
+}
+
+PlayerDaemon::PlayerDaemon(QObject *parent) :
+    QObject(parent),
+    m_tcpServer(this),
+    m_localServer(this)
+{
+    connect(&m_tcpServer, &QTcpServer::newConnection, this, &PlayerDaemon::acceptTcp);
+    connect(&m_localServer, &QLocalServer::newConnection, this, &PlayerDaemon::acceptLocal);
+
+    m_assetDirectory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QStringLiteral("/assets");
+
+    // Everything sent while handling one read goes out in one write
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    connect(&m_flushTimer, &QTimer::timeout, this, &PlayerDaemon::flush);
+
+    m_playTimer.setSingleShot(true);
+    m_playTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_playTimer, &QTimer::timeout, this, &PlayerDaemon::startPlaying);
+
+    m_volumeTimer.setSingleShot(true);
+    m_volumeTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_volumeTimer, &QTimer::timeout, this, [this]() {
+        applyVolume(m_scheduledVolume);
+    });
+
+    m_rampTimer.setInterval(RampStepInterval);
+    connect(&m_rampTimer, &QTimer::timeout, this, &PlayerDaemon::stepRamp);
+}
+
+PlayerDaemon::~PlayerDaemon()
+{
+    if (m_serviceInfo.isRegistered())
+        m_serviceInfo.unregisterService();
+
+    const QList<Client*> clients = m_clients;
+    m_clients.clear();
+    for (Client *client : clients) {
+        delete client->device;
+        delete client;
+    }
+}
+
+void PlayerDaemon::setAssetDirectory(const QString &directory)
+{
+    m_assetDirectory = directory;
+}
+
+QString PlayerDaemon::assetDirectory() const
+{
+    return m_assetDirectory;
+}
+
+bool PlayerDaemon::listenTcp(quint16 port)
+{
+    if (!m_tcpServer.listen(QHostAddress::Any, port)) {
+        qWarning() << "can't listen on TCP port" << port << m_tcpServer.errorString();
+        return false;
+    }
+
+    qInfo() << "listening on TCP port" << m_tcpServer.serverPort();
+    return true;
+}
+
+bool PlayerDaemon::listenRfcomm(const QString &serviceName)
+{
+    if (QBluetoothLocalDevice::allDevices().isEmpty()) {
+        qWarning() << "no Bluetooth adapter, can't serve RFCOMM";
+        return false;
+    }
+
+    m_rfcommServer = new QBluetoothServer(QBluetoothServiceInfo::RfcommProtocol, this);
+    connect(m_rfcommServer, &QBluetoothServer::newConnection, this, &PlayerDaemon::acceptRfcomm);
+
+    m_serviceInfo = m_rfcommServer->listen(QBluetoothUuid(BT_SERVER_UUID), serviceName);
+    if (!m_serviceInfo.isValid()) {
+        qWarning() << "can't register the RFCOMM service" << m_rfcommServer->error();
+        delete m_rfcommServer;
+        m_rfcommServer = nullptr;
+        return false;
+    }
+
+    qInfo() << "serving" << serviceName << "on RFCOMM channel" << m_rfcommServer->serverPort();
+    return true;
+}
+
+bool PlayerDaemon::listenLocal(const QString &name)
+{
+    QLocalServer::removeServer(name);
+
+    if (!m_localServer.listen(name)) {
+        qWarning() << "can't listen on" << name << m_localServer.errorString();
+        return false;
+    }
+
+    qInfo() << "listening on" << m_localServer.fullServerName();
+    return true;
+}
+
+int PlayerDaemon::clientCount() const
+{
+    return m_clients.size();
+}
+
+void PlayerDaemon::acceptTcp()
+{
+    while (QTcpSocket *socket = m_tcpServer.nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        // Unread input then backs up into the kernel and the sender's window
+        socket->setReadBufferSize(HighWater);
+        addClient(socket, QStringLiteral("%1:%2").arg(socket->peerAddress().toString()).arg(socket->peerPort()));
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            removeClient(socket);
+        });
+    }
+}
+
+void PlayerDaemon::acceptLocal()
+{
+    while (QLocalSocket *socket = m_localServer.nextPendingConnection()) {
+        addClient(socket, QStringLiteral("local"));
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            removeClient(socket);
+        });
+    }
+}
+
+void PlayerDaemon::acceptRfcomm()
+{
+    while (QBluetoothSocket *socket = m_rfcommServer->nextPendingConnection()) {
+        addClient(socket, socket->peerAddress().toString());
+        connect(socket, &QBluetoothSocket::disconnected, this, [this, socket]() {
+            removeClient(socket);
+        });
+    }
+}
+
+PlayerDaemon::Client *PlayerDaemon::addClient(QIODevice *device, const QString &peer)
+{
+    Client *client = new Client;
+    client->device = device;
+    client->peer = peer;
+    m_clients.append(client);
+
+    qInfo() << "controller connected:" << peer << "-" << m_clients.size() << "connected";
+
+    connect(device, &QIODevice::readyRead, this, [this, device]() {
+        if (Client *client = clientFor(device))
+            readClient(client);
+    });
+    connect(device, &QIODevice::bytesWritten, this, [this, device]() {
+        Client *client = clientFor(device);
+        if (client && client->lagging && backlog(client) <= LowWater)
+            clientDrained(client);
+    });
+
+    client->drainDeadline.setSingleShot(true);
+    client->drainDeadline.setInterval(DrainTimeout);
+    connect(&client->drainDeadline, &QTimer::timeout, this, [this, device]() {
+        if (Client *client = clientFor(device)) {
+            qWarning() << "dropping" << client->peer << "-" << backlog(client) << "bytes not read in"
+                       << DrainTimeout / 1000 << "s";
+            dropClient(client);
+        }
+    });
+
+    return client;
+}
+
+PlayerDaemon::Client *PlayerDaemon::clientFor(const QIODevice *device) const
+{
+    for (Client *client : m_clients) {
+        if (client->device == device)
+            return client;
+    }
+    return nullptr;
+}
+
+void PlayerDaemon::removeClient(QIODevice *device)
+{
+    Client *client = clientFor(device);
+    if (!client)
+        return;
+
+    m_clients.removeOne(client);
+    m_scanClients.remove(client);
+    qInfo() << "controller disconnected:" << client->peer << "-" << m_clients.size() << "connected";
+
+    device->deleteLater();
+    delete client;
+}
+
+void PlayerDaemon::dropClient(Client *client)
+{
+    if (client->closing)
+        return;
+
+    client->closing = true;
+    client->output.clear();
+    client->drainDeadline.stop();
+
+    QPointer<QIODevice> device(client->device);
+    QMetaObject::invokeMethod(this, [this, device]() {
+        if (!device)
+            return;
+        abortDevice(device);
+        removeClient(device);
+    }, Qt::QueuedConnection);
+}
+
+qint64 PlayerDaemon::backlog(const Client *client) const
+{
+    return client->device->bytesToWrite() + qint64(client->output.size());
+}
+
+void PlayerDaemon::readClient(Client *client)
+{
+    // A lagging client is left to drain first; its input stays queued in
+    // the socket, which for TCP also slows the controller down
+    if (client->closing || client->lagging)
+        return;
+
+    client->readBuffer.append(client->device->readAll());
+
+    m_current = client;
+    const std::size_t consumed = ProtocolParser::parse(client->readBuffer.constData(),
+                                                       static_cast<std::size_t>(client->readBuffer.size()),
+                                                       *this);
+    m_current = nullptr;
+
+    client->readBuffer.remove(0, static_cast<int>(consumed));
+    if (client->readBuffer.size() > MAX_READ_BUFFER) {
+        qWarning() << "dropping" << client->peer << "- unterminated input";
+        dropClient(client);
+    }
+}
+
+void PlayerDaemon::clientDrained(Client *client)
+{
+    qInfo() << client->peer << "caught up, sending a snapshot";
+    client->lagging = false;
+    client->drainDeadline.stop();
+    sendSnapshot(client);
+
+    if (client->device->bytesAvailable() > 0)
+        readClient(client);
+}
+
+void PlayerDaemon::flush()
+{
+    for (Client *client : qAsConst(m_clients)) {
+        if (client->output.empty() || client->closing)
+            continue;
+
+        client->device->write(client->output.data(), static_cast<qint64>(client->output.size()));
+        client->output.clear();
+    }
+}
+
+void PlayerDaemon::send(Client *client, const ProtocolMessage &message)
+{
+    if (client->closing)
+        return;
+
+    if (message.sequence && !client->stateVersions) {
+        ProtocolMessage unversioned = message;
+        unversioned.sequence = 0;
+        ProtocolWriter::encode(unversioned, client->binaryFraming, client->output);
+    } else {
+        ProtocolWriter::encode(message, client->binaryFraming, client->output);
+    }
+
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+
+    const qint64 queued = backlog(client);
+    if (queued > MaxBacklog) {
+        qWarning() << "dropping" << client->peer << "-" << queued << "bytes not read";
+        dropClient(client);
+    } else if (queued > HighWater && !client->lagging) {
+        qInfo() << client->peer << "is falling behind, holding state events";
+        client->lagging = true;
+        client->drainDeadline.start();
+    }
+}
+
+void PlayerDaemon::reply(const ProtocolMessage &message)
+{
+    if (m_current)
+        send(m_current, message);
+}
+
+void PlayerDaemon::broadcastState(ProtocolMessage message)
+{
+    message.sequence = ++m_stateVersion;
+
+    m_stateHistory.enqueue(message);
+    if (m_stateHistory.size() > StateHistorySize)
+        m_stateHistory.dequeue();
+
+    // Lagging clients get a snapshot instead once they have drained
+    for (Client *client : qAsConst(m_clients)) {
+        if (!client->lagging)
+            send(client, message);
+    }
+}
+
+void PlayerDaemon::sendSnapshot(Client *client)
+{
+    if (client->stateVersions) {
+        ProtocolMessage state{ProtocolOpcode::State, m_speakerAddress, m_stateVersion};
+        state.flags = (m_playing ? StatePlaying : 0) | (m_volume << StateVolumeShift);
+        send(client, state);
+        sendRamp(client);
+        return;
+    }
+
+    send(client, {ProtocolOpcode::Volume, 0, m_volume});
+    send(client, {m_playing ? ProtocolOpcode::Playing : ProtocolOpcode::Stopped});
+    if (m_speakerAddress)
+        send(client, {ProtocolOpcode::ConnectedSpeaker, m_speakerAddress});
+    else
+        send(client, {ProtocolOpcode::DisconnectedSpeaker});
+    sendRamp(client);
+}
+
+void PlayerDaemon::sendRamp(Client *client)
+{
+    if (!m_rampTimer.isActive() || !client->volumeRamps)
+        return;
+
+    const std::uint64_t elapsed = clock() - m_rampStart;
+    ProtocolMessage ramping{ProtocolOpcode::Ramping, 0, m_rampTo, m_rampFlags};
+    ramping.times[0] = elapsed < m_rampDuration ? m_rampDuration - elapsed : 0;
+    send(client, ramping);
+}
+
+std::uint64_t PlayerDaemon::clock()
+{
+    return std::uint64_t(ClockEstimator::now());
+}
+
+int PlayerDaemon::msecsUntil(std::uint64_t time)
+{
+    const qint64 usec = qint64(time - clock());
+    return usec > 0 ? int(qMin<qint64>((usec + 999) / 1000, 60000)) : 0;
+}
+
+void PlayerDaemon::onHello(unsigned int version, std::uint32_t capabilities)
+{
+    // Answer in text, the controller only switches once it has read this
+    reply({ProtocolOpcode::Hello, 0, PROTOCOL_VERSION, CapBinaryFraming | CapAcknowledge | CapTimeSync | CapStateVersion | CapBulkTransfer | CapVolumeRamp});
+    m_current->binaryFraming = version >= 2 && (capabilities & CapBinaryFraming);
+    m_current->stateVersions = version >= 2 && (capabilities & CapStateVersion);
+    m_current->volumeRamps = version >= 2 && (capabilities & CapVolumeRamp);
+}
+
+void PlayerDaemon::onScan()
+{
+    if (QBluetoothLocalDevice::allDevices().isEmpty()) {
+        qInfo() << "SCAN from" << m_current->peer << "- no Bluetooth adapter to scan with";
+        return;
+    }
+
+    m_scanClients.insert(m_current);
+
+    if (!m_scanAgent) {
+        m_scanAgent = new QBluetoothDeviceDiscoveryAgent(this);
+        connect(m_scanAgent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered, this, &PlayerDaemon::scanResult);
+        connect(m_scanAgent, &QBluetoothDeviceDiscoveryAgent::finished, this, [this]() {
+            m_scanClients.clear();
+        });
+        connect(m_scanAgent, static_cast<void (QBluetoothDeviceDiscoveryAgent::*)(QBluetoothDeviceDiscoveryAgent::Error)>(&QBluetoothDeviceDiscoveryAgent::error),
+                this, [this](QBluetoothDeviceDiscoveryAgent::Error error) {
+            qWarning() << "speaker scan failed" << error << m_scanAgent->errorString();
+            m_scanClients.clear();
+        });
+    }
+
+    if (!m_scanAgent->isActive())
+        m_scanAgent->start();
+}
+
+void PlayerDaemon::scanResult(const QBluetoothDeviceInfo &device)
+{
+    // Speakers are classic audio sinks
+    if (device.coreConfigurations() == QBluetoothDeviceInfo::LowEnergyCoreConfiguration
+            || device.majorDeviceClass() != QBluetoothDeviceInfo::AudioVideoDevice)
+        return;
+
+    const QByteArray name = device.name().toUtf8();
+    const ProtocolMessage message{ProtocolOpcode::BtDevice, device.address().toUInt64(), 0, 0,
+                                  std::string_view(name.constData(), static_cast<std::size_t>(name.size()))};
+    for (Client *client : qAsConst(m_scanClients))
+        send(client, message);
+}
+
+void PlayerDaemon::onConnectSpeaker(std::uint64_t address)
+{
+    m_speakerAddress = address;
+    broadcastState({ProtocolOpcode::ConnectedSpeaker, m_speakerAddress});
+}
+
+void PlayerDaemon::onUnpairSpeaker()
+{
+    m_speakerAddress = 0;
+    broadcastState({ProtocolOpcode::DisconnectedSpeaker});
+}
+
+void PlayerDaemon::onPlay()
+{
+    m_playTimer.stop();
+    startPlaying();
+}
+
+void PlayerDaemon::onStop()
+{
+    m_playTimer.stop();
+    m_playing = false;
+    broadcastState({ProtocolOpcode::Stopped});
+    // Stopping a sleep timer early also gets the volume back
+    stopRamp(m_rampFlags & RampStopAtEnd);
+}
+
+void PlayerDaemon::onSetVolume(unsigned int volume)
+{
+    m_volumeTimer.stop();
+    m_rampTimer.stop();
+    applyVolume(volume);
+}
+
+void PlayerDaemon::onTimeRequest(std::uint64_t origin)
+{
+    ProtocolMessage message{ProtocolOpcode::TimeReply};
+    message.times = {origin, clock(), clock()};
+    reply(message);
+}
+
+void PlayerDaemon::onPlayAt(std::uint64_t time)
+{
+    m_playTimer.start(msecsUntil(time));
+}
+
+void PlayerDaemon::onSetVolumeAt(unsigned int volume, std::uint64_t time)
+{
+    stopRamp(false);
+    m_scheduledVolume = volume;
+    m_volumeTimer.start(msecsUntil(time));
+}
+
+void PlayerDaemon::onGetState(std::uint64_t since)
+{
+    // Replay if everything after since is still in the history
+    const bool replay = since && since <= m_stateVersion
+            && (m_stateHistory.isEmpty() || m_stateHistory.head().sequence <= since + 1);
+
+    if (replay) {
+        for (const ProtocolMessage &event : qAsConst(m_stateHistory)) {
+            if (event.sequence > since)
+                reply(event);
+        }
+        // The history doesn't tell how far a running ramp got
+        sendRamp(m_current);
+        return;
+    }
+
+    sendSnapshot(m_current);
+}
+
+void PlayerDaemon::onUpload(std::uint64_t size, std::uint32_t checksum, std::string_view name)
+{
+    Client *client = m_current;
+    client->upload.close();
+
+    const QString fileName = assetName(name);
+    if (!client->binaryFraming || fileName.isEmpty() || size > std::uint64_t(MaxUploadSize)
+            || !QDir().mkpath(m_assetDirectory)) {
+        qInfo() << "refusing upload from" << client->peer << QString::fromUtf8(name.data(), int(name.size()));
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusRejected});
+        return;
+    }
+
+    const QString partName = QStringLiteral("%1/%2.%3-%4.part").arg(m_assetDirectory, fileName)
+            .arg(size).arg(checksum, 8, 16, QLatin1Char('0'));
+
+    // Two controllers can't add to the same file
+    for (const Client *other : qAsConst(m_clients)) {
+        if (other != client && other->upload.isOpen() && other->upload.fileName() == partName) {
+            reply({ProtocolOpcode::UploadAck, 0, 0, StatusRejected});
+            return;
+        }
+    }
+
+    client->upload.setFileName(partName);
+    if (!client->upload.open(QIODevice::ReadWrite)) {
+        qWarning() << "can't write" << partName << client->upload.errorString();
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusRejected});
+        return;
+    }
+
+    // Whatever an earlier attempt left, checksummed again to go on from it
+    std::uint32_t received = 0;
+    if (std::uint64_t(client->upload.size()) > size) {
+        client->upload.resize(0);
+    } else {
+        while (!client->upload.atEnd()) {
+            const QByteArray piece = client->upload.read(64 * 1024);
+            if (piece.isEmpty())
+                break;
+            received = protocolChecksum(piece.constData(), std::size_t(piece.size()), received);
+        }
+    }
+    client->upload.seek(client->upload.size());
+
+    qInfo() << client->peer << "uploading" << fileName << size << "bytes"
+            << (client->upload.size() ? QStringLiteral("from %1").arg(client->upload.size()) : QString());
+
+    client->uploadName = fileName;
+    client->uploadSize = size;
+    client->uploadChecksum = checksum;
+    client->uploadReceived = received;
+    client->uploadNakSent = false;
+    acknowledgeUpload(client);
+}
+
+void PlayerDaemon::onChunk(std::uint64_t offset, std::uint32_t checksum, std::string_view data)
+{
+    Client *client = m_current;
+    if (!client->upload.isOpen()) {
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusRejected});
+        return;
+    }
+
+    // Always appended at the end, pos() saves flushing for size()
+    const std::uint64_t expected = std::uint64_t(client->upload.pos());
+
+    // Sent again after a timeout, already here
+    if (offset < expected && offset + data.size() <= expected) {
+        acknowledgeUpload(client);
+        return;
+    }
+
+    if (offset != expected || expected + data.size() > client->uploadSize
+            || protocolChecksum(data.data(), data.size()) != checksum) {
+        // Go back N: one request to rewind, then silence until the
+        // expected chunk shows up
+        if (!client->uploadNakSent) {
+            client->uploadNakSent = true;
+            reply({ProtocolOpcode::UploadAck, 0, expected, StatusCorrupt});
+        }
+        return;
+    }
+
+    if (client->upload.write(data.data(), qint64(data.size())) != qint64(data.size())) {
+        qWarning() << "can't write" << client->upload.fileName() << client->upload.errorString();
+        client->upload.close();
+        reply({ProtocolOpcode::UploadAck, 0, expected, StatusRejected});
+        return;
+    }
+
+    client->uploadNakSent = false;
+    client->uploadReceived = protocolChecksum(data.data(), data.size(), client->uploadReceived);
+    acknowledgeUpload(client);
+}
+
+void PlayerDaemon::acknowledgeUpload(Client *client)
+{
+    const std::uint64_t received = std::uint64_t(client->upload.pos());
+
+    if (received < client->uploadSize) {
+        reply({ProtocolOpcode::UploadAck, 0, received, StatusOk});
+        return;
+    }
+
+    if (client->uploadReceived != client->uploadChecksum) {
+        qWarning() << "upload of" << client->uploadName << "from" << client->peer << "is corrupt, starting over";
+        client->upload.resize(0);
+        client->uploadReceived = 0;
+        reply({ProtocolOpcode::UploadAck, 0, 0, StatusCorrupt});
+        return;
+    }
+
+    const QString partName = client->upload.fileName();
+    const QString finalName = m_assetDirectory + QLatin1Char('/') + client->uploadName;
+    client->upload.close();
+    QFile::remove(finalName);
+    if (!QFile::rename(partName, finalName)) {
+        qWarning() << "can't move" << partName << "to" << finalName;
+        reply({ProtocolOpcode::UploadAck, 0, received, StatusRejected});
+        return;
+    }
+
+    qInfo() << "received" << finalName << "from" << client->peer;
+    reply({ProtocolOpcode::UploadAck, 0, received, StatusOk});
+}
+
+void PlayerDaemon::onRamp(unsigned int volume, std::uint32_t flags, std::uint64_t duration)
+{
+    if (flags & RampCancel) {
+        stopRamp(false);
+        return;
+    }
+
+    // Re-armed, a sleep timer fades on from here but still restores the
+    // volume the first one started from
+    if (!(m_rampTimer.isActive() && (flags & RampStopAtEnd) && (m_rampFlags & RampStopAtEnd)))
+        m_rampRestore = m_volume;
+
+    // A new ramp goes on from wherever the last one got to
+    m_volumeTimer.stop();
+    m_rampStart = clock();
+    m_rampDuration = duration;
+    m_rampFrom = m_volume;
+    m_rampTo = qMin(volume, 100U);
+    m_rampFlags = flags;
+    m_rampTimer.start();
+
+    qInfo() << m_current->peer << "ramps the volume from" << m_rampFrom << "to" << m_rampTo
+            << "in" << duration / 1000 << "ms";
+    // Lagging clients hear of it with their snapshot
+    for (Client *client : qAsConst(m_clients)) {
+        if (!client->lagging)
+            sendRamp(client);
+    }
+
+    stepRamp();
+}
+
+void PlayerDaemon::stepRamp()
+{
+    const std::uint64_t elapsed = clock() - m_rampStart;
+    const unsigned int volume = protocolRampVolume(m_rampFrom, m_rampTo, m_rampFlags, elapsed, m_rampDuration);
+
+    if (elapsed < m_rampDuration) {
+        // Steps aren't events, only the end is
+        m_volume = volume;
+        return;
+    }
+
+    m_rampTimer.stop();
+    if (m_rampFlags & RampStopAtEnd) {
+        m_playTimer.stop();
+        m_playing = false;
+        broadcastState({ProtocolOpcode::Stopped});
+    }
+    applyVolume(m_rampFlags & RampStopAtEnd && m_rampFlags & RampRestoreVolume ? m_rampRestore : volume);
+}
+
+void PlayerDaemon::stopRamp(bool restore)
+{
+    if (!m_rampTimer.isActive())
+        return;
+
+    m_rampTimer.stop();
+    applyVolume(restore && (m_rampFlags & RampRestoreVolume) ? m_rampRestore : m_volume);
+}
+
+void PlayerDaemon::startPlaying()
+{
+    m_playing = true;
+    broadcastState({ProtocolOpcode::Playing});
+}
+
+void PlayerDaemon::applyVolume(unsigned int volume)
+{
+    m_volume = qMin(volume, 100U);
+    broadcastState({ProtocolOpcode::Volume, 0, m_volume});
+}
+
+void PlayerDaemon::onUnrecognized(std::string_view raw)
+{
+    qInfo() << "ignoring from" << m_current->peer
+            << QByteArray::fromRawData(raw.data(), static_cast<int>(raw.size()));
+}
+
+void PlayerDaemon::onSequenced(std::uint64_t sequence, bool handled)
+{
+    reply({ProtocolOpcode::Ack, 0, sequence, handled ? StatusOk : StatusRejected});
+}
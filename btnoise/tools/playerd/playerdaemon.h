@@ -0,0 +1,192 @@
+#ifndef PLAYERDAEMON_H
+#define PLAYERDAEMON_H
+
+#include "protocol.h"
+
+#include <QObject>
+#include <QBluetoothDeviceDiscoveryAgent>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothServer>
+#include <QBluetoothServiceInfo>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QLocalServer>
+#include <QQueue>
+#include <QSet>
+#include <QTcpServer>
+#include <QTimer>
+
+#include <string>
+
+// Reference player: the player side of the protocol, headless. Any number of
+// controllers may be connected at once, over RFCOMM, TCP or a local socket,
+// all served from the one event loop. Commands from any of them change the
+// shared state, and every change is broadcast to all of them.
+//
+// Output is collected per client and written once per event loop iteration.
+// A client that stops reading is not allowed to hold up the others: beyond
+// HighWater queued bytes it gets no more state events and its input is left
+// unread, and once it has drained to LowWater it gets one snapshot of the
+// current state instead of everything it missed. One that hasn't drained
+// within DrainTimeout is dropped, before its unread input piles up in a
+// local or Bluetooth socket, which unlike TCP can't be capped. Replies alone
+// can't grow a backlog much further, MaxBacklog is the hard limit.
+//
+// Uploaded files are written to the asset directory. An unfinished upload
+// stays there as <name>.<size>-<crc>.part, and an UPLOAD of the same file
+// picks it up again, from any controller.
+//
+// Speakers are only tracked, routing audio to them is left to the platform.
+class PlayerDaemon : public QObject, private PlayerCommandHandler
+{
+    Q_OBJECT
+
+public:
+    static const qint64 HighWater = 64 * 1024;
+    static const qint64 LowWater = 16 * 1024;
+    static const qint64 MaxBacklog = 1024 * 1024;
+    // How long a lagging client has to drain to LowWater, in ms
+    static const int DrainTimeout = 10000;
+    // State events kept for GET_STATE replays
+    static const int StateHistorySize = 64;
+    // Uploads larger than this are refused
+    static const qint64 MaxUploadSize = 64 * 1024 * 1024;
+
+    explicit PlayerDaemon(QObject *parent = nullptr);
+    ~PlayerDaemon();
+
+    bool listenTcp(quint16 port);
+    // Registers the player service under BT_SERVER_UUID
+    bool listenRfcomm(const QString &serviceName);
+    bool listenLocal(const QString &name);
+
+    int clientCount() const;
+
+    // Where uploads go, created on demand
+    void setAssetDirectory(const QString &directory);
+    QString assetDirectory() const;
+
+private:
+    struct Client {
+        QIODevice *device = nullptr;
+        QString peer;
+        QByteArray readBuffer;
+        std::string output;
+        bool binaryFraming = false;
+        bool stateVersions = false;
+        // Understands RAMPING, see CapVolumeRamp
+        bool volumeRamps = false;
+        // Over HighWater, catching up with a snapshot once drained
+        bool lagging = false;
+        // Runs while lagging, drops the client when it fires
+        QTimer drainDeadline;
+        // Being dropped, nothing more is sent or read
+        bool closing = false;
+
+        // The .part file of the upload in progress, open while there is one
+        QFile upload;
+        QString uploadName;
+        std::uint64_t uploadSize = 0;
+        std::uint32_t uploadChecksum = 0;
+        // Checksum of what the .part file holds
+        std::uint32_t uploadReceived = 0;
+        // A StatusCorrupt went out, the rest of the window is ignored quietly
+        bool uploadNakSent = false;
+    };
+
+    Client *addClient(QIODevice *device, const QString &peer);
+    Client *clientFor(const QIODevice *device) const;
+    // The device disconnected, or was aborted
+    void removeClient(QIODevice *device);
+    // Aborts the connection from the event loop, not while dispatching
+    void dropClient(Client *client);
+
+    void readClient(Client *client);
+    void clientDrained(Client *client);
+    qint64 backlog(const Client *client) const;
+    void flush();
+
+    void send(Client *client, const ProtocolMessage &message);
+    void reply(const ProtocolMessage &message);
+    // Numbers a state change and sends it to every client
+    void broadcastState(ProtocolMessage message);
+    // The current state, and the running ramp if there is one
+    void sendSnapshot(Client *client);
+
+    // Microseconds on the player's monotonic clock
+    static std::uint64_t clock();
+    static int msecsUntil(std::uint64_t time);
+    void startPlaying();
+    void applyVolume(unsigned int volume);
+    void stepRamp();
+    // Ends a running ramp where it is, restore as with RampRestoreVolume
+    void stopRamp(bool restore);
+    // Tells the client about the running ramp, if it cares
+    void sendRamp(Client *client);
+    // Acknowledges the upload's progress; a complete one is checked and
+    // either moved into place or thrown away
+    void acknowledgeUpload(Client *client);
+
+    void onHello(unsigned int version, std::uint32_t capabilities) override;
+    void onScan() override;
+    void onConnectSpeaker(std::uint64_t address) override;
+    void onUnpairSpeaker() override;
+    void onPlay() override;
+    void onStop() override;
+    void onSetVolume(unsigned int volume) override;
+    void onTimeRequest(std::uint64_t origin) override;
+    void onPlayAt(std::uint64_t time) override;
+    void onSetVolumeAt(unsigned int volume, std::uint64_t time) override;
+    void onGetState(std::uint64_t since) override;
+    void onUpload(std::uint64_t size, std::uint32_t checksum, std::string_view name) override;
+    void onChunk(std::uint64_t offset, std::uint32_t checksum, std::string_view data) override;
+    void onRamp(unsigned int volume, std::uint32_t flags, std::uint64_t duration) override;
+    void onUnrecognized(std::string_view raw) override;
+    void onSequenced(std::uint64_t sequence, bool handled) override;
+
+    void acceptTcp();
+    void acceptLocal();
+    void acceptRfcomm();
+    void scanResult(const QBluetoothDeviceInfo &device);
+
+    QTcpServer m_tcpServer;
+    QLocalServer m_localServer;
+    QBluetoothServer *m_rfcommServer = nullptr;
+    QBluetoothServiceInfo m_serviceInfo;
+
+    QList<Client*> m_clients;
+    // Client whose input is being dispatched
+    Client *m_current = nullptr;
+    QTimer m_flushTimer;
+    QString m_assetDirectory;
+
+    QBluetoothDeviceDiscoveryAgent *m_scanAgent = nullptr;
+    // Clients waiting for scan results
+    QSet<Client*> m_scanClients;
+
+    unsigned int m_volume = 50;
+    bool m_playing = false;
+    std::uint64_t m_speakerAddress = 0;
+
+    std::uint64_t m_stateVersion = 0;
+    QQueue<ProtocolMessage> m_stateHistory;
+
+    QTimer m_playTimer;
+    QTimer m_volumeTimer;
+    unsigned int m_scheduledVolume = 0;
+
+    // Steps of a running RAMP
+    static const int RampStepInterval = 50;
+    QTimer m_rampTimer;
+    // Clock time the ramp started at, duration in usec
+    std::uint64_t m_rampStart = 0;
+    std::uint64_t m_rampDuration = 0;
+    unsigned int m_rampFrom = 0;
+    unsigned int m_rampTo = 0;
+    // Volume a StopAtEnd ramp puts back, kept when another one replaces it
+    unsigned int m_rampRestore = 0;
+    std::uint32_t m_rampFlags = 0;
+};
+
+#endif // PLAYERDAEMON_H
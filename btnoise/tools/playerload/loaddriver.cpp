@@ -0,0 +1,296 @@
+#include "loaddriver.h"
+#include "playersession.h"
+#include "simulatedplayer.h"
+
+#include <QJsonArray>
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void LatencySamples::add(double ms)
+{
+    m_values.push_back(ms);
+    m_sorted = false;
+}
+
+int LatencySamples::count() const
+{
+    return int(m_values.size());
+}
+
+double LatencySamples::percentile(double p) const
+{
+    if (m_values.empty())
+        return 0;
+
+    if (!m_sorted) {
+        std::sort(m_values.begin(), m_values.end());
+        m_sorted = true;
+    }
+
+    const std::size_t rank = std::size_t(std::ceil(p * double(m_values.size())));
+    return m_values[std::min(m_values.size() - 1, rank ? rank - 1 : 0)];
+}
+
+QJsonObject LatencySamples::toJson() const
+{
+    QJsonObject result;
+    result.insert(QStringLiteral("count"), count());
+    result.insert(QStringLiteral("p50"), percentile(0.5));
+    result.insert(QStringLiteral("p95"), percentile(0.95));
+    result.insert(QStringLiteral("p99"), percentile(0.99));
+    result.insert(QStringLiteral("max"), percentile(1));
+    return result;
+}
+
+LoadDriver::LoadDriver(const Options &options, QObject *parent) :
+    QObject(parent),
+    m_options(options)
+{
+    connect(&m_commandTimer, &QTimer::timeout, this, &LoadDriver::sendCommand);
+    connect(&m_floodTimer, &QTimer::timeout, this, &LoadDriver::flood);
+
+    m_lagTimer.setTimerType(Qt::PreciseTimer);
+    m_lagTimer.setInterval(LagSampleInterval);
+    connect(&m_lagTimer, &QTimer::timeout, this, &LoadDriver::sampleLag);
+
+    m_progressTimer.setInterval(ProgressInterval);
+    connect(&m_progressTimer, &QTimer::timeout, this, &LoadDriver::printProgress);
+}
+
+LoadDriver::~LoadDriver()
+{
+    stop();
+}
+
+bool LoadDriver::start()
+{
+    m_runClock.start();
+
+    if (!startPlayers())
+        return false;
+
+    if (m_options.floodInterval > 0 && (m_options.floodDevices || m_options.floodVolume))
+        m_floodTimer.start(m_options.floodInterval);
+
+    if (m_options.serveOnly) {
+        std::printf("serving %d players, connect with --transport local --player %s-0\n",
+                    m_options.players, qPrintable(m_options.prefix));
+        return true;
+    }
+
+    for (const QString &name : qAsConst(m_playerNames)) {
+        auto *session = new PlayerSession(name, name, PlayerTransport::Local, &m_metrics, this);
+
+        connect(session, &PlayerSession::connectedChanged, this, [this, session]() {
+            const qint64 now = m_runClock.elapsed();
+            if (!session->isConnected()) {
+                m_disconnects++;
+                m_disconnectedAt.insert(session, now);
+            } else if (m_disconnectedAt.contains(session)) {
+                m_reconnect.add(double(now - m_disconnectedAt.take(session)));
+            }
+        });
+
+        // What the UI would have to redraw
+        const auto count = [this]() { m_signals++; };
+        connect(session, &PlayerSession::volumeChanged, this, count);
+        connect(session, &PlayerSession::playingChanged, this, count);
+        connect(session, &PlayerSession::speakerConnectedChanged, this, count);
+        connect(session, &PlayerSession::speakerDiscovered, this, count);
+
+        m_sessions.append(session);
+        session->open();
+
+        if (!m_options.uploadFile.isEmpty()) {
+            connect(session, &PlayerSession::uploadChanged, this, [this, session]() {
+                uploadChanged(session);
+            });
+            if (!session->startUpload(m_options.uploadFile)) {
+                std::fprintf(stderr, "can't read %s\n", qPrintable(m_options.uploadFile));
+                return false;
+            }
+        }
+    }
+
+    if (m_options.commandRate > 0)
+        m_commandTimer.start(qMax(1, int(1000 / (m_options.commandRate * m_sessions.size()))));
+
+    m_lagClock.start();
+    m_lagTimer.start();
+    m_progressTimer.start();
+    return true;
+}
+
+void LoadDriver::stop()
+{
+    m_commandTimer.stop();
+    m_floodTimer.stop();
+    m_lagTimer.stop();
+    m_progressTimer.stop();
+
+    for (PlayerSession *session : qAsConst(m_sessions))
+        session->close();
+
+    stopPlayers();
+}
+
+bool LoadDriver::startPlayers()
+{
+    m_playerThread.setObjectName(QStringLiteral("players"));
+    m_playerThread.start();
+    m_playerContext = new QObject;
+    m_playerContext->moveToThread(&m_playerThread);
+
+    // Created over there, a player's sockets and timers belong to the thread
+    // that makes them
+    bool listening = true;
+    QMetaObject::invokeMethod(m_playerContext, [this, &listening]() {
+        for (int i = 0; i < m_options.players && listening; i++) {
+            auto *player = new SimulatedPlayer;
+            player->setLinkDelay(m_options.delay, m_options.jitter);
+            player->setBandwidth(m_options.bandwidth);
+            player->setDropRate(m_options.dropRate);
+            player->setDisconnectInterval(m_options.disconnectInterval);
+            player->setScanResults(m_options.scanResults);
+            listening = player->listen(QStringLiteral("%1-%2").arg(m_options.prefix).arg(i));
+            m_players.append(player);
+            m_playerNames.append(player->serverName());
+        }
+    }, Qt::BlockingQueuedConnection);
+
+    return listening;
+}
+
+void LoadDriver::stopPlayers()
+{
+    if (!m_playerThread.isRunning())
+        return;
+
+    QMetaObject::invokeMethod(m_playerContext, [this]() {
+        qDeleteAll(m_players);
+        m_players.clear();
+    }, Qt::BlockingQueuedConnection);
+
+    m_playerThread.quit();
+    m_playerThread.wait();
+    delete m_playerContext;
+    m_playerContext = nullptr;
+}
+
+void LoadDriver::sendCommand()
+{
+    PlayerSession *session = m_sessions.at(int(QRandomGenerator::global()->bounded(m_sessions.size())));
+    if (!session->isConnected())
+        return;
+
+    // Mostly slider moves, some play / stop, the odd scan
+    const int pick = int(QRandomGenerator::global()->bounded(100));
+    if (pick < 70)
+        session->setVolume(QRandomGenerator::global()->bounded(101));
+    else if (pick < 95 && session->playing())
+        session->stop();
+    else if (pick < 95)
+        session->play();
+    else
+        session->scan();
+
+    m_commands++;
+}
+
+void LoadDriver::uploadChanged(PlayerSession *session)
+{
+    const BulkUpload *upload = session->upload();
+    if (!upload->isFinished() || upload->state() == BulkUpload::Canceled)
+        return;
+
+    if (upload->state() == BulkUpload::Done) {
+        m_uploads++;
+        m_uploadedBytes += quint64(upload->size());
+        m_uploadRate.add(upload->throughput() / 1024);
+    } else {
+        m_uploadFailures++;
+    }
+
+    // Again, once this upload has finished emitting
+    QMetaObject::invokeMethod(this, [this, session]() {
+        // Not after stop()
+        if (m_lagTimer.isActive())
+            session->startUpload(m_options.uploadFile);
+    }, Qt::QueuedConnection);
+}
+
+void LoadDriver::flood()
+{
+    QMetaObject::invokeMethod(m_playerContext, [this]() {
+        for (SimulatedPlayer *player : qAsConst(m_players)) {
+            player->floodDevices(m_options.floodDevices);
+            player->floodVolume(m_options.floodVolume);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void LoadDriver::sampleLag()
+{
+    const qint64 elapsed = m_lagClock.nsecsElapsed();
+    m_lagClock.restart();
+    m_lag.add(qMax<qint64>(0, elapsed - LagSampleInterval * 1000000LL) / 1e6);
+}
+
+void LoadDriver::printProgress()
+{
+    int connected = 0;
+    for (PlayerSession *session : qAsConst(m_sessions))
+        connected += session->isConnected() ? 1 : 0;
+
+    const QVariantMap protocol = m_metrics.snapshot().value(QStringLiteral("protocol")).toMap();
+    const QVariantMap roundTrip = protocol.value(QStringLiteral("roundTrip")).toMap();
+
+    std::printf("%6.1f s  %d/%d connected  %llu commands  rtt p50 %.0f p99 %.0f ms  %llu failed"
+                "  %llu disconnects  lag p99 %.1f ms",
+                m_runClock.elapsed() / 1000.0, connected, m_sessions.size(), m_commands,
+                roundTrip.value(QStringLiteral("p50")).toDouble(), roundTrip.value(QStringLiteral("p99")).toDouble(),
+                protocol.value(QStringLiteral("failed")).toULongLong(), m_disconnects, m_lag.percentile(0.99));
+    if (!m_options.uploadFile.isEmpty())
+        std::printf("  %llu uploads at p50 %.1f KiB/s", m_uploads, m_uploadRate.percentile(0.5));
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+QJsonObject LoadDriver::report() const
+{
+    QJsonObject options;
+    options.insert(QStringLiteral("players"), m_options.players);
+    options.insert(QStringLiteral("delay"), m_options.delay);
+    options.insert(QStringLiteral("jitter"), m_options.jitter < 0 ? m_options.delay : m_options.jitter);
+    options.insert(QStringLiteral("bandwidth"), m_options.bandwidth);
+    options.insert(QStringLiteral("dropRate"), m_options.dropRate);
+    options.insert(QStringLiteral("disconnectInterval"), m_options.disconnectInterval);
+    options.insert(QStringLiteral("scanResults"), m_options.scanResults);
+    options.insert(QStringLiteral("floodDevices"), m_options.floodDevices);
+    options.insert(QStringLiteral("floodVolume"), m_options.floodVolume);
+    options.insert(QStringLiteral("floodInterval"), m_options.floodInterval);
+    options.insert(QStringLiteral("commandRate"), m_options.commandRate);
+    options.insert(QStringLiteral("uploadFile"), m_options.uploadFile);
+
+    QJsonObject result;
+    result.insert(QStringLiteral("options"), options);
+    result.insert(QStringLiteral("duration"), m_runClock.elapsed() / 1000.0);
+    result.insert(QStringLiteral("commands"), double(m_commands));
+    result.insert(QStringLiteral("signals"), double(m_signals));
+    result.insert(QStringLiteral("disconnects"), double(m_disconnects));
+    result.insert(QStringLiteral("reconnect"), m_reconnect.toJson());
+    result.insert(QStringLiteral("eventLoopLag"), m_lag.toJson());
+    if (!m_options.uploadFile.isEmpty()) {
+        QJsonObject uploads;
+        uploads.insert(QStringLiteral("finished"), double(m_uploads));
+        uploads.insert(QStringLiteral("failed"), double(m_uploadFailures));
+        uploads.insert(QStringLiteral("bytes"), double(m_uploadedBytes));
+        uploads.insert(QStringLiteral("throughput"), m_uploadRate.toJson());
+        result.insert(QStringLiteral("uploads"), uploads);
+    }
+    result.insert(QStringLiteral("controller"), m_metrics.toJson());
+    return result;
+}
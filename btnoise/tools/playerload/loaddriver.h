@@ -0,0 +1,124 @@
+#ifndef LOADDRIVER_H
+#define LOADDRIVER_H
+
+#include "metrics.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+#include <vector>
+
+class PlayerSession;
+class SimulatedPlayer;
+
+// Every sample kept, for exact percentiles; fine for runs of minutes
+class LatencySamples
+{
+public:
+    void add(double ms);
+    int count() const;
+    double percentile(double p) const;
+    QJsonObject toJson() const;
+
+private:
+    mutable std::vector<double> m_values;
+    mutable bool m_sorted = true;
+};
+
+// Runs N stand-in players on local sockets and, unless only serving, one
+// controller session per player driving them with a steady command mix.
+// Latencies are recorded on the controller side: command round trips and
+// reconnect times from the sessions, and how late the event loop gets to a
+// timer as a measure of UI responsiveness under event floods. The players
+// run on a thread of their own, so that lag is the controller's alone.
+class LoadDriver : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        int players = 4;
+        QString prefix = QStringLiteral("btnoise-load");
+        bool serveOnly = false;
+
+        // Link, see SimulatedPlayer
+        int delay = 0;
+        int jitter = -1;
+        int bandwidth = 0;
+        qreal dropRate = 0;
+        int disconnectInterval = 0;
+
+        int scanResults = 0;
+        // Per player, every floodInterval ms
+        int floodDevices = 0;
+        int floodVolume = 0;
+        int floodInterval = 5000;
+
+        // Commands per second per controller
+        qreal commandRate = 5;
+
+        // Uploaded by every controller over and over, alongside the
+        // commands
+        QString uploadFile;
+    };
+
+    // Event loop lag is sampled this often, in ms
+    static const int LagSampleInterval = 10;
+    static const int ProgressInterval = 5000;
+
+    explicit LoadDriver(const Options &options, QObject *parent = nullptr);
+    ~LoadDriver();
+
+    bool start();
+    void stop();
+
+    QJsonObject report() const;
+
+private:
+    bool startPlayers();
+    void stopPlayers();
+    void sendCommand();
+    void flood();
+    void sampleLag();
+    void printProgress();
+    void uploadChanged(PlayerSession *session);
+
+    Options m_options;
+    Metrics m_metrics;
+    // Living on m_playerThread, only touched through queued calls
+    QThread m_playerThread;
+    QObject *m_playerContext = nullptr;
+    QList<SimulatedPlayer *> m_players;
+    QStringList m_playerNames;
+    QList<PlayerSession *> m_sessions;
+
+    QTimer m_commandTimer;
+    QTimer m_floodTimer;
+    QTimer m_lagTimer;
+    QTimer m_progressTimer;
+    QElapsedTimer m_lagClock;
+    QElapsedTimer m_runClock;
+
+    // Run clock time each session lost its player, in ms
+    QHash<PlayerSession *, qint64> m_disconnectedAt;
+    LatencySamples m_reconnect;
+    LatencySamples m_lag;
+    quint64 m_commands = 0;
+    quint64 m_disconnects = 0;
+    quint64 m_signals = 0;
+
+    // Throughput of finished uploads, in KiB/s
+    LatencySamples m_uploadRate;
+    quint64 m_uploads = 0;
+    quint64 m_uploadFailures = 0;
+    quint64 m_uploadedBytes = 0;
+};
+
+#endif // LOADDRIVER_H
@@ -0,0 +1,96 @@
+#include "loaddriver.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QSaveFile>
+#include <QTimer>
+
+#include <cstdio>
+
+// Load generator: many stand-in players with impaired links, driven by
+// controller sessions from the app, printing latency percentiles.
+//
+//     playerload --players 8 --delay 40 --drop-rate 0.01 --disconnect-every 20000
+//     playerload --serve-only --flood-devices 2000 --flood-interval 10000
+//     playerload --players 1 --bandwidth 90000 --delay 20 --upload rain.ogg
+//
+// With --serve-only nothing drives the players, the app is pointed at one of
+// them instead.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("playerload"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Emulates many btnoise players and measures the controller against them."));
+    parser.addHelpOption();
+
+    QCommandLineOption playersOption("players", "Number of players.", "n", "4");
+    QCommandLineOption prefixOption("prefix", "Local socket names are <prefix>-0, <prefix>-1 ...", "name", "btnoise-load");
+    QCommandLineOption serveOption("serve-only", "Only run the players, for the app to connect to.");
+    QCommandLineOption durationOption("duration", "Seconds to run, 0 to run until killed (no report).", "s", "30");
+    QCommandLineOption delayOption("delay", "One way link delay.", "ms", "0");
+    QCommandLineOption jitterOption("jitter", "Random extra delay, defaults to the delay.", "ms");
+    QCommandLineOption bandwidthOption("bandwidth", "Link capacity per direction, 0 for none.", "bytes/s", "0");
+    QCommandLineOption dropOption("drop-rate", "Share of replies and events lost, 0 to 1.", "rate", "0");
+    QCommandLineOption disconnectOption("disconnect-every", "Cut the link at random times averaging this.", "ms", "0");
+    QCommandLineOption scanOption("scan-results", "Speakers reported per SCAN.", "n", "0");
+    QCommandLineOption floodDevicesOption("flood-devices", "BT_DEVICE reports per flood.", "n", "0");
+    QCommandLineOption floodVolumeOption("flood-volume", "VOL changes per flood.", "n", "0");
+    QCommandLineOption floodIntervalOption("flood-interval", "Time between floods.", "ms", "5000");
+    QCommandLineOption rateOption("command-rate", "Commands per second per controller.", "n", "5");
+    QCommandLineOption uploadOption("upload", "File each controller uploads again and again.", "file");
+    QCommandLineOption reportOption("report", "Write the final report as JSON to file.", "file");
+    QCommandLineOption verboseOption("verbose", "Keep the app's protocol logging.");
+
+    parser.addOptions({ playersOption, prefixOption, serveOption, durationOption, delayOption, jitterOption,
+                        bandwidthOption, dropOption, disconnectOption, scanOption, floodDevicesOption,
+                        floodVolumeOption, floodIntervalOption, rateOption, uploadOption, reportOption, verboseOption });
+    parser.process(app);
+
+    if (!parser.isSet(verboseOption))
+        QLoggingCategory::setFilterRules(QStringLiteral("btnoise.*.info=false"));
+
+    LoadDriver::Options options;
+    options.players = qMax(1, parser.value(playersOption).toInt());
+    options.prefix = parser.value(prefixOption);
+    options.serveOnly = parser.isSet(serveOption);
+    options.delay = parser.value(delayOption).toInt();
+    options.jitter = parser.isSet(jitterOption) ? parser.value(jitterOption).toInt() : -1;
+    options.bandwidth = parser.value(bandwidthOption).toInt();
+    options.dropRate = parser.value(dropOption).toDouble();
+    options.disconnectInterval = parser.value(disconnectOption).toInt();
+    options.scanResults = parser.value(scanOption).toInt();
+    options.floodDevices = parser.value(floodDevicesOption).toInt();
+    options.floodVolume = parser.value(floodVolumeOption).toInt();
+    options.floodInterval = parser.value(floodIntervalOption).toInt();
+    options.commandRate = parser.value(rateOption).toDouble();
+    options.uploadFile = parser.value(uploadOption);
+
+    LoadDriver driver(options);
+    if (!driver.start())
+        return 1;
+
+    const int duration = parser.value(durationOption).toInt();
+    if (duration > 0)
+        QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+
+    const int result = app.exec();
+    driver.stop();
+
+    const QByteArray report = QJsonDocument(driver.report()).toJson();
+    std::fwrite(report.constData(), 1, std::size_t(report.size()), stdout);
+
+    if (parser.isSet(reportOption)) {
+        QSaveFile file(parser.value(reportOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(report) != report.size() || !file.commit()) {
+            std::fprintf(stderr, "can't write %s\n", qPrintable(parser.value(reportOption)));
+            return 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,51 @@
+# Load generator for the player protocol, see main.cpp. Linux / desktop only,
+# it serves the players on local sockets like the SIMULATOR build does.
+TEMPLATE = app
+TARGET = playerload
+
+QT += bluetooth network
+QT -= gui
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+APP = $$PWD/../..
+INCLUDEPATH += $$APP
+
+HEADERS += \
+        loaddriver.h \
+        $$APP/playertransport.h \
+        $$APP/rfcommtransport.h \
+        $$APP/tcptransport.h \
+        $$APP/localtransport.h \
+        $$APP/protocol.h \
+        $$APP/clockestimator.h \
+        $$APP/outboundbuffer.h \
+        $$APP/commandtracker.h \
+        $$APP/offlinequeue.h \
+        $$APP/bulkupload.h \
+        $$APP/connectionstatemachine.h \
+        $$APP/playersession.h \
+        $$APP/simulatedplayer.h \
+        $$APP/trace.h \
+        $$APP/metrics.h \
+        $$APP/startuptimeline.h
+
+SOURCES += \
+        main.cpp \
+        loaddriver.cpp \
+        $$APP/playertransport.cpp \
+        $$APP/rfcommtransport.cpp \
+        $$APP/tcptransport.cpp \
+        $$APP/localtransport.cpp \
+        $$APP/protocol.cpp \
+        $$APP/clockestimator.cpp \
+        $$APP/outboundbuffer.cpp \
+        $$APP/commandtracker.cpp \
+        $$APP/offlinequeue.cpp \
+        $$APP/bulkupload.cpp \
+        $$APP/connectionstatemachine.cpp \
+        $$APP/playersession.cpp \
+        $$APP/simulatedplayer.cpp \
+        $$APP/trace.cpp \
+        $$APP/metrics.cpp \
+        $$APP/startuptimeline.cpp
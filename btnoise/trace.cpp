@@ -0,0 +1,152 @@
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QIODevice>
+
+Q_LOGGING_CATEGORY(lcTransport, "btnoise.transport", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcProtocol, "btnoise.protocol", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcDiscovery, "btnoise.discovery", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcUi, "btnoise.ui", QtInfoMsg)
+
+static_assert((TraceBuffer::CAPACITY & (TraceBuffer::CAPACITY - 1)) == 0,
+              "trace capacity must be a power of two");
+
+static QElapsedTimer &traceClock()
+{
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock;
+}
+
+TraceBuffer::TraceBuffer()
+{
+    traceClock();
+}
+
+TraceBuffer &TraceBuffer::instance()
+{
+    static TraceBuffer buffer;
+    return buffer;
+}
+
+void TraceBuffer::record(Trace::Category category, Trace::Event event, quint32 arg0, quint64 arg1) noexcept
+{
+    const quint64 position = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = m_slots[position & (CAPACITY - 1)];
+
+    // Seqlock per slot: readers skip a slot that is being rewritten
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.record.time = static_cast<quint64>(traceClock().nsecsElapsed());
+    slot.record.arg1 = arg1;
+    slot.record.arg0 = arg0;
+    slot.record.event = event;
+    slot.record.category = category;
+    slot.record.reserved = 0;
+
+    slot.sequence.store(position + 1, std::memory_order_release);
+}
+
+std::vector<Trace::Record> TraceBuffer::snapshot() const
+{
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 first = head > CAPACITY ? head - CAPACITY : 0;
+
+    std::vector<Trace::Record> records;
+    records.reserve(static_cast<std::size_t>(head - first));
+
+    for (quint64 position = first; position < head; position++) {
+        const Slot &slot = m_slots[position & (CAPACITY - 1)];
+
+        const quint64 before = slot.sequence.load(std::memory_order_acquire);
+        const Trace::Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const quint64 after = slot.sequence.load(std::memory_order_relaxed);
+
+        // Overwritten or still being written while we copied it
+        if (before != position + 1 || after != before)
+            continue;
+
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+void TraceBuffer::dump(QIODevice *out) const
+{
+    char line[160];
+    for (const Trace::Record &record : snapshot()) {
+        const int length = qsnprintf(line, sizeof(line), "%12.6f %-9s %-19s %u %llu\n",
+                                     record.time / 1e9,
+                                     categoryName(record.category),
+                                     eventName(record.event),
+                                     record.arg0,
+                                     static_cast<unsigned long long>(record.arg1));
+        out->write(line, qMin(length, int(sizeof(line)) - 1));
+    }
+}
+
+const char *TraceBuffer::categoryName(quint8 category)
+{
+    switch (category) {
+    case Trace::Transport:
+        return "transport";
+    case Trace::Protocol:
+        return "protocol";
+    case Trace::Discovery:
+        return "discovery";
+    case Trace::Ui:
+        return "ui";
+    }
+    return "?";
+}
+
+const char *TraceBuffer::eventName(quint16 event)
+{
+    switch (event) {
+    case Trace::BytesRead:
+        return "bytes-read";
+    case Trace::BytesFlushed:
+        return "bytes-flushed";
+    case Trace::ConnectionState:
+        return "connection-state";
+    case Trace::MessageReceived:
+        return "message-received";
+    case Trace::CommandSent:
+        return "command-sent";
+    case Trace::CommandAcknowledged:
+        return "command-acked";
+    case Trace::CommandFailed:
+        return "command-failed";
+    case Trace::LineDropped:
+        return "line-dropped";
+    case Trace::ClockSampled:
+        return "clock-sampled";
+    case Trace::UploadRewound:
+        return "upload-rewound";
+    case Trace::ScanStarted:
+        return "scan-started";
+    case Trace::ScanFinished:
+        return "scan-finished";
+    case Trace::PlayerFound:
+        return "player-found";
+    case Trace::SpeakerFound:
+        return "speaker-found";
+    case Trace::VolumeSet:
+        return "volume-set";
+    case Trace::VolumeSent:
+        return "volume-sent";
+    case Trace::PlayRequested:
+        return "play-requested";
+    case Trace::StopRequested:
+        return "stop-requested";
+    case Trace::RampRequested:
+        return "ramp-requested";
+    }
+    return "?";
+}
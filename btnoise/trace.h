@@ -0,0 +1,108 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtGlobal>
+#include <QLoggingCategory>
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+class QIODevice;
+
+// Text logging goes through these categories, e.g.
+// QT_LOGGING_RULES="btnoise.protocol.info=false" silences one subsystem.
+Q_DECLARE_LOGGING_CATEGORY(lcTransport)
+Q_DECLARE_LOGGING_CATEGORY(lcProtocol)
+Q_DECLARE_LOGGING_CATEGORY(lcDiscovery)
+Q_DECLARE_LOGGING_CATEGORY(lcUi)
+
+namespace Trace {
+
+enum Category : quint8 {
+    Transport,
+    Protocol,
+    Discovery,
+    Ui
+};
+
+enum Event : quint16 {
+    // Transport
+    BytesRead,              // bytes
+    BytesFlushed,           // bytes
+    ConnectionState,        // state, previous
+    // Protocol
+    MessageReceived,        // opcode, value
+    CommandSent,            // opcode, sequence
+    CommandAcknowledged,    // opcode, round trip usec
+    CommandFailed,          // opcode, timed out
+    LineDropped,            // bytes
+    ClockSampled,           // round trip usec, offset usec
+    UploadRewound,          // offset, previous next offset
+    // Discovery
+    ScanStarted,            // targeted
+    ScanFinished,
+    PlayerFound,            // -, address
+    SpeakerFound,           // -, address
+    // Ui
+    VolumeSet,              // volume
+    VolumeSent,             // volume
+    PlayRequested,
+    StopRequested,
+    RampRequested           // volume, duration usec
+};
+
+// One trace point, fixed size so recording never allocates or formats
+struct Record {
+    quint64 time;           // nsecs since the buffer was created
+    quint64 arg1;
+    quint32 arg0;
+    quint16 event;
+    quint8 category;
+    quint8 reserved;
+};
+
+} // namespace Trace
+
+// Process wide ring of the most recent trace records. Recording is lock
+// free and safe from any thread, old records are overwritten.
+class TraceBuffer
+{
+public:
+    static const std::size_t CAPACITY = 4096;
+
+    static TraceBuffer &instance();
+
+    void record(Trace::Category category, Trace::Event event, quint32 arg0, quint64 arg1) noexcept;
+
+    // Records still in the ring, oldest first
+    std::vector<Trace::Record> snapshot() const;
+    // One text line per record
+    void dump(QIODevice *out) const;
+
+    static const char *categoryName(quint8 category);
+    static const char *eventName(quint16 event);
+
+private:
+    TraceBuffer();
+
+    struct Slot {
+        // 0 while being written, otherwise the record's position + 1
+        std::atomic<quint64> sequence{0};
+        Trace::Record record;
+    };
+
+    std::atomic<quint64> m_head{0};
+    std::array<Slot, CAPACITY> m_slots;
+};
+
+// Compiled out entirely with CONFIG+=notrace
+#ifdef NO_TRACE
+#define TRACE(category, event, arg0, arg1) do { } while (false)
+#else
+#define TRACE(category, event, arg0, arg1) \
+    TraceBuffer::instance().record(Trace::category, Trace::event, \
+                                   static_cast<quint32>(arg0), static_cast<quint64>(arg1))
+#endif
+
+#endif // TRACE_H